@@ -0,0 +1,180 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <Math.h>
+#include "Affine34.h"
+
+// the implicit last column
+static __m128 UnitW()
+{
+	return _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+static __m128 Cross(const __m128 a, const __m128 b)
+{
+	// (a.yzx * b.zxy) - (a.zxy * b.yzx), w drops to 0
+	const __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	const __m128 bZXY = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+	const __m128 aZXY = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+	const __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+
+	return _mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX));
+}
+
+// one row of A * B: b is that row of B, a0..a2 are A's rows
+//     the rows by reference - Win32 passes only three __m128 in registers
+static __m128 MulRow(const __m128 b, const __m128 &a0, const __m128 &a1, const __m128 &a2)
+{
+	const __m128 _x = _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0));
+	const __m128 _y = _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1));
+	const __m128 _z = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2));
+	const __m128 _w = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3));
+
+	// same grouping as Matrix's (x + y) + (z + w), the w term carries B's translation
+	const __m128 xy = _mm_add_ps(_mm_mul_ps(a0, _x), _mm_mul_ps(a1, _y));
+	const __m128 zw = _mm_add_ps(_mm_mul_ps(a2, _z), _mm_mul_ps(UnitW(), _w));
+
+	return _mm_add_ps(xy, zw);
+}
+
+Affine34::Affine34()
+{
+	this->setIdentMatrix();
+}
+
+Affine34::Affine34(const Matrix &m)
+{
+	Vect4D row0;
+	Vect4D row1;
+	Vect4D row2;
+	Vect4D row3;
+	m.get(Matrix::MatrixRow::MATRIX_ROW_0, row0);
+	m.get(Matrix::MatrixRow::MATRIX_ROW_1, row1);
+	m.get(Matrix::MatrixRow::MATRIX_ROW_2, row2);
+	m.get(Matrix::MatrixRow::MATRIX_ROW_3, row3);
+
+	_MM_TRANSPOSE4_PS(row0._m, row1._m, row2._m, row3._m);
+
+	// row3 is now the last column
+	assert(_mm_movemask_ps(_mm_cmpeq_ps(row3._m, UnitW())) == 0xF);
+
+	this->r0 = row0._m;
+	this->r1 = row1._m;
+	this->r2 = row2._m;
+}
+
+void Affine34::toMatrix(Matrix &out) const
+{
+	__m128 row0 = this->r0;
+	__m128 row1 = this->r1;
+	__m128 row2 = this->r2;
+	__m128 row3 = UnitW();
+
+	_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+	// known affine, no need to look at the last column
+	out.v0._m = row0;
+	out.v1._m = row1;
+	out.v2._m = row2;
+	out.v3._m = row3;
+	out.structure = Matrix::AFFINE;
+}
+
+void Affine34::setIdentMatrix()
+{
+	this->r0 = _mm_setr_ps(1.0f, 0.0f, 0.0f, 0.0f);
+	this->r1 = _mm_setr_ps(0.0f, 1.0f, 0.0f, 0.0f);
+	this->r2 = _mm_setr_ps(0.0f, 0.0f, 1.0f, 0.0f);
+}
+
+void Affine34::setTransMatrix(const Vect4D &t)
+{
+	this->r0 = _mm_setr_ps(1.0f, 0.0f, 0.0f, t.x);
+	this->r1 = _mm_setr_ps(0.0f, 1.0f, 0.0f, t.y);
+	this->r2 = _mm_setr_ps(0.0f, 0.0f, 1.0f, t.z);
+}
+
+void Affine34::setScaleMatrix(const Vect4D &s)
+{
+	this->r0 = _mm_setr_ps(s.x, 0.0f, 0.0f, 0.0f);
+	this->r1 = _mm_setr_ps(0.0f, s.y, 0.0f, 0.0f);
+	this->r2 = _mm_setr_ps(0.0f, 0.0f, s.z, 0.0f);
+}
+
+void Affine34::setRotZMatrix(float az)
+{
+	// transpose of Matrix::setRotZMatrix
+	this->setRotZMatrix(cos(az), sin(az));
+}
+
+void Affine34::setRotZMatrix(float c, float s)
+{
+	this->r0 = _mm_setr_ps(c, s, 0.0f, 0.0f);
+	this->r1 = _mm_setr_ps(-s, c, 0.0f, 0.0f);
+	this->r2 = _mm_setr_ps(0.0f, 0.0f, 1.0f, 0.0f);
+}
+
+Affine34 Affine34::operator * (const Affine34 &t) const
+{
+	Affine34 tmp;
+
+	tmp.r0 = MulRow(t.r0, this->r0, this->r1, this->r2);
+	tmp.r1 = MulRow(t.r1, this->r0, this->r1, this->r2);
+	tmp.r2 = MulRow(t.r2, this->r0, this->r1, this->r2);
+
+	return tmp;
+}
+
+float Affine34::Determinant() const
+{
+	// the translation doesn't count - dot over xyz only
+	return _mm_cvtss_f32(_mm_dp_ps(this->r0, Cross(this->r1, this->r2), 0x71));
+}
+
+void Affine34::Inverse(Affine34 &out) const
+{
+	// 3x3 part: rows of the inverse are the cross products of the columns over
+	// the determinant - stored transposed, so transpose them back
+	__m128 x0 = Cross(this->r1, this->r2);
+	__m128 x1 = Cross(this->r2, this->r0);
+	__m128 x2 = Cross(this->r0, this->r1);
+	__m128 x3 = _mm_setzero_ps();
+
+	const float det = _mm_cvtss_f32(_mm_dp_ps(this->r0, x0, 0x71));
+	if( fabs(det) < 0.0001 )
+	{
+		// not invertible
+		out.r0 = _mm_setzero_ps();
+		out.r1 = _mm_setzero_ps();
+		out.r2 = _mm_setzero_ps();
+		return;
+	}
+
+	_MM_TRANSPOSE4_PS(x0, x1, x2, x3);
+
+	const __m128 invDet = _mm_set_ps1(1.0f / det);
+	x0 = _mm_mul_ps(x0, invDet);
+	x1 = _mm_mul_ps(x1, invDet);
+	x2 = _mm_mul_ps(x2, invDet);
+
+	// translation: -t * inverse(3x3), t gathered from the w lanes
+	const __m128 t = _mm_shuffle_ps(_mm_unpackhi_ps(this->r0, this->r1), this->r2, _MM_SHUFFLE(3, 3, 3, 2));
+
+	out.r0 = _mm_sub_ps(x0, _mm_dp_ps(x0, t, 0x78));
+	out.r1 = _mm_sub_ps(x1, _mm_dp_ps(x1, t, 0x78));
+	out.r2 = _mm_sub_ps(x2, _mm_dp_ps(x2, t, 0x78));
+}
+
+Vect4D Affine34::transformPoint(const Vect4D &p) const
+{
+	const __m128 p1 = _mm_blend_ps(p._m, UnitW(), 0x8);
+
+	const __m128 _x = _mm_dp_ps(this->r0, p1, 0xF1);
+	const __m128 _y = _mm_dp_ps(this->r1, p1, 0xF2);
+	const __m128 _z = _mm_dp_ps(this->r2, p1, 0xF4);
+
+	return Vect4D(_mm_or_ps(_mm_or_ps(_x, _y), _mm_or_ps(_z, UnitW())));
+}
+
+// --- End of File ---
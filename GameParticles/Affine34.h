@@ -0,0 +1,64 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef AFFINE34_H
+#define AFFINE34_H
+
+#include "Vect4D.h"
+#include "Matrix.h"
+
+// Affine transform in 48 bytes instead of the 64 of a Matrix
+//
+//     Matrix is row vector (v' = v * M). Scale, rotation and translation
+//     leave its last column at 0 0 0 1, so only 12 floats carry anything.
+//     Affine34 keeps those 12 transposed, one output component per row:
+//
+//         r0 = ( m0, m4, m8,  m12 )      x' = dot(r0, (x y z 1))
+//         r1 = ( m1, m5, m9,  m13 )      y' = dot(r1, (x y z 1))
+//         r2 = ( m2, m6, m10, m14 )      z' = dot(r2, (x y z 1))
+//
+//     A * B means the same as for Matrix: A first, then B. A product is
+//     12 multiplies instead of 16, in the same order as Matrix's, so
+//     toMatrix() gives back the bits the 4x4 product would have made.
+//     The inverse is a 3x3 one plus a translation.
+class Affine34
+{
+public:
+	// identity
+	Affine34();
+	Affine34(const Affine34 &t) = default;
+	Affine34 &operator = (const Affine34 &t) = default;
+	~Affine34() = default;
+
+	// the last column of m has to be 0 0 0 1
+	explicit Affine34(const Matrix &m);
+	void toMatrix(Matrix &out) const;
+
+	void setIdentMatrix();
+	void setTransMatrix(const Vect4D &t);
+	void setScaleMatrix(const Vect4D &s);
+	void setRotZMatrix(float Z_Radians);
+
+	// from a unit (cos, sin) pair - no trig
+	void setRotZMatrix(float cosZ, float sinZ);
+
+	Affine34 operator * (const Affine34 &t) const;
+
+	float Determinant() const;
+
+	// all zero when not invertible, like Matrix::Inverse
+	void Inverse(Affine34 &out) const;
+
+	// (x y z 1) * this, w comes back 1
+	Vect4D transformPoint(const Vect4D &p) const;
+
+private:
+	__m128	r0;
+	__m128	r1;
+	__m128	r2;
+};
+
+#endif
+
+// --- End of File ---
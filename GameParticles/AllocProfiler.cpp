@@ -0,0 +1,279 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include "AllocProfiler.h"
+
+#if ALLOC_PROFILER_ENABLED
+	#include <crtdbg.h>
+
+	static _CRT_ALLOC_HOOK pPreviousHook = nullptr;
+	static thread_local const char *t_pScope = nullptr;
+#endif
+
+AllocProfiler *AllocProfiler::pActive = nullptr;
+
+AllocProfiler::AllocProfiler(int _warmUpFrames)
+	: sites(),
+	scopes(),
+	numSites(0),
+	numScopes(0),
+	droppedSites(0),
+	frameCount(0),
+	frameBytes(0),
+	warmUpFrames(_warmUpFrames),
+	frames(0),
+	allocFrames(0),
+	worstCount(0),
+	worstBytes(0),
+	worstFrame(-1),
+	totalCount(0),
+	totalBytes(0),
+	lock(false),
+	installed(false)
+{
+}
+
+AllocProfiler::~AllocProfiler()
+{
+#if ALLOC_PROFILER_ENABLED
+	if( this->installed )
+	{
+		_CrtSetAllocHook(pPreviousHook);
+		AllocProfiler::pActive = nullptr;
+	}
+#endif
+}
+
+const char *AllocProfiler::GetScope()
+{
+#if ALLOC_PROFILER_ENABLED
+	return t_pScope;
+#else
+	return nullptr;
+#endif
+}
+
+void AllocProfiler::SetScope(const char *pName)
+{
+#if ALLOC_PROFILER_ENABLED
+	t_pScope = pName;
+#else
+	AZUL_UNUSED_VAR(pName);
+#endif
+}
+
+void AllocProfiler::startup()
+{
+#if ALLOC_PROFILER_ENABLED
+	// one at a time, the hook is process wide
+	assert(AllocProfiler::pActive == nullptr);
+
+	AllocProfiler::pActive = this;
+	pPreviousHook = _CrtSetAllocHook(&AllocProfiler::privHook);
+	this->installed = true;
+#endif
+}
+
+int __cdecl AllocProfiler::privHook(int allocType, void *pUserData, size_t size, int blockType,
+	long requestNumber, const unsigned char *pFileName, int lineNumber)
+{
+#if ALLOC_PROFILER_ENABLED
+	AllocProfiler *pProfiler = AllocProfiler::pActive;
+
+	// the CRT's own blocks (printf buffers...) - and calling into it from here could recurse
+	if( pProfiler != nullptr && blockType != _CRT_BLOCK && allocType != _HOOK_FREE )
+	{
+		pProfiler->privRecord(size, reinterpret_cast<const char *>(pFileName), lineNumber);
+	}
+
+	if( pPreviousHook != nullptr )
+	{
+		return pPreviousHook(allocType, pUserData, size, blockType, requestNumber, pFileName, lineNumber);
+	}
+#else
+	AZUL_UNUSED_VAR(allocType);
+	AZUL_UNUSED_VAR(pUserData);
+	AZUL_UNUSED_VAR(size);
+	AZUL_UNUSED_VAR(blockType);
+	AZUL_UNUSED_VAR(requestNumber);
+	AZUL_UNUSED_VAR(pFileName);
+	AZUL_UNUSED_VAR(lineNumber);
+#endif
+	return 1;
+}
+
+void AllocProfiler::privLock()
+{
+	while( this->lock.exchange(true, std::memory_order_acquire) )
+	{
+		_mm_pause();
+	}
+}
+
+void AllocProfiler::privUnlock()
+{
+	this->lock.store(false, std::memory_order_release);
+}
+
+// any thread, inside the heap - no allocation from here on
+void AllocProfiler::privRecord(size_t size, const char *pFile, int line)
+{
+	const char *pScope = AllocProfiler::GetScope();
+	const bool steady = (this->frames >= this->warmUpFrames);
+
+	this->privLock();
+
+	this->frameCount++;
+	this->frameBytes += size;
+	this->totalCount++;
+	this->totalBytes += size;
+
+	// per stage
+	int s = 0;
+	while( s < this->numScopes && this->scopes[s].pName != pScope )
+	{
+		s++;
+	}
+	if( s == this->numScopes && s < MAX_SCOPES )
+	{
+		this->scopes[s] = { pScope, 0, 0, 0 };
+		this->numScopes++;
+	}
+	if( s < this->numScopes )
+	{
+		ScopeTotal &total = this->scopes[s];
+		total.count++;
+		total.bytes += size;
+		total.steadyCount += steady ? 1 : 0;
+	}
+
+	// per call site - file names are literals (__FILE__), the pointer is the key
+	int i = 0;
+	while( i < this->numSites
+		&& !(this->sites[i].pFile == pFile && this->sites[i].line == line && this->sites[i].pScope == pScope) )
+	{
+		i++;
+	}
+	if( i == this->numSites && i < MAX_SITES )
+	{
+		this->sites[i] = { pFile, line, pScope, 0, 0, 0, 0, 0 };
+		this->numSites++;
+	}
+	if( i < this->numSites )
+	{
+		Site &site = this->sites[i];
+		site.count++;
+		site.bytes += size;
+		site.steadyCount += steady ? 1 : 0;
+		site.frameCount++;
+		site.frameSize += size;
+	}
+	else
+	{
+		this->droppedSites++;
+	}
+
+	this->privUnlock();
+}
+
+void AllocProfiler::frame()
+{
+	// nothing else runs between two frames - unhook while printing
+	AllocProfiler::pActive = nullptr;
+
+	const bool steady = (this->frames >= this->warmUpFrames);
+	if( steady && this->frameCount > 0 )
+	{
+		this->allocFrames++;
+		if( this->frameCount > this->worstCount )
+		{
+			this->worstCount = this->frameCount;
+			this->worstBytes = this->frameBytes;
+			this->worstFrame = this->frames;
+		}
+
+		Trace::out("--- AllocProfiler: frame %d allocated %d times, %d bytes ---\n",
+			this->frames, this->frameCount, (int)this->frameBytes);
+		this->privPrintSites(true);
+
+	#if ALLOC_ASSERT_ZERO
+		// steady state must not touch the heap - call sites above
+		assert(this->frameCount == 0);
+	#endif
+	}
+
+	this->frameCount = 0;
+	this->frameBytes = 0;
+	for( int i = 0; i < this->numSites; i++ )
+	{
+		this->sites[i].frameCount = 0;
+		this->sites[i].frameSize = 0;
+	}
+	this->frames++;
+
+	AllocProfiler::pActive = this->installed ? this : nullptr;
+}
+
+void AllocProfiler::privPrintSites(bool thisFrame) const
+{
+	for( int i = 0; i < this->numSites; i++ )
+	{
+		const Site &site = this->sites[i];
+		const int count = thisFrame ? site.frameCount : site.count;
+		const size_t bytes = thisFrame ? site.frameSize : site.bytes;
+		if( count == 0 )
+		{
+			continue;
+		}
+
+		const char *pScope = (site.pScope != nullptr) ? site.pScope : "(no stage)";
+		if( site.pFile != nullptr )
+		{
+			// double-click in the output window
+			Trace::out("   %s(%d) : %d allocs, %d bytes, stage %s\n", site.pFile, site.line, count, (int)bytes, pScope);
+		}
+		else
+		{
+			Trace::out("   <no file - STL / library> : %d allocs, %d bytes, stage %s\n", count, (int)bytes, pScope);
+		}
+	}
+}
+
+void AllocProfiler::report() const
+{
+#if ALLOC_PROFILER_ENABLED
+	// done counting - teardown frees whatever it likes
+	AllocProfiler::pActive = nullptr;
+
+	Trace::out("--- AllocProfiler: %d frames (%d warm-up), %d allocs, %d bytes ---\n",
+		this->frames, this->warmUpFrames, this->totalCount, (int)this->totalBytes);
+
+	if( this->allocFrames == 0 )
+	{
+		Trace::out("  steady state: no heap allocation\n");
+	}
+	else
+	{
+		Trace::out("  steady state: %d frames allocated, worst frame %d: %d allocs, %d bytes\n",
+			this->allocFrames, this->worstFrame, this->worstCount, (int)this->worstBytes);
+	}
+
+	for( int s = 0; s < this->numScopes; s++ )
+	{
+		const ScopeTotal &total = this->scopes[s];
+		Trace::out("  %-14s %8d allocs  %10d bytes  %8d in steady state\n",
+			(total.pName != nullptr) ? total.pName : "(no stage)", total.count, (int)total.bytes, total.steadyCount);
+	}
+
+	this->privPrintSites(false);
+	if( this->droppedSites > 0 )
+	{
+		Trace::out("  ... %d allocs from sites past the first %d\n", this->droppedSites, MAX_SITES);
+	}
+#else
+	Trace::out("--- AllocProfiler: off (needs ALLOC_PROFILE and a Debug build) ---\n");
+#endif
+}
+
+// --- End of File ---
@@ -0,0 +1,141 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef ALLOC_PROFILER_H
+#define ALLOC_PROFILER_H
+
+#include "Settings.h"
+
+// the hook lives in the debug CRT heap - release builds compile it out
+#if defined(_DEBUG) && ALLOC_PROFILE
+	#define ALLOC_PROFILER_ENABLED 1
+#else
+	#define ALLOC_PROFILER_ENABLED 0
+#endif
+
+// Heap allocations per frame and per frame graph stage
+//
+//     startup() installs a debug CRT allocation hook (_CrtSetAllocHook), so
+//     every new / malloc of the process is counted - and with MemTrace's
+//     new macro (Framework.h) it comes with the file and line of the call.
+//     Blocks the CRT allocates for itself (_CRT_BLOCK) are left out.
+//
+//     Each thread has a current scope, the stage FrameGraph is running on
+//     it. Jobs carry the scope of the thread that created them, so a
+//     parallelFor inside a stage is still charged to that stage.
+//
+//     frame() closes a frame. Past the warm-up frames the loop is expected
+//     not to allocate at all: a frame that does prints its call sites and,
+//     with ALLOC_ASSERT_ZERO, asserts - a per particle new / delete creeping
+//     back in shows up on the first frame it runs.
+//
+//     The hook must not allocate: fixed tables, a spin lock, no Trace::out.
+class AllocProfiler
+{
+public:
+	static const int MAX_SITES = 64;
+	static const int MAX_SCOPES = 32;
+
+	explicit AllocProfiler(int warmUpFrames);
+	AllocProfiler() = delete;
+	AllocProfiler(const AllocProfiler &) = delete;
+	AllocProfiler &operator = (const AllocProfiler &) = delete;
+	~AllocProfiler();
+
+	// from here on every allocation is counted
+	void startup();
+
+	// end of a frame - checks the steady state
+	void frame();
+
+	// per frame totals, per stage totals, call sites - stops counting
+	void report() const;
+
+	// calling thread's scope, nullptr: outside any stage
+	static const char *GetScope();
+	static void SetScope(const char *pName);
+
+private:
+	struct Site
+	{
+		const char	*pFile;		// nullptr: no MemTrace name (STL, CRT, other libraries)
+		int			line;
+		const char	*pScope;
+		int			count;
+		size_t		bytes;
+		int			steadyCount;	// past the warm-up
+		int			frameCount;		// this frame
+		size_t		frameSize;
+	};
+
+	struct ScopeTotal
+	{
+		const char	*pName;
+		int			count;
+		size_t		bytes;
+		int			steadyCount;
+	};
+
+	static int __cdecl privHook(int allocType, void *pUserData, size_t size, int blockType,
+		long requestNumber, const unsigned char *pFileName, int lineNumber);
+
+	void privRecord(size_t size, const char *pFile, int line);
+	void privLock();
+	void privUnlock();
+	void privPrintSites(bool thisFrame) const;
+
+	// tables
+	Site		sites[MAX_SITES];
+	ScopeTotal	scopes[MAX_SCOPES];
+	int			numSites;
+	int			numScopes;
+	int			droppedSites;		// site table full
+
+	// this frame, written by the hook
+	int			frameCount;
+	size_t		frameBytes;
+
+	// whole run
+	int			warmUpFrames;
+	int			frames;
+	int			allocFrames;		// steady state frames that allocated
+	int			worstCount;
+	size_t		worstBytes;
+	int			worstFrame;
+	int			totalCount;
+	size_t		totalBytes;
+
+	std::atomic<bool>	lock;
+	bool		installed;
+
+	// the hook only knows the one being profiled
+	static AllocProfiler	*pActive;
+};
+
+// scope of the calling thread for a block, restored after
+class AllocScope
+{
+public:
+	explicit AllocScope(const char *pName)
+		: pPrevious(AllocProfiler::GetScope())
+	{
+		AllocProfiler::SetScope(pName);
+	}
+
+	AllocScope() = delete;
+	AllocScope(const AllocScope &) = delete;
+	AllocScope &operator = (const AllocScope &) = delete;
+
+	~AllocScope()
+	{
+		AllocProfiler::SetScope(this->pPrevious);
+	}
+
+private:
+	const char	*pPrevious;
+};
+
+#endif
+
+// --- End of File ---
@@ -0,0 +1,36 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <float.h>
+#include "BoundingBox.h"
+
+BoundingBox::BoundingBox()
+{
+	this->reset();
+}
+
+BoundingBox::~BoundingBox()
+{
+	// nothing to delete
+}
+
+void BoundingBox::reset()
+{
+	this->vMin._m = _mm_set_ps1(FLT_MAX);
+	this->vMax._m = _mm_set_ps1(-FLT_MAX);
+}
+
+bool BoundingBox::isEmpty() const
+{
+	// any axis with min > max means nothing was added
+	return (_mm_movemask_ps(_mm_cmpgt_ps(this->vMin._m, this->vMax._m)) & 0x7) != 0;
+}
+
+void BoundingBox::merge(const BoundingBox& b)
+{
+	this->vMin._m = _mm_min_ps(this->vMin._m, b.vMin._m);
+	this->vMax._m = _mm_max_ps(this->vMax._m, b.vMax._m);
+}
+
+// --- End of File ---
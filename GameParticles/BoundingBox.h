@@ -0,0 +1,40 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef BOUNDING_BOX_H
+#define BOUNDING_BOX_H
+
+// includes
+#include "Vect4D.h"
+
+// Axis aligned box, grown one point at a time with SSE min/max
+class BoundingBox
+{
+public:
+	BoundingBox();
+	BoundingBox(const BoundingBox& r) = default;
+	BoundingBox& operator = (const BoundingBox& r) = default;
+	~BoundingBox();
+
+	// empty box: min = +big, max = -big so the first add() snaps to the point
+	void reset();
+	bool isEmpty() const;
+
+	void merge(const BoundingBox& b);
+
+	// hot path - called for every particle in the integrate loop
+	inline void add(const Vect4D& v)
+	{
+		this->vMin._m = _mm_min_ps(this->vMin._m, v._m);
+		this->vMax._m = _mm_max_ps(this->vMax._m, v._m);
+	}
+
+public:
+	Vect4D vMin;
+	Vect4D vMax;
+};
+
+#endif
+
+// --- End of File ---
@@ -0,0 +1,89 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include "CpuFeatures.h"
+#include "Simd.h"
+
+// CPUID leaf 1, ECX
+static const int CPUID_FMA = 1 << 12;
+static const int CPUID_OSXSAVE = 1 << 27;
+static const int CPUID_AVX = 1 << 28;
+static const int CPUID_F16C = 1 << 29;
+
+// CPUID leaf 7, EBX
+static const int CPUID7_AVX2 = 1 << 5;
+static const int CPUID7_AVX512F = 1 << 16;
+
+// XCR0: SSE and AVX state saved by the OS, + opmask and both ZMM halves
+static const unsigned long long XCR0_YMM = 0x6;
+static const unsigned long long XCR0_ZMM = 0xE6;
+
+const CpuFeatures &CpuFeatures::Get()
+{
+	static const CpuFeatures features;
+	return features;
+}
+
+CpuFeatures::CpuFeatures()
+	: avx(false),
+	f16c(false),
+	avx2(false),
+	avx512(false)
+{
+	int regs[4];
+	__cpuid(regs, 0);
+	const int maxLeaf = regs[0];
+
+	__cpuid(regs, 1);
+	const int ecx = regs[2];
+
+	unsigned long long xcr0 = 0;
+	if( ecx & CPUID_OSXSAVE )
+	{
+		xcr0 = _xgetbv(0);
+	}
+	const bool ymmState = (xcr0 & XCR0_YMM) == XCR0_YMM;
+	const bool zmmState = (xcr0 & XCR0_ZMM) == XCR0_ZMM;
+
+	this->avx = ymmState && (ecx & CPUID_AVX) != 0;
+	this->f16c = this->avx && (ecx & CPUID_F16C) != 0;
+
+	if( maxLeaf >= 7 )
+	{
+		__cpuidex(regs, 7, 0);
+		const int ebx = regs[1];
+
+		this->avx2 = this->avx && (ecx & CPUID_FMA) != 0 && (ebx & CPUID7_AVX2) != 0;
+		this->avx512 = this->avx2 && zmmState && (ebx & CPUID7_AVX512F) != 0;
+	}
+}
+
+bool CpuFeatures::hasAVX() const
+{
+	return this->avx;
+}
+
+bool CpuFeatures::hasF16C() const
+{
+	return this->f16c;
+}
+
+bool CpuFeatures::hasAVX2() const
+{
+	return this->avx2;
+}
+
+bool CpuFeatures::hasAVX512() const
+{
+	return this->avx512;
+}
+
+void CpuFeatures::report() const
+{
+	Trace::out("--- CpuFeatures: SSE4.1 (baseline)  AVX %s  F16C %s  AVX2+FMA %s  AVX-512F %s ---\n",
+		this->avx ? "yes" : "no", this->f16c ? "yes" : "no", this->avx2 ? "yes" : "no", this->avx512 ? "yes" : "no");
+	Trace::out("  Simd kernels run %d wide (SIMD_MAX_WIDTH %d)\n", SimdWidth(), SIMD_MAX_WIDTH);
+}
+
+// --- End of File ---
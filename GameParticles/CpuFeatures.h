@@ -0,0 +1,46 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// Instruction sets past the SSE4.1 baseline, asked once (CPUID)
+//
+//     The build only assumes SSE4.1 - anything newer is used behind a run
+//     time check with a fallback, never through a compiler /arch switch.
+//     VEX encoded sets (AVX, F16C, AVX2) also need the OS to save the YMM
+//     state (OSXSAVE + XGETBV), AVX-512 the ZMM and mask state too - the
+//     CPUID bit alone is not enough.
+class CpuFeatures
+{
+public:
+	static const CpuFeatures &Get();
+
+	CpuFeatures(const CpuFeatures &) = delete;
+	CpuFeatures &operator = (const CpuFeatures &) = delete;
+
+	bool hasAVX() const;
+	bool hasF16C() const;
+
+	// AVX2 and FMA3 - the Simd<float, 8> backend needs both
+	bool hasAVX2() const;
+
+	// AVX-512 Foundation, with the OS saving the ZMM / mask state
+	bool hasAVX512() const;
+
+	void report() const;
+
+private:
+	CpuFeatures();
+	~CpuFeatures() = default;
+
+	bool	avx;
+	bool	f16c;
+	bool	avx2;
+	bool	avx512;
+};
+
+#endif
+
+// --- End of File ---
@@ -0,0 +1,313 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <float.h>
+#include <string.h>
+#include "DepthSort.h"
+#include "JobSystem.h"
+#include "Simd.h"
+
+// nearly sorted: at most one descent every NEARLY_SORTED keys
+static const int NEARLY_SORTED = 8;
+
+// insertion sort gives up after MOVE_BUDGET moves per key
+static const int MOVE_BUDGET = 8;
+
+static const int RADIX_BITS = 8;
+static const int RADIX_BUCKETS = 1 << RADIX_BITS;
+static const int KEY_SHIFT = 32;
+static const int KEY_MAX = 0xFFFF;
+
+static int numSlicesOf(const JobSystem *pJobs)
+{
+	return pJobs ? pJobs->getNumSlices() : 1;
+}
+
+DepthSort::DepthSort()
+	: pDepthBuffer(nullptr),
+	pListScratch(nullptr),
+	capacity(0),
+	pKeyBuffer(nullptr),
+	pScratchBuffer(nullptr),
+	pHistogram(nullptr),
+	pSliceMin(nullptr),
+	pSliceMax(nullptr),
+	pSliceDescents(nullptr),
+	sliceCount(0),
+	stats()
+{
+}
+
+void DepthSort::allocate(FrameArena &arena, int count, const JobSystem *pJobs)
+{
+	this->capacity = count;
+	this->sliceCount = numSlicesOf(pJobs);
+
+	// keys on cache lines - the radix scatter writes them in runs
+	this->pDepthBuffer = arena.allocArray<float>(count, 64);
+	this->pKeyBuffer = arena.allocArray<uint64_t>(count, 64);
+	this->pScratchBuffer = arena.allocArray<uint64_t>(count, 64);
+	this->pListScratch = arena.allocArray<Particle *>(count, 64);
+
+	this->pHistogram = arena.allocArray<uint32_t>(this->sliceCount * RADIX_BUCKETS, 64);
+	this->pSliceMin = arena.allocArray<float>(this->sliceCount);
+	this->pSliceMax = arena.allocArray<float>(this->sliceCount);
+	this->pSliceDescents = arena.allocArray<int>(this->sliceCount);
+
+	assert(this->pDepthBuffer && this->pKeyBuffer && this->pScratchBuffer && this->pListScratch);
+	assert(this->pHistogram && this->pSliceMin && this->pSliceMax && this->pSliceDescents);
+}
+
+float *DepthSort::getDepthBuffer()
+{
+	return this->pDepthBuffer;
+}
+
+const DepthSortStats &DepthSort::getStats() const
+{
+	return this->stats;
+}
+
+void DepthSort::sort(Particle **pList, int count, SortOrder order, JobSystem *pJobs)
+{
+	assert(count <= this->capacity);
+	assert(numSlicesOf(pJobs) == this->sliceCount);
+
+	this->stats.count = count;
+	this->stats.passes = 0;
+	this->stats.wasSorted = false;
+	this->stats.insertion = false;
+
+	if( (count < 2) || (order == SortOrder::None) )
+	{
+		this->stats.wasSorted = true;
+		return;
+	}
+
+	const bool sorted = this->privBuildKeys(count, order, pJobs);
+	if( sorted )
+	{
+		this->stats.wasSorted = true;
+		return;
+	}
+
+	bool done = false;
+	if( this->pSliceDescents[0] <= count / NEARLY_SORTED )
+	{
+		done = this->privInsertionSort(count, count * MOVE_BUDGET);
+		this->stats.insertion = done;
+	}
+
+	if( !done )
+	{
+		this->privRadixSort(count, pJobs);
+	}
+
+	// apply the permutation to the draw list
+	auto gather = [this, pList](int begin, int end, int)
+	{
+		for( int i = begin; i < end; i++ )
+		{
+			this->pListScratch[i] = pList[(uint32_t)this->pKeyBuffer[i]];
+		}
+	};
+	RunSlices(pJobs, count, gather);
+
+	auto copyBack = [this, pList](int begin, int end, int)
+	{
+		memcpy(pList + begin, this->pListScratch + begin, (size_t)(end - begin) * sizeof(Particle *));
+	};
+	RunSlices(pJobs, count, copyBack);
+}
+
+// returns true when the keys are already in order
+//     pSliceDescents[0] holds the total number of descents afterwards
+bool DepthSort::privBuildKeys(int count, SortOrder order, JobSystem *pJobs)
+{
+	const int numSlices = numSlicesOf(pJobs);
+
+	// depth range of this frame
+	auto range = [this](int begin, int end, int slice)
+	{
+		SimdDispatch([this, begin, end, slice](auto width)
+		{
+			typedef Simd<float, decltype(width)::value> V;
+
+			V vMin = V::Set1(FLT_MAX);
+			V vMax = V::Set1(-FLT_MAX);
+
+			int i = begin;
+			for( ; i + V::WIDTH <= end; i += V::WIDTH )
+			{
+				const V d = V::LoadU(this->pDepthBuffer + i);
+				vMin = V::Min(vMin, d);
+				vMax = V::Max(vMax, d);
+			}
+
+			float lo = vMin.reduceMin();
+			float hi = vMax.reduceMax();
+
+			for( ; i < end; i++ )
+			{
+				const float d = this->pDepthBuffer[i];
+				lo = (d < lo) ? d : lo;
+				hi = (d > hi) ? d : hi;
+			}
+
+			this->pSliceMin[slice] = lo;
+			this->pSliceMax[slice] = hi;
+		});
+	};
+	RunSlices(pJobs, count, range);
+
+	float lo = this->pSliceMin[0];
+	float hi = this->pSliceMax[0];
+	for( int t = 1; t < numSlices; t++ )
+	{
+		lo = (this->pSliceMin[t] < lo) ? this->pSliceMin[t] : lo;
+		hi = (this->pSliceMax[t] > hi) ? this->pSliceMax[t] : hi;
+	}
+
+	const float scale = (hi > lo) ? (float)KEY_MAX / (hi - lo) : 0.0f;
+	const bool backToFront = (order == SortOrder::BackToFront);
+
+	// quantize, pack with the index, count descents on the way
+	auto keys = [this, lo, scale, backToFront](int begin, int end, int slice)
+	{
+		int descents = 0;
+		uint64_t last = 0;
+
+		for( int i = begin; i < end; i++ )
+		{
+			int q = (int)((this->pDepthBuffer[i] - lo) * scale);
+			q = (q < 0) ? 0 : ((q > KEY_MAX) ? KEY_MAX : q);
+			if( backToFront )
+			{
+				q = KEY_MAX - q;
+			}
+
+			const uint64_t k = ((uint64_t)q << KEY_SHIFT) | (uint32_t)i;
+			descents += (k < last) ? 1 : 0;
+			last = k;
+
+			this->pKeyBuffer[i] = k;
+		}
+
+		this->pSliceDescents[slice] = descents;
+	};
+	RunSlices(pJobs, count, keys);
+
+	int descents = 0;
+	for( int t = 0; t < numSlices; t++ )
+	{
+		descents += this->pSliceDescents[t];
+
+		// seam between two slices
+		const int b = JobSystem::sliceBegin(count, t, numSlices);
+		if( (b > 0) && (b < count) && (this->pKeyBuffer[b] < this->pKeyBuffer[b - 1]) )
+		{
+			descents++;
+		}
+	}
+	this->pSliceDescents[0] = descents;
+
+	return descents == 0;
+}
+
+// returns false if the move budget ran out - keys are still a valid
+// permutation, just not fully sorted
+bool DepthSort::privInsertionSort(int count, int budget)
+{
+	uint64_t *pKeys = this->pKeyBuffer;
+
+	for( int i = 1; i < count; i++ )
+	{
+		const uint64_t k = pKeys[i];
+		int j = i - 1;
+
+		while( (j >= 0) && (pKeys[j] > k) )
+		{
+			pKeys[j + 1] = pKeys[j];
+			j--;
+
+			if( --budget < 0 )
+			{
+				pKeys[j + 1] = k;
+				return false;
+			}
+		}
+
+		pKeys[j + 1] = k;
+	}
+
+	return true;
+}
+
+void DepthSort::privRadixSort(int count, JobSystem *pJobs)
+{
+	const int numSlices = numSlicesOf(pJobs);
+
+	for( int pass = 0; pass < 2; pass++ )
+	{
+		const int shift = KEY_SHIFT + pass * RADIX_BITS;
+		const uint64_t *pSrc = this->pKeyBuffer;
+		uint64_t *pDst = this->pScratchBuffer;
+
+		auto histogram = [this, pSrc, shift](int begin, int end, int slice)
+		{
+			uint32_t *h = this->pHistogram + slice * RADIX_BUCKETS;
+			memset(h, 0, RADIX_BUCKETS * sizeof(uint32_t));
+
+			for( int i = begin; i < end; i++ )
+			{
+				h[(pSrc[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+			}
+		};
+		RunSlices(pJobs, count, histogram);
+
+		// exclusive prefix sum in (bucket, slice) order keeps it stable
+		uint32_t sum = 0;
+		bool trivial = false;
+		for( int b = 0; b < RADIX_BUCKETS; b++ )
+		{
+			uint32_t bucketTotal = 0;
+			for( int t = 0; t < numSlices; t++ )
+			{
+				uint32_t &h = this->pHistogram[t * RADIX_BUCKETS + b];
+				const uint32_t c = h;
+				h = sum;
+				sum += c;
+				bucketTotal += c;
+			}
+			trivial |= (bucketTotal == (uint32_t)count);
+		}
+
+		// every key has the same digit - nothing moves
+		if( trivial )
+		{
+			continue;
+		}
+
+		auto scatter = [this, pSrc, pDst, shift](int begin, int end, int slice)
+		{
+			uint32_t *h = this->pHistogram + slice * RADIX_BUCKETS;
+
+			for( int i = begin; i < end; i++ )
+			{
+				const uint64_t k = pSrc[i];
+				pDst[h[(k >> shift) & (RADIX_BUCKETS - 1)]++] = k;
+			}
+		};
+		RunSlices(pJobs, count, scatter);
+
+		// result always ends up in pKeyBuffer
+		uint64_t *pTmp = this->pKeyBuffer;
+		this->pKeyBuffer = this->pScratchBuffer;
+		this->pScratchBuffer = pTmp;
+
+		this->stats.passes++;
+	}
+}
+
+// --- End of File ---
@@ -0,0 +1,82 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef DEPTH_SORT_H
+#define DEPTH_SORT_H
+
+#include <stdint.h>
+#include "Enum.h"
+#include "FrameArena.h"
+
+class Particle;
+class JobSystem;
+
+struct DepthSortStats
+{
+	int		count;
+	int		passes;			// radix passes actually run (0..2)
+	bool	wasSorted;		// nothing to do, order kept from last frame
+	bool	insertion;		// nearly sorted, finished by insertion sort
+};
+
+// Orders the draw list by view depth
+//
+//     Depths are quantized to 16 bit keys over this frame's range and
+//     packed with the list index as (key << 32 | index), then sorted with
+//     a two pass LSD radix sort (8 bits per pass). Each pass builds per slice
+//     histograms in parallel, prefix sums them serially, then every slice
+//     scatters its own keys - stable and lock free.
+//
+//     Temporal coherence: the emitter relinks its list in sorted order, so
+//     next frame the keys arrive nearly sorted. Already sorted input is
+//     detected while building the keys, and a nearly sorted one is finished
+//     by an insertion sort with a move budget before falling back to radix.
+//
+//     Every buffer is frame scratch: allocate() takes them from the frame
+//     arena once the live count is known, they are gone after the frame.
+class DepthSort
+{
+public:
+	DepthSort();
+	DepthSort(const DepthSort &) = delete;
+	DepthSort &operator = (const DepthSort &) = delete;
+	~DepthSort() = default;
+
+	// this frame's buffers for count entries, sliced like pJobs
+	void allocate(FrameArena &arena, int count, const JobSystem *pJobs);
+
+	// the integrate pass writes one depth per draw list entry here
+	float *getDepthBuffer();
+
+	void sort(Particle **pList, int count, SortOrder order, JobSystem *pJobs);
+
+	const DepthSortStats &getStats() const;
+
+private:
+	bool privBuildKeys(int count, SortOrder order, JobSystem *pJobs);
+	bool privInsertionSort(int count, int budget);
+	void privRadixSort(int count, JobSystem *pJobs);
+
+	// frame arena, valid from allocate() to the end of the frame
+	float		*pDepthBuffer;
+	Particle	**pListScratch;
+	int			capacity;
+
+	// keys and scratch swap after every radix pass
+	uint64_t	*pKeyBuffer;
+	uint64_t	*pScratchBuffer;
+
+	// per slice scratch: 256 counters, min/max, descents
+	uint32_t	*pHistogram;
+	float		*pSliceMin;
+	float		*pSliceMax;
+	int			*pSliceDescents;
+	int			sliceCount;
+
+	DepthSortStats	stats;
+};
+
+#endif
+
+// --- End of File ---
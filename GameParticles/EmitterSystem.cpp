@@ -0,0 +1,316 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include "EmitterSystem.h"
+#include "JobSystem.h"
+#include "Settings.h"
+
+// update / draw stages an emitter registers at most
+static const int STAGES_PER_EMITTER = 4;
+
+// past this many emitters the stage by stage dumps are left out
+static const int DUMP_EMITTERS = 8;
+
+EmitterParams::EmitterParams()
+:	startPosition( 0.0f, 2.0f, 2.0f ),
+	startVelocity( -4.0f, 4.0f, 0.0f ),
+	spawnFrequency( 0.00001f ),
+	maxLife( MAX_LIFE ),
+	maxParticles( NUM_PARTICLES ),
+	reserveParticles( PARTICLE_RESERVE ),
+	sortOrder( (SortOrder)PARTICLE_SORT_ORDER )
+{
+}
+
+EmitterSystem::EmitterSystem(JobSystem *_pJobs, int _maxEmitters)
+:	pJobs(_pJobs),
+	poEntries(nullptr),
+	maxEmitters(_maxEmitters),
+	numEmitters(0),
+	poPool(nullptr),
+	poScratch(nullptr),
+	poSpawnTable(nullptr),
+	poUpdateGraph(nullptr),
+	poDrawGraph(nullptr),
+	updateTimer(),
+	drawTimer(),
+	updateMs(0.0),
+	drawMs(0.0),
+	frames(0)
+{
+	assert(_maxEmitters > 0);
+
+	this->poEntries = new Entry[(unsigned int)_maxEmitters];
+}
+
+EmitterSystem::~EmitterSystem()
+{
+	// emitters hand their particles back before the shared pool goes
+	for( int e = 0; e < this->numEmitters; e++ )
+	{
+		this->poEntries[e].destroy(this->poEntries[e].pEmitter);
+	}
+
+	delete this->poUpdateGraph;
+	delete this->poDrawGraph;
+	delete this->poScratch;
+	delete this->poSpawnTable;
+	delete this->poPool;
+	delete[] this->poEntries;
+}
+
+ParticleEmitter &EmitterSystem::add(const char *pName, const EmitterParams &params)
+{
+	return this->add<DefaultParticlePolicies>(pName, params);
+}
+
+EmitterSystem::Entry &EmitterSystem::privNewEntry(const char *pName, const EmitterParams &params)
+{
+	// the graphs are built for a fixed set
+	assert(this->poUpdateGraph == nullptr);
+	assert(this->numEmitters < this->maxEmitters);
+
+	const int index = this->numEmitters++;
+	Entry &entry = this->poEntries[index];
+
+	if( pName != nullptr )
+	{
+		strncpy_s(entry.name, sizeof(entry.name), pName, _TRUNCATE);
+	}
+	else
+	{
+		sprintf_s(entry.name, sizeof(entry.name), "emitter %d", index);
+	}
+
+	entry.maxParticles = params.maxParticles;
+	entry.reserveParticles = (params.reserveParticles > params.maxParticles) ? params.reserveParticles : params.maxParticles;
+	entry.firstUpdateStage = 0;
+	entry.lastUpdateStage = 0;
+	entry.firstDrawStage = 0;
+	entry.lastDrawStage = 0;
+	entry.spawnTable = false;
+
+	return entry;
+}
+
+bool EmitterSystem::privSmallScene() const
+{
+	return this->numEmitters <= DUMP_EMITTERS;
+}
+
+void EmitterSystem::setViewFrustum(const ViewFrustum &f)
+{
+	for( int e = 0; e < this->numEmitters; e++ )
+	{
+		this->poEntries[e].setViewFrustum(this->poEntries[e].pEmitter, f);
+	}
+}
+
+void EmitterSystem::build()
+{
+	assert(this->poUpdateGraph == nullptr);
+	assert(this->numEmitters > 0);
+
+	const bool sharing = (this->numEmitters > 1);
+	if( sharing )
+	{
+		int reserve = 0;
+		int base = 0;
+		bool tables = false;
+		for( int e = 0; e < this->numEmitters; e++ )
+		{
+			reserve += this->poEntries[e].reserveParticles;
+			base += this->poEntries[e].maxParticles;
+			tables = tables || this->poEntries[e].spawnTable;
+		}
+
+		this->poPool = new ParticlePool(reserve, base, this->pJobs, PARTICLE_LARGE_PAGES != 0);
+
+		// the thread arenas are what the emitters borrow, the frame arena stays empty
+		const int threads = (this->pJobs != nullptr) ? this->pJobs->getNumThreads() : 1;
+		this->poScratch = new FrameMemory(threads, VirtualMemory::COMMIT_GRANULE, VirtualMemory::COMMIT_GRANULE);
+
+		// drawn here, so no frame pays for it
+		if( tables )
+		{
+			this->poSpawnTable = new SpawnTable();
+			this->poSpawnTable->fill(VarianceSpawn());
+		}
+	}
+
+	this->poUpdateGraph = new FrameGraph("update", STAGES_PER_EMITTER * this->numEmitters);
+	this->poDrawGraph = new FrameGraph("draw", STAGES_PER_EMITTER * this->numEmitters);
+
+	for( int e = 0; e < this->numEmitters; e++ )
+	{
+		Entry &entry = this->poEntries[e];
+
+		// a small emitter in a crowd: one job a stage, no slices
+		const bool slices = !sharing || (entry.maxParticles >= EMITTER_SLICE_MIN);
+		entry.attach(entry.pEmitter, slices ? this->pJobs : nullptr, this->poPool, this->poScratch, this->poSpawnTable);
+
+		entry.firstUpdateStage = this->poUpdateGraph->getNumStages();
+		entry.firstDrawStage = this->poDrawGraph->getNumStages();
+		entry.registerStages(entry.pEmitter, *this->poUpdateGraph, *this->poDrawGraph);
+		entry.lastUpdateStage = this->poUpdateGraph->getNumStages();
+		entry.lastDrawStage = this->poDrawGraph->getNumStages();
+	}
+
+	this->poUpdateGraph->compile();
+	this->poDrawGraph->compile();
+}
+
+void EmitterSystem::update()
+{
+	assert(this->poUpdateGraph);
+
+	// no job is running - the borrowed thread arenas start over
+	if( this->poScratch != nullptr )
+	{
+		this->poScratch->reset();
+	}
+
+	this->updateTimer.Tic();
+	this->poUpdateGraph->execute(this->pJobs);
+	this->updateTimer.Toc();
+
+	this->updateMs += this->updateTimer.TimeInSeconds() * 1000.0;
+	this->frames++;
+}
+
+void EmitterSystem::draw()
+{
+	assert(this->poDrawGraph);
+
+	this->drawTimer.Tic();
+	this->poDrawGraph->execute(this->pJobs);
+	this->drawTimer.Toc();
+
+	this->drawMs += this->drawTimer.TimeInSeconds() * 1000.0;
+}
+
+int EmitterSystem::getEmitterCount() const
+{
+	return this->numEmitters;
+}
+
+int EmitterSystem::getParticleCount() const
+{
+	int count = 0;
+	for( int e = 0; e < this->numEmitters; e++ )
+	{
+		count += this->poEntries[e].getParticleCount(this->poEntries[e].pEmitter);
+	}
+	return count;
+}
+
+const ParticlePool &EmitterSystem::getPool() const
+{
+	assert(this->numEmitters > 0);
+
+	if( this->poPool != nullptr )
+	{
+		return *this->poPool;
+	}
+	return this->poEntries[0].getPool(this->poEntries[0].pEmitter);
+}
+
+void EmitterSystem::dumpSchedule() const
+{
+	assert(this->poUpdateGraph);
+
+	if( this->privSmallScene() )
+	{
+		this->poUpdateGraph->dumpSchedule();
+		this->poDrawGraph->dumpSchedule();
+	}
+	else
+	{
+		Trace::out("--- EmitterSystem: %d emitters, %d update and %d draw stages ---\n",
+			this->numEmitters, this->poUpdateGraph->getNumStages(), this->poDrawGraph->getNumStages());
+	}
+}
+
+void EmitterSystem::dumpTimings() const
+{
+	assert(this->poUpdateGraph);
+
+	if( this->privSmallScene() )
+	{
+		this->poUpdateGraph->dumpTimings();
+		this->poDrawGraph->dumpTimings();
+	}
+}
+
+void EmitterSystem::report() const
+{
+	assert(this->poUpdateGraph);
+
+	const double frameCount = (this->frames > 0) ? (double)this->frames : 1.0;
+
+	Trace::out("--- EmitterSystem: %d emitters, %d particles, %d frames, %s pool ---\n",
+		this->numEmitters, this->getParticleCount(), this->frames, (this->poPool != nullptr) ? "shared" : "own");
+	Trace::out("  #    name                   live    drawn    update ms    draw ms\n");
+
+	double updateStages = 0.0;
+	double drawStages = 0.0;
+	int drawn = 0;
+
+	for( int e = 0; e < this->numEmitters; e++ )
+	{
+		const Entry &entry = this->poEntries[e];
+
+		// average of the stages it owns
+		double update = 0.0;
+		for( int s = entry.firstUpdateStage; s < entry.lastUpdateStage; s++ )
+		{
+			update += this->poUpdateGraph->getAverageMs(s);
+		}
+
+		double draw = 0.0;
+		for( int s = entry.firstDrawStage; s < entry.lastDrawStage; s++ )
+		{
+			draw += this->poDrawGraph->getAverageMs(s);
+		}
+
+		const CullStats &stats = entry.getCullStats(entry.pEmitter);
+		Trace::out("  %-4d %-20s %7d  %7d  %10.4f  %10.4f\n", e, entry.name,
+			entry.getParticleCount(entry.pEmitter), stats.particlesDrawn, update, draw);
+
+		updateStages += update;
+		drawStages += draw;
+		drawn += stats.particlesDrawn;
+	}
+
+	// stage time over wall time: how much of it ran side by side
+	const double updateWall = this->updateMs / frameCount;
+	const double drawWall = this->drawMs / frameCount;
+	Trace::out("  total                            %7d  %10.4f  %10.4f   stage sum\n", drawn, updateStages, drawStages);
+	Trace::out("                                            %10.4f  %10.4f   wall, x%.2f / x%.2f\n",
+		updateWall, drawWall, (updateWall > 0.0) ? updateStages / updateWall : 0.0, (drawWall > 0.0) ? drawStages / drawWall : 0.0);
+}
+
+void EmitterSystem::reportMemory() const
+{
+	if( this->poPool != nullptr )
+	{
+		Trace::out("--- EmitterSystem memory: shared pool %.2f MB committed, %d live ---\n",
+			(double)this->poPool->getCommittedBytes() / (1024.0 * 1024.0), this->poPool->getLiveCount());
+		this->poScratch->report();
+		if( this->poSpawnTable != nullptr )
+		{
+			Trace::out("  %-14s committed %8.2f MB\n", "spawn table", (double)this->poSpawnTable->getCommittedBytes() / (1024.0 * 1024.0));
+		}
+	}
+
+	if( this->privSmallScene() )
+	{
+		for( int e = 0; e < this->numEmitters; e++ )
+		{
+			this->poEntries[e].reportMemory(this->poEntries[e].pEmitter);
+		}
+	}
+}
+
+// --- End of File ---
@@ -0,0 +1,216 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef EMITTER_SYSTEM_H
+#define EMITTER_SYSTEM_H
+
+#include <type_traits>
+#include "ParticleEmitter.h"
+#include "FrameGraph.h"
+
+// what an emitter of an EmitterSystem starts with - the defaults are the
+// original emitter's
+struct EmitterParams
+{
+	EmitterParams();
+
+	Vect4D		startPosition;
+	Vect4D		startVelocity;
+	float		spawnFrequency;		// seconds between spawns
+	float		maxLife;
+	int			maxParticles;
+	int			reserveParticles;	// address space of its streams, at least maxParticles
+	SortOrder	sortOrder;
+};
+
+// Many emitters run as one workload
+//
+//     add() creates an emitter of any configuration with its parameters.
+//     build() registers every emitter's stages in one update and one draw
+//     frame graph, so update() and draw() run the stages of all of them as
+//     jobs side by side - one emitter's cull next to another's build, not
+//     emitter after emitter.
+//
+//     With more than one emitter they share one particle pool, the thread
+//     scratch arenas (see FrameMemory) and the start states of TableSpawn;
+//     each keeps its own streams, sized by its reserve. The shared memory is
+//     created by build(), an emitter's own pool and arenas when it is
+//     attached. Emitters under EMITTER_SLICE_MIN particles run a stage as
+//     a single job, the other emitters are the parallelism - bigger ones
+//     split their stages over the workers too. A lone emitter is set up
+//     like a standalone ParticleEmitter.
+//
+//     report() prints per emitter the average time of the stages it owns,
+//     as the frame graphs time them, and the totals against the wall time
+//     of update() and draw().
+//
+//     Emitters are kept behind a few function pointers, filled per
+//     configuration by add() - no virtual calls anywhere near a frame.
+class EmitterSystem
+{
+public:
+	EmitterSystem(JobSystem *pJobs, int maxEmitters);
+	EmitterSystem() = delete;
+	EmitterSystem(const EmitterSystem &) = delete;
+	EmitterSystem &operator = (const EmitterSystem &) = delete;
+	~EmitterSystem();
+
+	// before build() - pName may be nullptr
+	template <typename Policies>
+	BasicParticleEmitter<Policies> &add(const char *pName, const EmitterParams &params);
+	ParticleEmitter &add(const char *pName, const EmitterParams &params);
+
+	// every emitter added so far
+	void setViewFrustum(const ViewFrustum &f);
+
+	// job system, shared memory, frame graphs
+	void build();
+
+	void update();
+	void draw();
+
+	int getEmitterCount() const;
+	int getParticleCount() const;
+
+	// the shared pool, or the lone emitter's
+	const ParticlePool &getPool() const;
+
+	// both frame graphs stage by stage - small scenes only, a line per stage
+	void dumpSchedule() const;
+	void dumpTimings() const;
+
+	// per emitter and total times
+	void report() const;
+	void reportMemory() const;
+
+private:
+	struct Entry
+	{
+		char		name[24];
+		void		*pEmitter;
+		int			maxParticles;
+		int			reserveParticles;
+		int			firstUpdateStage;	// [first, last) of each graph
+		int			lastUpdateStage;
+		int			firstDrawStage;
+		int			lastDrawStage;
+		bool		spawnTable;			// TableSpawn - draws from the shared table
+
+		void		(*destroy)(void *pEmitter);
+		void		(*attach)(void *pEmitter, JobSystem *pJobs, ParticlePool *pSharedPool, FrameMemory *pSharedScratch, SpawnTable *pSharedSpawn);
+		void		(*setViewFrustum)(void *pEmitter, const ViewFrustum &f);
+		void		(*registerStages)(void *pEmitter, FrameGraph &updateGraph, FrameGraph &drawGraph);
+		int			(*getParticleCount)(const void *pEmitter);
+		const CullStats &(*getCullStats)(const void *pEmitter);
+		const ParticlePool &(*getPool)(const void *pEmitter);
+		void		(*reportMemory)(const void *pEmitter);
+	};
+
+	template <typename E>
+	static void Destroy(void *pEmitter)
+	{
+		delete static_cast<E *>(pEmitter);
+	}
+
+	// sharing first - then setJobSystem() leaves the pool alone
+	template <typename E>
+	static void Attach(void *pEmitter, JobSystem *pJobs, ParticlePool *pSharedPool, FrameMemory *pSharedScratch, SpawnTable *pSharedSpawn)
+	{
+		E *p = static_cast<E *>(pEmitter);
+		if( pSharedPool != nullptr )
+		{
+			p->setSharedMemory(pSharedPool, pSharedScratch);
+			p->getSpawn().share(pSharedSpawn);
+		}
+		p->setJobSystem(pJobs);
+	}
+
+	template <typename E>
+	static void SetViewFrustum(void *pEmitter, const ViewFrustum &f)
+	{
+		static_cast<E *>(pEmitter)->setViewFrustum(f);
+	}
+
+	template <typename E>
+	static void RegisterStages(void *pEmitter, FrameGraph &updateGraph, FrameGraph &drawGraph)
+	{
+		static_cast<E *>(pEmitter)->registerStages(updateGraph, drawGraph);
+	}
+
+	template <typename E>
+	static int GetParticleCount(const void *pEmitter)
+	{
+		return static_cast<const E *>(pEmitter)->getParticleCount();
+	}
+
+	template <typename E>
+	static const CullStats &GetCullStats(const void *pEmitter)
+	{
+		return static_cast<const E *>(pEmitter)->getCullStats();
+	}
+
+	template <typename E>
+	static const ParticlePool &GetPool(const void *pEmitter)
+	{
+		return static_cast<const E *>(pEmitter)->getPool();
+	}
+
+	template <typename E>
+	static void ReportMemory(const void *pEmitter)
+	{
+		static_cast<const E *>(pEmitter)->reportMemory();
+	}
+
+	Entry &privNewEntry(const char *pName, const EmitterParams &params);
+	bool privSmallScene() const;
+
+	JobSystem		*pJobs;
+	Entry			*poEntries;
+	int				maxEmitters;
+	int				numEmitters;
+
+	// with more than one emitter
+	ParticlePool	*poPool;
+	FrameMemory		*poScratch;		// only its thread arenas are used
+	SpawnTable		*poSpawnTable;	// drawn in build() if an emitter spawns from a table
+
+	FrameGraph		*poUpdateGraph;
+	FrameGraph		*poDrawGraph;
+
+	PerformanceTimer	updateTimer;
+	PerformanceTimer	drawTimer;
+	double			updateMs;		// summed over the frames
+	double			drawMs;
+	int				frames;
+};
+
+template <typename Policies>
+BasicParticleEmitter<Policies> &EmitterSystem::add(const char *pName, const EmitterParams &params)
+{
+	typedef BasicParticleEmitter<Policies> Emitter;
+
+	Emitter *pEmitter = new Emitter(params.maxParticles, params.reserveParticles);
+	pEmitter->getSpawn().setStart(params.startPosition, params.startVelocity);
+	pEmitter->getLifetime().setMaxLife(params.maxLife);
+	pEmitter->setSpawnFrequency(params.spawnFrequency);
+	pEmitter->setSortOrder(params.sortOrder);
+
+	Entry &entry = this->privNewEntry(pName, params);
+	entry.pEmitter = pEmitter;
+	entry.spawnTable = std::is_same<typename Policies::Spawn, TableSpawn>::value;
+	entry.destroy = &EmitterSystem::Destroy<Emitter>;
+	entry.attach = &EmitterSystem::Attach<Emitter>;
+	entry.setViewFrustum = &EmitterSystem::SetViewFrustum<Emitter>;
+	entry.registerStages = &EmitterSystem::RegisterStages<Emitter>;
+	entry.getParticleCount = &EmitterSystem::GetParticleCount<Emitter>;
+	entry.getCullStats = &EmitterSystem::GetCullStats<Emitter>;
+	entry.getPool = &EmitterSystem::GetPool<Emitter>;
+	entry.reportMemory = &EmitterSystem::ReportMemory<Emitter>;
+
+	return *pEmitter;
+}
+
+#endif
+
+// --- End of File ---
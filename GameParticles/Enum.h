@@ -33,6 +33,64 @@ enum class Index  // used for matrices
 	m15 = 15
 };
 
+enum class CullResult  // chunk or particle vs view frustum
+{
+	Outside = 0,
+	Intersect = 1,
+	Inside = 2,
+	SubPixel = 3		// in view, but smaller than the screen size threshold
+};
+
+enum class SortOrder  // draw order of the particles
+{
+	None = 0,			// list order (newest first)
+	BackToFront = 1,
+	FrontToBack = 2
+};
+
+enum class PinMode  // where the worker threads run
+{
+	None = 0,			// left to the OS scheduler
+	Compact = 1,		// one core each, filling a NUMA node before the next
+	Scatter = 2			// one core each, round robin over the NUMA nodes
+};
+
+enum class TransposePath  // AoS <-> SoA conversion (see SoATranspose)
+{
+	Best = 0,			// widest the CPU has
+	Scalar = 1,			// element by element, the reference
+	SSE = 2,			// 4x4 transposes, 4 vectors per step
+	AVX2 = 3			// 8x4 transposes, 8 vectors per step
+};
+
+enum class Stream : unsigned int  // data a frame stage reads or writes (bit mask)
+{
+	None = 0,
+	Particles = 1 << 0,		// list membership - spawn and retire
+	Motion = 1 << 1,		// position, velocity, rotation, life
+	DrawList = 1 << 2,
+	Depth = 1 << 3,
+	Chunks = 1 << 4,		// chunk ranges and bounds
+	Camera = 1 << 5,
+	Visibility = 1 << 6,	// chunk cull results
+	Rows = 1 << 7,			// last transform rows kept on each particle
+	Instances = 1 << 8,
+	SliceStats = 1 << 9,
+	CullStats = 1 << 10,
+	Random = 1 << 11,		// rand() - shared by every emitter
+	Device = 1 << 12		// OpenGL - shared by every emitter
+};
+
+inline Stream operator | (Stream a, Stream b)
+{
+	return (Stream)((unsigned int)a | (unsigned int)b);
+}
+
+inline Stream operator & (Stream a, Stream b)
+{
+	return (Stream)((unsigned int)a & (unsigned int)b);
+}
+
 #endif 
 
 // --- End of File ---
@@ -0,0 +1,191 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <string.h>
+#include "FrameArena.h"
+#include "JobSystem.h"
+#include "Settings.h"
+
+FrameArena::FrameArena()
+	: memory(),
+	offset(0),
+	lastFrame(0),
+	highWater(0)
+{
+}
+
+void FrameArena::create(size_t reserveBytes, size_t baseBytes)
+{
+	assert(reserveBytes >= baseBytes);
+
+	this->memory.create((int)reserveBytes, (int)baseBytes, -1, false);
+
+	// faulted in now, not in the first frame
+	VirtualMemory::Touch(this->memory.data(), this->memory.getCommittedBytes());
+}
+
+void *FrameArena::alloc(size_t bytes, size_t alignment)
+{
+	assert(alignment == 16 || alignment == 32 || alignment == 64);
+
+	// the range itself is page aligned, aligning the offset is enough
+	const size_t begin = (this->offset + alignment - 1) & ~(alignment - 1);
+	const size_t end = begin + bytes;
+
+	if( !this->memory.ensure((int)end) )
+	{
+		return nullptr;
+	}
+
+	this->offset = end;
+	this->highWater = (end > this->highWater) ? end : this->highWater;
+
+	return this->memory.data() + begin;
+}
+
+size_t FrameArena::getMark() const
+{
+	return this->offset;
+}
+
+void FrameArena::rewind(size_t mark)
+{
+	assert(mark <= this->offset);
+
+#ifdef _DEBUG
+	memset(this->memory.data() + mark, FrameArena::POISON, this->offset - mark);
+#endif
+
+	this->offset = mark;
+}
+
+void FrameArena::reset()
+{
+#ifdef _DEBUG
+	memset(this->memory.data(), FrameArena::POISON, this->offset);
+#endif
+
+	this->lastFrame = this->offset;
+	this->offset = 0;
+
+	// no-op unless a burst left a quarter of the pages spare
+	this->memory.trim((int)this->lastFrame);
+}
+
+size_t FrameArena::getUsed() const
+{
+	return this->offset;
+}
+
+size_t FrameArena::getLastFrameBytes() const
+{
+	return this->lastFrame;
+}
+
+size_t FrameArena::getHighWater() const
+{
+	return this->highWater;
+}
+
+size_t FrameArena::getCommittedBytes() const
+{
+	return this->memory.getCommittedBytes();
+}
+
+void FrameArena::report(const char *pName) const
+{
+	const double kb = 1.0 / 1024.0;
+	Trace::out("  %-14s last frame %9.1f KB  high water %9.1f KB  committed %9.1f KB\n",
+		pName, (double)this->lastFrame * kb, (double)this->highWater * kb, (double)this->memory.getCommittedBytes() * kb);
+}
+
+FrameMemory::FrameMemory(int _numThreads, size_t frameReserve, size_t frameBase, FrameMemory *pThreadSource)
+	: frameArena(),
+	poThreadArenas(nullptr),
+	pThreadArenas(nullptr),
+	numThreads(_numThreads)
+{
+	assert(_numThreads > 0);
+
+	this->frameArena.create(frameReserve, frameBase);
+
+	if( pThreadSource != nullptr )
+	{
+		// one arena per job system thread, whoever asks for it
+		this->numThreads = pThreadSource->numThreads;
+		this->pThreadArenas = pThreadSource->pThreadArenas;
+	}
+	else
+	{
+		this->poThreadArenas = new FrameArena[(unsigned int)_numThreads];
+		for( int i = 0; i < _numThreads; i++ )
+		{
+			this->poThreadArenas[i].create(FRAME_ARENA_THREAD_RESERVE, VirtualMemory::COMMIT_GRANULE);
+		}
+		this->pThreadArenas = this->poThreadArenas;
+	}
+}
+
+FrameMemory::~FrameMemory()
+{
+	delete[] this->poThreadArenas;
+}
+
+FrameArena &FrameMemory::getFrameArena()
+{
+	return this->frameArena;
+}
+
+FrameArena &FrameMemory::getThreadArena()
+{
+	const int index = JobSystem::ThreadIndex();
+	assert(index >= 0 && index < this->numThreads);
+
+	return this->pThreadArenas[index];
+}
+
+void FrameMemory::reset()
+{
+	this->frameArena.reset();
+	if( this->poThreadArenas != nullptr )
+	{
+		for( int i = 0; i < this->numThreads; i++ )
+		{
+			this->poThreadArenas[i].reset();
+		}
+	}
+}
+
+size_t FrameMemory::getCommittedBytes() const
+{
+	size_t total = this->frameArena.getCommittedBytes();
+	if( this->poThreadArenas != nullptr )
+	{
+		for( int i = 0; i < this->numThreads; i++ )
+		{
+			total += this->poThreadArenas[i].getCommittedBytes();
+		}
+	}
+	return total;
+}
+
+void FrameMemory::report() const
+{
+	this->frameArena.report("frame arena");
+
+	if( this->poThreadArenas == nullptr )
+	{
+		Trace::out("  thread arenas shared\n");
+		return;
+	}
+
+	char name[32];
+	for( int i = 0; i < this->numThreads; i++ )
+	{
+		sprintf_s(name, sizeof(name), "thread %d arena", i);
+		this->poThreadArenas[i].report(name);
+	}
+}
+
+// --- End of File ---
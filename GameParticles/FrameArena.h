@@ -0,0 +1,124 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include "GrowableArray.h"
+
+// Linear (bump) allocator for data that only lives inside one frame
+//
+//     alloc() moves an offset forward, reset() moves it back to zero - no
+//     frees, no destructors, no heap. The memory is a reserved virtual range
+//     committed as the offset first reaches it (see GrowableArray), so a
+//     pointer stays valid until the next reset() no matter what comes after.
+//
+//     reset() is O(1); a debug build fills what the frame used with
+//     POISON first, so a pointer kept across frames reads garbage at once.
+//     Pages a burst left committed go back on reset, with the usual slack.
+//
+//     One owner at a time - not thread safe, see FrameMemory.
+class FrameArena
+{
+public:
+	static const unsigned char POISON = 0xCD;
+
+	FrameArena();
+	FrameArena(const FrameArena &) = delete;
+	FrameArena &operator = (const FrameArena &) = delete;
+	~FrameArena() = default;
+
+	// address space for reserveBytes, baseBytes committed and faulted in
+	void create(size_t reserveBytes, size_t baseBytes);
+
+	// alignment 16, 32 or 64 - nullptr past the reserve
+	void *alloc(size_t bytes, size_t alignment = 16);
+
+	// raw, uninitialized elements
+	template <typename T>
+	T *allocArray(int count, size_t alignment = 16)
+	{
+		return static_cast<T *>(this->alloc(sizeof(T) * (size_t)count, alignment));
+	}
+
+	// default constructed, never destroyed - plain data only
+	template <typename T>
+	T *make(size_t alignment = 16)
+	{
+		void *p = this->alloc(sizeof(T), alignment);
+		assert(p);
+
+		T *pObject;
+		AZUL_PLACEMENT_NEW_BEGIN
+		#undef new
+			pObject = ::new(p) T();
+		AZUL_PLACEMENT_NEW_END
+
+		return pObject;
+	}
+
+	// scoped scratch: everything allocated after getMark() goes on rewind()
+	size_t getMark() const;
+	void rewind(size_t mark);
+
+	void reset();
+
+	size_t getUsed() const;
+	size_t getLastFrameBytes() const;	// used when reset() was last called
+	size_t getHighWater() const;		// most used in any frame
+	size_t getCommittedBytes() const;
+
+	void report(const char *pName) const;
+
+private:
+	GrowableArray<unsigned char>	memory;
+	size_t	offset;
+	size_t	lastFrame;
+	size_t	highWater;
+};
+
+// The frame arena plus one arena per job system thread
+//
+//     getFrameArena() is for stage code: buffers one stage writes and a
+//     later one reads (depth keys, per slice counters). The stages that
+//     allocate from it are ordered by the frame graph, so it has a single
+//     owner at any time.
+//
+//     getThreadArena() is the calling thread's own (JobSystem::ThreadIndex),
+//     for scratch inside a job - no sharing, no atomics. Take a mark and
+//     rewind at the end of the job so a thread running many slices doesn't
+//     pile them up.
+//
+//     reset() while no job is running - the start of the next frame.
+//
+//     Given a pThreadSource, the thread arenas are that one's: jobs only
+//     use them mark / rewind, so owners can take turns on them. Only the
+//     source resets them and counts their pages (see EmitterSystem).
+class FrameMemory
+{
+public:
+	FrameMemory(int numThreads, size_t frameReserve, size_t frameBase, FrameMemory *pThreadSource = nullptr);
+	FrameMemory() = delete;
+	FrameMemory(const FrameMemory &) = delete;
+	FrameMemory &operator = (const FrameMemory &) = delete;
+	~FrameMemory();
+
+	FrameArena &getFrameArena();
+	FrameArena &getThreadArena();
+
+	void reset();
+
+	size_t getCommittedBytes() const;
+	void report() const;
+
+private:
+	FrameArena	frameArena;
+	FrameArena	*poThreadArenas;	// nullptr when borrowed
+	FrameArena	*pThreadArenas;
+	int			numThreads;
+};
+
+#endif
+
+// --- End of File ---
@@ -0,0 +1,155 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include "FrameBarrier.h"
+
+FrameBarrier::FrameBarrier(int _spinBudget)
+	: generation(0),
+	armed(0),
+	sleeping(0),
+	releaseTicks(0),
+	spinBudget(_spinBudget > 0 ? _spinBudget : 0),
+	spinWakes(0),
+	sleepWakes(0),
+	spinTicks(0),
+	sleepTicks(0),
+	maxTicks(0),
+	releases(0)
+{
+}
+
+FrameBarrier::~FrameBarrier()
+{
+	// nobody may still be waiting
+	assert(this->sleeping.load() == 0);
+}
+
+long long FrameBarrier::privNow()
+{
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+unsigned int FrameBarrier::arm()
+{
+	// announce first, so a release() after this point can't miss us
+	this->armed.fetch_add(1, std::memory_order_seq_cst);
+	return this->generation.load(std::memory_order_seq_cst);
+}
+
+void FrameBarrier::disarm()
+{
+	this->armed.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void FrameBarrier::wait(unsigned int ticket)
+{
+	const int budget = this->spinBudget.load(std::memory_order_relaxed);
+	int spins = 0;
+	bool slept = false;
+
+	while( this->generation.load(std::memory_order_acquire) == ticket )
+	{
+		if( spins < budget )
+		{
+			_mm_pause();
+			spins++;
+			continue;
+		}
+
+		// pairs with the generation bump then sleeping check in release()
+		this->sleeping.fetch_add(1, std::memory_order_seq_cst);
+		if( this->generation.load(std::memory_order_seq_cst) == ticket )
+		{
+			unsigned int compare = ticket;
+			WaitOnAddress((volatile void *)&this->generation, &compare, sizeof(compare), INFINITE);
+		}
+		this->sleeping.fetch_sub(1, std::memory_order_relaxed);
+		slept = true;
+	}
+
+	this->armed.fetch_sub(1, std::memory_order_relaxed);
+	this->privRecord(slept);
+}
+
+void FrameBarrier::release()
+{
+	this->releaseTicks.store(FrameBarrier::privNow(), std::memory_order_relaxed);
+	this->generation.fetch_add(1, std::memory_order_seq_cst);
+	this->releases.fetch_add(1, std::memory_order_relaxed);
+
+	// the syscall only when somebody gave up spinning
+	if( this->sleeping.load(std::memory_order_seq_cst) > 0 )
+	{
+		WakeByAddressAll((void *)&this->generation);
+	}
+}
+
+bool FrameBarrier::hasWaiters() const
+{
+	return this->armed.load(std::memory_order_relaxed) > 0;
+}
+
+void FrameBarrier::setSpinBudget(int _spinBudget)
+{
+	this->spinBudget.store((_spinBudget > 0) ? _spinBudget : 0, std::memory_order_relaxed);
+}
+
+int FrameBarrier::getSpinBudget() const
+{
+	return this->spinBudget.load(std::memory_order_relaxed);
+}
+
+void FrameBarrier::privRecord(bool slept)
+{
+	// against the latest release - an early waker may see a newer one
+	long long ticks = FrameBarrier::privNow() - this->releaseTicks.load(std::memory_order_relaxed);
+	ticks = (ticks > 0) ? ticks : 0;
+
+	if( slept )
+	{
+		this->sleepWakes.fetch_add(1, std::memory_order_relaxed);
+		this->sleepTicks.fetch_add(ticks, std::memory_order_relaxed);
+	}
+	else
+	{
+		this->spinWakes.fetch_add(1, std::memory_order_relaxed);
+		this->spinTicks.fetch_add(ticks, std::memory_order_relaxed);
+	}
+
+	long long prev = this->maxTicks.load(std::memory_order_relaxed);
+	while( (ticks > prev) && !this->maxTicks.compare_exchange_weak(prev, ticks, std::memory_order_relaxed) )
+	{
+	}
+}
+
+void FrameBarrier::report(const char *pName) const
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	const double usPerTick = 1000000.0 / (double)freq.QuadPart;
+
+	const int numSpin = this->spinWakes.load();
+	const int numSleep = this->sleepWakes.load();
+	const double spinUs = (numSpin > 0) ? (double)this->spinTicks.load() * usPerTick / numSpin : 0.0;
+	const double sleepUs = (numSleep > 0) ? (double)this->sleepTicks.load() * usPerTick / numSleep : 0.0;
+
+	Trace::out("--- FrameBarrier %s: spin budget %d, %d releases ---\n", pName, this->getSpinBudget(), this->releases.load());
+	Trace::out("  spin wake ups:  %7d  avg %8.2f us\n", numSpin, spinUs);
+	Trace::out("  sleep wake ups: %7d  avg %8.2f us\n", numSleep, sleepUs);
+	Trace::out("  worst wake up:  %8.2f us\n", (double)this->maxTicks.load() * usPerTick);
+}
+
+void FrameBarrier::resetStats()
+{
+	this->spinWakes.store(0);
+	this->sleepWakes.store(0);
+	this->spinTicks.store(0);
+	this->sleepTicks.store(0);
+	this->maxTicks.store(0);
+	this->releases.store(0);
+}
+
+// --- End of File ---
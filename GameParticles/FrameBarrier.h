@@ -0,0 +1,65 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef FRAME_BARRIER_H
+#define FRAME_BARRIER_H
+
+#include <atomic>
+
+// Hybrid spin-then-futex wake up for the worker threads
+//
+//     A waiter takes a ticket with arm(), re-checks its own condition, then
+//     wait()s: it spins on the generation for spinBudget pauses and only
+//     then blocks in WaitOnAddress. release() bumps the generation and only
+//     pays for WakeByAddressAll when somebody actually went to sleep.
+//
+//     Every wake up is timed from the release that caused it, split in
+//     spin and sleep wake ups - report() prints both so the spin budget
+//     can be tuned per core count.
+class FrameBarrier
+{
+public:
+	explicit FrameBarrier(int spinBudget);
+	FrameBarrier() = delete;
+	FrameBarrier(const FrameBarrier &) = delete;
+	FrameBarrier &operator = (const FrameBarrier &) = delete;
+	~FrameBarrier();
+
+	// waiter side
+	unsigned int arm();
+	void disarm();
+	void wait(unsigned int ticket);
+
+	// releaser side - wakes everybody armed before the call
+	void release();
+	bool hasWaiters() const;
+
+	void setSpinBudget(int spinBudget);
+	int getSpinBudget() const;
+
+	void report(const char *pName) const;
+	void resetStats();
+
+private:
+	static long long privNow();
+	void privRecord(bool slept);
+
+	std::atomic<unsigned int>	generation;		// the WaitOnAddress word
+	std::atomic<int>			armed;
+	std::atomic<int>			sleeping;
+	std::atomic<long long>		releaseTicks;
+	std::atomic<int>			spinBudget;		// pauses before sleeping
+
+	// wake up latency, in performance counter ticks
+	std::atomic<int>			spinWakes;
+	std::atomic<int>			sleepWakes;
+	std::atomic<long long>		spinTicks;
+	std::atomic<long long>		sleepTicks;
+	std::atomic<long long>		maxTicks;
+	std::atomic<int>			releases;
+};
+
+#endif
+
+// --- End of File ---
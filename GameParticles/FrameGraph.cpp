@@ -0,0 +1,352 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <string.h>
+#include "FrameGraph.h"
+#include "JobSystem.h"
+#include "AllocProfiler.h"
+
+// shared by every owner
+static const Stream GLOBAL_STREAMS = Stream::Random | Stream::Device;
+
+static const char *const STREAM_NAMES[] =
+{
+	"Particles", "Motion", "DrawList", "Depth", "Chunks", "Camera", "Visibility",
+	"Rows", "Instances", "SliceStats", "CullStats", "Random", "Device"
+};
+
+static const int NUM_STREAMS = (int)(sizeof(STREAM_NAMES) / sizeof(STREAM_NAMES[0]));
+
+static bool Any(Stream s)
+{
+	return (unsigned int)s != 0;
+}
+
+static void StreamNames(Stream s, char *pBuff, size_t size)
+{
+	pBuff[0] = 0;
+	for( int i = 0; i < NUM_STREAMS; i++ )
+	{
+		if( ((unsigned int)s >> i) & 1u )
+		{
+			if( pBuff[0] != 0 )
+			{
+				strcat_s(pBuff, size, "|");
+			}
+			strcat_s(pBuff, size, STREAM_NAMES[i]);
+		}
+	}
+
+	if( pBuff[0] == 0 )
+	{
+		strcat_s(pBuff, size, "-");
+	}
+}
+
+FrameGraph::FrameGraph(const char *_pName, int _maxStages)
+	: pName(_pName),
+	poStages(nullptr),
+	poEdges(nullptr),
+	maxStages(_maxStages),
+	numStages(0),
+	numEdges(0),
+	numLevels(0),
+	frames(0),
+	compiled(false),
+	pJobs(nullptr),
+	remaining(0),
+	poMainQueue(nullptr),
+	mainTail(0),
+	mainHead(0)
+{
+	assert(_maxStages > 0);
+
+	this->poStages = new Stage[(unsigned int)_maxStages];
+	this->poMainQueue = new std::atomic<int>[(unsigned int)_maxStages];
+
+	for( int i = 0; i < _maxStages; i++ )
+	{
+		this->poMainQueue[i].store(-1, std::memory_order_relaxed);
+	}
+}
+
+FrameGraph::~FrameGraph()
+{
+	delete[] this->poMainQueue;
+	delete[] this->poEdges;
+	delete[] this->poStages;
+}
+
+int FrameGraph::addStage(const char *_pName, const void *pOwner, Stream reads, Stream writes,
+	StageFunc func, void *pContext, bool mainThread)
+{
+	assert(!this->compiled);
+	assert(this->numStages < this->maxStages);
+	assert(func);
+
+	const int index = this->numStages++;
+	Stage &stage = this->poStages[index];
+
+	stage.pName = _pName;
+	stage.pOwner = pOwner;
+	stage.reads = reads;
+	stage.writes = writes;
+	stage.func = func;
+	stage.pContext = pContext;
+	stage.mainThread = mainThread;
+	stage.level = 0;
+	stage.numInputs = 0;
+	stage.firstEdge = 0;
+	stage.numEdges = 0;
+	stage.pending.store(0, std::memory_order_relaxed);
+	stage.lastMs = 0.0f;
+	stage.totalMs = 0.0f;
+
+	return index;
+}
+
+bool FrameGraph::privConflict(const Stage &a, const Stage &b) const
+{
+	Stream mask = GLOBAL_STREAMS;
+	if( a.pOwner == b.pOwner )
+	{
+		mask = (Stream)~0u;
+	}
+
+	// read after write, write after read, write after write
+	return Any(a.writes & b.reads & mask)
+		|| Any(a.reads & b.writes & mask)
+		|| Any(a.writes & b.writes & mask);
+}
+
+void FrameGraph::compile()
+{
+	assert(!this->compiled);
+
+	// count, then fill - edges of a stage are contiguous
+	for( int j = 0; j < this->numStages; j++ )
+	{
+		Stage &from = this->poStages[j];
+		from.firstEdge = this->numEdges;
+
+		for( int i = j + 1; i < this->numStages; i++ )
+		{
+			if( this->privConflict(from, this->poStages[i]) )
+			{
+				from.numEdges++;
+				this->numEdges++;
+			}
+		}
+	}
+
+	this->poEdges = new int[(unsigned int)(this->numEdges > 0 ? this->numEdges : 1)];
+
+	for( int j = 0; j < this->numStages; j++ )
+	{
+		Stage &from = this->poStages[j];
+		int e = from.firstEdge;
+
+		for( int i = j + 1; i < this->numStages; i++ )
+		{
+			Stage &to = this->poStages[i];
+			if( this->privConflict(from, to) )
+			{
+				this->poEdges[e++] = i;
+				to.numInputs++;
+
+				// program order is topological, from.level is final here
+				to.level = (from.level + 1 > to.level) ? from.level + 1 : to.level;
+			}
+		}
+
+		this->numLevels = (from.level + 1 > this->numLevels) ? from.level + 1 : this->numLevels;
+	}
+
+	this->compiled = true;
+}
+
+void FrameGraph::execute(JobSystem *_pJobs)
+{
+	assert(this->compiled);
+
+	this->frames++;
+
+	if( _pJobs == nullptr )
+	{
+		// program order is a valid schedule
+		for( int i = 0; i < this->numStages; i++ )
+		{
+			this->privRun(i);
+		}
+		return;
+	}
+
+	this->pJobs = _pJobs;
+	this->mainTail.store(0, std::memory_order_relaxed);
+	this->mainHead = 0;
+	for( int i = 0; i < this->numStages; i++ )
+	{
+		this->poStages[i].pending.store(this->poStages[i].numInputs, std::memory_order_relaxed);
+	}
+	this->remaining.store(this->numStages, std::memory_order_release);
+
+	for( int i = 0; i < this->numStages; i++ )
+	{
+		if( this->poStages[i].numInputs == 0 )
+		{
+			this->privLaunch(i);
+		}
+	}
+
+	// run main thread stages as they come ready, help with the rest
+	while( this->remaining.load(std::memory_order_acquire) > 0 )
+	{
+		if( this->mainHead < this->mainTail.load(std::memory_order_acquire) )
+		{
+			// slot is claimed before it is written
+			const int index = this->poMainQueue[this->mainHead].load(std::memory_order_acquire);
+			if( index >= 0 )
+			{
+				this->poMainQueue[this->mainHead].store(-1, std::memory_order_relaxed);
+				this->mainHead++;
+
+				this->privRun(index);
+				this->privComplete(index);
+				continue;
+			}
+		}
+
+		if( !this->pJobs->help() )
+		{
+			_mm_pause();
+		}
+	}
+
+	this->pJobs = nullptr;
+}
+
+void FrameGraph::privStageJob(void *pContext, int begin, int, int)
+{
+	FrameGraph *pGraph = static_cast<FrameGraph *>(pContext);
+
+	pGraph->privRun(begin);
+	pGraph->privComplete(begin);
+}
+
+void FrameGraph::privLaunch(int index)
+{
+	if( this->poStages[index].mainThread )
+	{
+		const int slot = this->mainTail.fetch_add(1, std::memory_order_acq_rel);
+		this->poMainQueue[slot].store(index, std::memory_order_release);
+	}
+	else
+	{
+		this->pJobs->run(this->pJobs->create(&FrameGraph::privStageJob, this, index, index + 1, 0, nullptr));
+	}
+}
+
+void FrameGraph::privRun(int index)
+{
+	Stage &stage = this->poStages[index];
+
+	// heap use is charged to the stage, its jobs included
+	AllocScope scope(stage.pName);
+
+	stage.timer.Tic();
+	stage.func(stage.pContext);
+	stage.timer.Toc();
+
+	stage.lastMs = (float)stage.timer.TimeInSeconds() * 1000.0f;
+	stage.totalMs += stage.lastMs;
+}
+
+void FrameGraph::privComplete(int index)
+{
+	const Stage &stage = this->poStages[index];
+
+	for( int e = 0; e < stage.numEdges; e++ )
+	{
+		const int next = this->poEdges[stage.firstEdge + e];
+		if( this->poStages[next].pending.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+		{
+			this->privLaunch(next);
+		}
+	}
+
+	this->remaining.fetch_sub(1, std::memory_order_release);
+}
+
+void FrameGraph::dumpSchedule() const
+{
+	Trace::out("--- FrameGraph %s: %d stages, %d levels, %d edges ---\n",
+		this->pName, this->numStages, this->numLevels, this->numEdges);
+
+	char reads[128];
+	char writes[128];
+	char after[256];
+
+	for( int level = 0; level < this->numLevels; level++ )
+	{
+		for( int i = 0; i < this->numStages; i++ )
+		{
+			const Stage &stage = this->poStages[i];
+			if( stage.level != level )
+			{
+				continue;
+			}
+
+			StreamNames(stage.reads, reads, sizeof(reads));
+			StreamNames(stage.writes, writes, sizeof(writes));
+
+			// inputs, by scanning every edge list
+			after[0] = 0;
+			for( int j = 0; j < i; j++ )
+			{
+				const Stage &from = this->poStages[j];
+				for( int e = 0; e < from.numEdges; e++ )
+				{
+					if( this->poEdges[from.firstEdge + e] == i )
+					{
+						char num[16];
+						sprintf_s(num, sizeof(num), after[0] ? ",%d" : "%d", j);
+						strcat_s(after, sizeof(after), num);
+					}
+				}
+			}
+
+			Trace::out("  L%d  #%-3d %-12s %p%s  reads:%s  writes:%s  after:%s\n",
+				level, i, stage.pName, stage.pOwner, stage.mainThread ? " (main)" : "",
+				reads, writes, after[0] ? after : "-");
+		}
+	}
+}
+
+void FrameGraph::dumpTimings() const
+{
+	Trace::out("--- FrameGraph %s timings (%d frames) ---\n", this->pName, this->frames);
+
+	for( int i = 0; i < this->numStages; i++ )
+	{
+		const Stage &stage = this->poStages[i];
+		const float avg = (this->frames > 0) ? stage.totalMs / (float)this->frames : 0.0f;
+
+		Trace::out("  #%-3d %-12s %p  last:%8.4f ms  avg:%8.4f ms\n",
+			i, stage.pName, stage.pOwner, stage.lastMs, avg);
+	}
+}
+
+int FrameGraph::getNumStages() const
+{
+	return this->numStages;
+}
+
+float FrameGraph::getAverageMs(int index) const
+{
+	assert(index >= 0 && index < this->numStages);
+
+	return (this->frames > 0) ? this->poStages[index].totalMs / (float)this->frames : 0.0f;
+}
+
+// --- End of File ---
@@ -0,0 +1,114 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+#include <atomic>
+#include "Enum.h"
+
+class JobSystem;
+
+typedef void (*StageFunc)(void *pContext);
+
+// Declarative per frame stage graph
+//
+//     Stages are added in program order with the streams they read and
+//     write. compile() derives the edges: a stage waits for every earlier
+//     stage of the same owner it has a read/write, write/read or
+//     write/write conflict with. Random and Device are shared by all
+//     owners, so stages touching them also order across emitters.
+//
+//     execute() starts every stage without pending inputs as a job, a
+//     finishing stage starts the successors it was the last input of.
+//     Main thread stages (rand(), OpenGL) are queued to the calling thread,
+//     which runs them and otherwise helps with the jobs.
+//
+//     Built once at startup - execute() does not allocate. maxStages is
+//     the capacity, MAX_STAGES unless a scene has many owners.
+class FrameGraph
+{
+public:
+	static const int MAX_STAGES = 128;
+
+	explicit FrameGraph(const char *pName, int maxStages = MAX_STAGES);
+	FrameGraph() = delete;
+	FrameGraph(const FrameGraph &) = delete;
+	FrameGraph &operator = (const FrameGraph &) = delete;
+	~FrameGraph();
+
+	int addStage(const char *pName, const void *pOwner, Stream reads, Stream writes,
+		StageFunc func, void *pContext, bool mainThread = false);
+
+	// member function as a stage: &FrameGraph::Call<T, &T::method>
+	template <typename T, void (T::*Method)()>
+	static void Call(void *pContext)
+	{
+		(static_cast<T *>(pContext)->*Method)();
+	}
+
+	void compile();
+	void execute(JobSystem *pJobs);
+
+	// Trace::out of the levels, streams and edges
+	void dumpSchedule() const;
+
+	// Trace::out of the last and average time of every stage
+	void dumpTimings() const;
+
+	// addStage() returns the index
+	int getNumStages() const;
+	float getAverageMs(int index) const;
+
+private:
+	struct Stage
+	{
+		const char		*pName;
+		const void		*pOwner;
+		Stream			reads;
+		Stream			writes;
+		StageFunc		func;
+		void			*pContext;
+		bool			mainThread;
+
+		int				level;			// longest path from a root
+		int				numInputs;
+		int				firstEdge;		// successors in poEdges
+		int				numEdges;
+		std::atomic<int>	pending;
+
+		PerformanceTimer	timer;
+		float			lastMs;
+		float			totalMs;
+	};
+
+	static void privStageJob(void *pContext, int begin, int end, int slice);
+
+	bool privConflict(const Stage &a, const Stage &b) const;
+	void privLaunch(int index);
+	void privRun(int index);
+	void privComplete(int index);
+
+	const char		*pName;
+	Stage			*poStages;
+	int				*poEdges;
+	int				maxStages;
+	int				numStages;
+	int				numEdges;
+	int				numLevels;
+	int				frames;
+	bool			compiled;
+
+	JobSystem			*pJobs;			// during execute()
+	std::atomic<int>	remaining;
+
+	// ready main thread stages - any thread appends, the caller drains
+	std::atomic<int>	*poMainQueue;
+	std::atomic<int>	mainTail;
+	int					mainHead;
+};
+
+#endif
+
+// --- End of File ---
@@ -0,0 +1,199 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef GROWABLE_ARRAY_H
+#define GROWABLE_ARRAY_H
+
+#include "VirtualMemory.h"
+
+// Array over a reserved virtual range
+//
+//     create() reserves room for maxCount elements and commits the first
+//     baseCount. ensure() commits (and pre-faults) more as the count grows,
+//     trim() hands pages back once the count drops well below what is
+//     committed - never below baseCount. data() never moves, so pointers
+//     into the array survive any growth: no reallocation, no copies.
+//
+//     With tryLarge and large pages available it is baseCount worth of
+//     large pages instead - faster, but fixed: getMaxCount() is baseCount.
+//
+//     Elements are zeroed memory, no constructors run.
+template <typename T>
+class GrowableArray
+{
+public:
+	GrowableArray()
+		: pBase(nullptr),
+		reserved(0),
+		committed(0),
+		base(0),
+		peak(0),
+		nodeNumber(-1),
+		large(false)
+	{
+	}
+
+	GrowableArray(const GrowableArray &) = delete;
+	GrowableArray &operator = (const GrowableArray &) = delete;
+
+	~GrowableArray()
+	{
+		this->destroy();
+	}
+
+	// nodeNumber -1: any node - committed pages are not touched here
+	void create(int maxCount, int baseCount, int _nodeNumber, bool tryLarge)
+	{
+		assert(this->pBase == nullptr);
+		assert(maxCount >= baseCount && baseCount >= 0);
+
+		this->nodeNumber = _nodeNumber;
+		this->base = GrowableArray::privBytes(baseCount);
+
+		if( tryLarge && baseCount > 0 )
+		{
+			size_t bytes = sizeof(T) * (size_t)baseCount;
+			this->pBase = static_cast<T *>(VirtualMemory::AllocLarge(bytes, _nodeNumber));
+			if( this->pBase != nullptr )
+			{
+				this->reserved = bytes;
+				this->committed = bytes;
+				this->base = bytes;
+				this->peak = bytes;
+				this->large = true;
+				return;
+			}
+		}
+
+		this->reserved = GrowableArray::privBytes(maxCount);
+		this->pBase = static_cast<T *>(VirtualMemory::Reserve(this->reserved > 0 ? this->reserved : VirtualMemory::COMMIT_GRANULE));
+		assert(this->pBase);
+
+		const bool ok = VirtualMemory::Commit(this->pBase, this->base, _nodeNumber);
+		assert(ok);
+		AZUL_UNUSED_VAR(ok);
+
+		this->committed = this->base;
+		this->peak = this->base;
+	}
+
+	void destroy()
+	{
+		VirtualMemory::Release(this->pBase);
+		this->pBase = nullptr;
+		this->reserved = 0;
+		this->committed = 0;
+		this->base = 0;
+		this->large = false;
+	}
+
+	// false when count is past the reservation
+	bool ensure(int count)
+	{
+		const size_t bytes = sizeof(T) * (size_t)count;
+		if( bytes <= this->committed )
+		{
+			return true;
+		}
+		if( bytes > this->reserved )
+		{
+			return false;
+		}
+
+		size_t target = GrowableArray::privBytes(count);
+		target = (target < this->reserved) ? target : this->reserved;
+
+		char *pEnd = reinterpret_cast<char *>(this->pBase) + this->committed;
+		if( !VirtualMemory::Commit(pEnd, target - this->committed, this->nodeNumber) )
+		{
+			return false;
+		}
+		VirtualMemory::Touch(pEnd, target - this->committed);
+
+		this->committed = target;
+		this->peak = (target > this->peak) ? target : this->peak;
+		return true;
+	}
+
+	// decommits down to count + 1/4 slack once a quarter of the pages is spare
+	void trim(int count)
+	{
+		if( this->large )
+		{
+			return;
+		}
+
+		const size_t bytes = sizeof(T) * (size_t)count;
+		size_t target = VirtualMemory::RoundUp(bytes + bytes / 4, VirtualMemory::COMMIT_GRANULE);
+		target = (target > this->base) ? target : this->base;
+		target = (target < this->reserved) ? target : this->reserved;
+
+		if( this->committed > target && (this->committed - target) >= this->committed / 4 )
+		{
+			VirtualMemory::Decommit(reinterpret_cast<char *>(this->pBase) + target, this->committed - target);
+			this->committed = target;
+		}
+	}
+
+	T *data() const
+	{
+		return this->pBase;
+	}
+
+	int getMaxCount() const
+	{
+		return (int)(this->reserved / sizeof(T));
+	}
+
+	int getCommittedCount() const
+	{
+		return (int)(this->committed / sizeof(T));
+	}
+
+	size_t getReservedBytes() const
+	{
+		return this->reserved;
+	}
+
+	size_t getCommittedBytes() const
+	{
+		return this->committed;
+	}
+
+	size_t getPeakBytes() const
+	{
+		return this->peak;
+	}
+
+	bool isLarge() const
+	{
+		return this->large;
+	}
+
+	void report(const char *pName) const
+	{
+		const double mb = 1.0 / (1024.0 * 1024.0);
+		Trace::out("  %-14s reserved %9.2f MB  committed %8.2f MB  peak %8.2f MB%s\n",
+			pName, (double)this->reserved * mb, (double)this->committed * mb, (double)this->peak * mb,
+			this->large ? "  (large pages)" : "");
+	}
+
+private:
+	static size_t privBytes(int count)
+	{
+		return VirtualMemory::RoundUp(sizeof(T) * (size_t)count, VirtualMemory::COMMIT_GRANULE);
+	}
+
+	T		*pBase;
+	size_t	reserved;
+	size_t	committed;
+	size_t	base;		// never decommitted below
+	size_t	peak;
+	int		nodeNumber;
+	bool	large;
+};
+
+#endif
+
+// --- End of File ---
@@ -0,0 +1,113 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <string.h>
+#include "HalfFloat.h"
+#include "CpuFeatures.h"
+#include "Vect4D.h"
+#include "Settings.h"
+
+const bool HalfFloat::useF16C = CpuFeatures::Get().hasF16C();
+
+// samples per attribute in the error report
+static const int REPORT_SAMPLES = 100000;
+
+// fixed seed - the report must not touch rand(), spawning depends on its sequence
+static float RandomRange(unsigned int &state, const float lo, const float hi)
+{
+	state = state * 1664525u + 1013904223u;
+	return lo + (hi - lo) * (float)(state >> 8) * (1.0f / 16777216.0f);
+}
+
+static float RoundTrip(const float f)
+{
+	return HalfFloat::ToFloat(HalfFloat::FromFloat(f));
+}
+
+struct HalfError
+{
+	float	maxAbs;
+	float	maxRel;
+};
+
+static HalfError Measure(const float lo, const float hi, unsigned int &state)
+{
+	HalfError error = { 0.0f, 0.0f };
+	for( int i = 0; i < REPORT_SAMPLES; i++ )
+	{
+		const float f = RandomRange(state, lo, hi);
+		const float err = fabsf(RoundTrip(f) - f);
+		const float rel = (f != 0.0f) ? err / fabsf(f) : 0.0f;
+
+		error.maxAbs = (err > error.maxAbs) ? err : error.maxAbs;
+		error.maxRel = (rel > error.maxRel) ? rel : error.maxRel;
+	}
+	return error;
+}
+
+bool HalfFloat::UsesF16C()
+{
+	return HalfFloat::useF16C;
+}
+
+void HalfFloat::Report()
+{
+	Trace::out("--- HalfFloat: %s path ---\n", HalfFloat::useF16C ? "F16C" : "SSE2 fallback");
+
+	// both paths must agree bit for bit, or the run depends on the CPU
+	if( CpuFeatures::Get().hasF16C() )
+	{
+		int unpackMismatch = 0;
+		for( int h = 0; h < 0x10000; h += 4 )
+		{
+			const __m128i v = _mm_setr_epi16((short)h, (short)(h + 1), (short)(h + 2), (short)(h + 3), 0, 0, 0, 0);
+			const __m128i a = _mm_castps_si128(HalfFloat::UnpackF16C(v));
+			const __m128i b = _mm_castps_si128(HalfFloat::UnpackSSE(v));
+
+			// nan payloads may differ, nan-ness may not
+			const __m128 fa = _mm_castsi128_ps(a);
+			const __m128i bothNan = _mm_castps_si128(_mm_and_ps(_mm_cmpunord_ps(fa, fa), _mm_cmpunord_ps(_mm_castsi128_ps(b), _mm_castsi128_ps(b))));
+			const __m128i same = _mm_or_si128(_mm_cmpeq_epi32(a, b), bothNan);
+			const int mask = _mm_movemask_ps(_mm_castsi128_ps(same));
+			for( int lane = 0; lane < 4; lane++ )
+			{
+				unpackMismatch += ((mask >> lane) & 1) ? 0 : 1;
+			}
+		}
+
+		int packMismatch = 0;
+		unsigned int state = 1u;
+		for( int i = 0; i < REPORT_SAMPLES; i++ )
+		{
+			// every float exponent a half can reach, both signs
+			const float scale = ldexpf(1.0f, (int)RandomRange(state, -26.0f, 17.0f));
+			const __m128 v = _mm_setr_ps(RandomRange(state, -scale, scale), RandomRange(state, -scale, scale),
+				RandomRange(state, -scale, scale), RandomRange(state, -scale, scale));
+
+			const __m128i same = _mm_cmpeq_epi16(HalfFloat::PackF16C(v), HalfFloat::PackSSE(v));
+			packMismatch += (_mm_movemask_epi8(same) & 0xFF) != 0xFF ? 1 : 0;
+		}
+
+		Trace::out("  F16C vs SSE2: %d of 65536 halves and %d of %d float quads differ\n",
+			unpackMismatch, packMismatch, REPORT_SAMPLES);
+	}
+
+	// ranges the emitter produces (start +- variance, see VarianceSpawn::Execute)
+	unsigned int state = 7u;
+	const HalfError velocity = Measure(-20.0f, 20.0f, state);
+	const HalfError scale = Measure(-8.0f, 8.0f, state);
+	const float rotationVelocity = fabsf(RoundTrip(-0.25f) + 0.25f);
+
+	Trace::out("  velocity      max abs %.3e  max rel %.3e  -> drift after %.0f s: %.3e units\n",
+		velocity.maxAbs, velocity.maxRel, MAX_LIFE, velocity.maxAbs * MAX_LIFE);
+	Trace::out("  scale         max abs %.3e  max rel %.3e\n", scale.maxAbs, scale.maxRel);
+	Trace::out("  rotation vel  abs %.3e\n", rotationVelocity);
+
+	const int floatBytes = (int)(2 * sizeof(Vect4D) + sizeof(float));
+	const int halfBytes = (int)(2 * sizeof(Half4) + sizeof(uint16_t));
+	Trace::out("  cold attributes: %d -> %d bytes per particle (%s)\n", floatBytes, halfBytes,
+		PARTICLE_HALF_ATTRIBUTES ? "half layout on" : "float layout, PARTICLE_HALF_ATTRIBUTES 0");
+}
+
+// --- End of File ---
@@ -0,0 +1,120 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef HALF_FLOAT_H
+#define HALF_FLOAT_H
+
+#include <stdint.h>
+
+// four IEEE binary16 lanes, x y z w - 8 bytes instead of a 16 byte Vect4D
+struct Half4
+{
+	uint16_t	h[4];
+};
+
+// IEEE half <-> float, four lanes at a time
+//
+//     F16C (vcvtph2ps / vcvtps2ph) when the CPU and OS have it, otherwise
+//     an SSE2 bit-twiddling version. Both round to nearest even and give
+//     the same bits for every input, so the simulation doesn't depend on
+//     the machine - Report() checks that, and prints the error of the half
+//     attributes against the float ones.
+//
+//     11 significant bits: about 3 decimal digits, |x| up to 65504.
+class HalfFloat
+{
+public:
+	static __m128 Load(const Half4 &src)
+	{
+		const __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src.h));
+		return HalfFloat::useF16C ? HalfFloat::UnpackF16C(h) : HalfFloat::UnpackSSE(h);
+	}
+
+	static void Store(Half4 &dst, const __m128 v)
+	{
+		const __m128i h = HalfFloat::useF16C ? HalfFloat::PackF16C(v) : HalfFloat::PackSSE(v);
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst.h), h);
+	}
+
+	static float ToFloat(const uint16_t h)
+	{
+		const __m128i v = _mm_cvtsi32_si128(h);
+		return _mm_cvtss_f32(HalfFloat::useF16C ? HalfFloat::UnpackF16C(v) : HalfFloat::UnpackSSE(v));
+	}
+
+	static uint16_t FromFloat(const float f)
+	{
+		const __m128 v = _mm_set_ss(f);
+		return (uint16_t)_mm_cvtsi128_si32(HalfFloat::useF16C ? HalfFloat::PackF16C(v) : HalfFloat::PackSSE(v));
+	}
+
+	static bool UsesF16C();
+
+	// F16C vs SSE bits, half vs float error of the particle attributes
+	static void Report();
+
+	// 4 halves in the low 64 bits <-> 4 floats
+	static __m128 UnpackF16C(const __m128i h)
+	{
+		return _mm_cvtph_ps(h);
+	}
+
+	static __m128i PackF16C(const __m128 v)
+	{
+		return _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+	}
+
+	static __m128 UnpackSSE(const __m128i h16)
+	{
+		// widen, then let a multiply by 2^112 rebias the exponent (denormals included)
+		const __m128i h = _mm_unpacklo_epi16(h16, _mm_setzero_si128());
+		const __m128i expMant = _mm_and_si128(h, _mm_set1_epi32(0x7FFF));
+		const __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expMant), 16);
+
+		const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMant, 13)),
+			_mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+
+		// inf / nan keep an all ones exponent
+		const __m128i infNan = _mm_and_si128(_mm_cmpgt_epi32(expMant, _mm_set1_epi32(0x7BFF)), _mm_set1_epi32(255 << 23));
+
+		return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNan)));
+	}
+
+	static __m128i PackSSE(const __m128 v)
+	{
+		const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000u));
+		const __m128 justSign = _mm_and_ps(v, signMask);
+		const __m128 absV = _mm_xor_ps(v, justSign);
+		const __m128i absBits = _mm_castps_si128(absV);
+
+		// too big -> inf, nan stays a (quiet) nan
+		const __m128i isRegular = _mm_cmpgt_epi32(_mm_set1_epi32((127 + 16) << 23), absBits);
+		const __m128i nanBit = _mm_and_si128(_mm_castps_si128(_mm_cmpunord_ps(absV, absV)), _mm_set1_epi32(0x200));
+		const __m128i infNan = _mm_or_si128(nanBit, _mm_set1_epi32(0x7C00));
+
+		// denormal result: the float add does the rounding
+		const __m128i subMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		const __m128i isSub = _mm_cmpgt_epi32(_mm_set1_epi32((127 - 14) << 23), absBits);
+		const __m128i sub = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absV, _mm_castsi128_ps(subMagic))), subMagic);
+
+		// normal result: rebias, round to nearest even, drop 13 bits
+		const __m128i mantOdd = _mm_srai_epi32(_mm_slli_epi32(absBits, 31 - 13), 31);
+		const __m128i rounded = _mm_sub_epi32(_mm_add_epi32(absBits, _mm_set1_epi32(0xFFF - ((127 - 15) << 23))), mantOdd);
+		const __m128i normal = _mm_srli_epi32(rounded, 13);
+
+		const __m128i finite = _mm_or_si128(_mm_and_si128(isSub, sub), _mm_andnot_si128(isSub, normal));
+		const __m128i joined = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, infNan));
+
+		// sign lands in bit 15, the lanes fit signed 16 bits for the pack
+		const __m128i result = _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(justSign), 16));
+		return _mm_packs_epi32(result, result);
+	}
+
+private:
+	static const bool useF16C;
+};
+
+#endif
+
+// --- End of File ---
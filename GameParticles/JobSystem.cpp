@@ -0,0 +1,538 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <malloc.h>
+#include "JobSystem.h"
+#include "AllocProfiler.h"
+
+// jobs per thread ring - a frame uses a few dozen
+static const unsigned int MAX_JOBS = 1024;
+
+// slices per thread in parallelFor(), spare ones are what gets stolen
+static const int SLICES_PER_THREAD = 4;
+
+static thread_local int t_threadIndex = 0;
+
+// ----------------------------------------------------------------------
+// JobDeque
+// ----------------------------------------------------------------------
+
+JobDeque::JobDeque()
+	: top(0),
+	bottom(0)
+{
+	for( int i = 0; i < CAPACITY; i++ )
+	{
+		this->jobs[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+JobDeque::~JobDeque()
+{
+	// nothing to delete
+}
+
+void JobDeque::push(Job *pJob)
+{
+	const int64_t b = this->bottom.load(std::memory_order_relaxed);
+	assert(b - this->top.load(std::memory_order_relaxed) < CAPACITY);
+
+	this->jobs[b & (CAPACITY - 1)].store(pJob, std::memory_order_relaxed);
+	this->bottom.store(b + 1, std::memory_order_release);
+}
+
+Job *JobDeque::pop()
+{
+	const int64_t b = this->bottom.load(std::memory_order_relaxed) - 1;
+	this->bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = this->top.load(std::memory_order_relaxed);
+
+	if( t > b )
+	{
+		// was empty
+		this->bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job *pJob = this->jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if( t != b )
+	{
+		// more than one left, no thief can reach this one
+		return pJob;
+	}
+
+	// last one - race the thieves for it
+	if( !this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed) )
+	{
+		pJob = nullptr;
+	}
+	this->bottom.store(b + 1, std::memory_order_relaxed);
+	return pJob;
+}
+
+Job *JobDeque::steal()
+{
+	int64_t t = this->top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const int64_t b = this->bottom.load(std::memory_order_acquire);
+
+	if( t >= b )
+	{
+		return nullptr;
+	}
+
+	Job *pJob = this->jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if( !this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed) )
+	{
+		// lost to the owner or another thief
+		return nullptr;
+	}
+	return pJob;
+}
+
+bool JobDeque::isEmpty() const
+{
+	return this->top.load(std::memory_order_acquire) >= this->bottom.load(std::memory_order_acquire);
+}
+
+// ----------------------------------------------------------------------
+// JobSystem
+// ----------------------------------------------------------------------
+
+JobSystem::JobSystem(int _numWorkers, int spinBudget, PinMode _pinMode)
+	: poThreads(nullptr),
+	poThreadData(nullptr),
+	numWorkers(_numWorkers > 0 ? _numWorkers : 0),
+	topology(),
+	pinMode(_pinMode),
+	poThreadCore(nullptr),
+	mainAffinity(),
+	mainPinned(false),
+	wakeBarrier(spinBudget),
+	quit(false)
+{
+	const int numThreads = this->getNumThreads();
+
+	this->poThreadData = new ThreadData[(unsigned int)numThreads];
+	for( int i = 0; i < numThreads; i++ )
+	{
+		ThreadData &data = this->poThreadData[i];
+		data.mailbox.store(nullptr, std::memory_order_relaxed);
+		data.pMail = nullptr;
+
+		// on cache lines - new[] only promises 16 bytes before C++17
+		data.poJobs = static_cast<Job *>(_aligned_malloc(sizeof(Job) * MAX_JOBS, alignof(Job)));
+		assert(data.poJobs);
+		for( unsigned int j = 0; j < MAX_JOBS; j++ )
+		{
+			AZUL_PLACEMENT_NEW_BEGIN
+			#undef new
+				::new(&data.poJobs[j]) Job();
+			AZUL_PLACEMENT_NEW_END
+
+			data.poJobs[j].unfinished.store(0, std::memory_order_relaxed);
+		}
+		data.nextJob = 0;
+		data.rng = 0x9E3779B9u * (unsigned int)(i + 1);
+	}
+
+	if( this->numWorkers > 0 )
+	{
+		this->poThreads = new std::thread[(unsigned int)this->numWorkers];
+
+		for( int i = 0; i < this->numWorkers; i++ )
+		{
+			this->poThreads[i] = std::thread(&JobSystem::privWorkerMain, this, i + 1);
+
+			// registered in the thread framework dictionary for the debug output
+			char name[Dictionary::THREAD_NAME_SIZE];
+			sprintf_s(name, Dictionary::THREAD_NAME_SIZE, "--- Worker %d ---", i + 1);
+			Debug::SetName(this->poThreads[i], name);
+		}
+	}
+
+	this->privPin();
+}
+
+JobSystem::~JobSystem()
+{
+	this->quit.store(true, std::memory_order_seq_cst);
+	this->wakeBarrier.release();
+
+	for( int i = 0; i < this->numWorkers; i++ )
+	{
+		this->poThreads[i].join();
+	}
+	delete[] this->poThreads;
+
+	if( this->mainPinned )
+	{
+		Topology::Unpin(GetCurrentThread(), this->mainAffinity);
+	}
+	delete[] this->poThreadCore;
+
+	for( int i = 0; i < this->getNumThreads(); i++ )
+	{
+		// plain data, nothing to destroy
+		_aligned_free(this->poThreadData[i].poJobs);
+	}
+	delete[] this->poThreadData;
+}
+
+int JobSystem::getNumThreads() const
+{
+	return this->numWorkers + 1;
+}
+
+void JobSystem::privPin()
+{
+	const int numThreads = this->getNumThreads();
+
+	this->poThreadCore = new int[(unsigned int)numThreads];
+	for( int i = 0; i < numThreads; i++ )
+	{
+		this->poThreadCore[i] = this->topology.pickCore(i, this->pinMode);
+	}
+
+	if( this->poThreadCore[0] >= 0 )
+	{
+		const CpuCore &core = this->topology.getCore(this->poThreadCore[0]);
+		this->mainPinned = Topology::Pin(GetCurrentThread(), core, &this->mainAffinity);
+		if( !this->mainPinned )
+		{
+			this->poThreadCore[0] = -1;
+		}
+	}
+
+	// a worker may already be running - it moves on its next time slice
+	for( int i = 1; i < numThreads; i++ )
+	{
+		if( this->poThreadCore[i] >= 0 )
+		{
+			const CpuCore &core = this->topology.getCore(this->poThreadCore[i]);
+			if( !Topology::Pin((HANDLE)this->poThreads[i - 1].native_handle(), core, nullptr) )
+			{
+				this->poThreadCore[i] = -1;
+			}
+		}
+	}
+}
+
+bool JobSystem::isPinned() const
+{
+	return this->poThreadCore[0] >= 0;
+}
+
+int JobSystem::getThreadCore(int threadIndex) const
+{
+	assert(threadIndex >= 0 && threadIndex < this->getNumThreads());
+	return this->poThreadCore[threadIndex];
+}
+
+int JobSystem::getThreadNode(int threadIndex) const
+{
+	const int core = this->getThreadCore(threadIndex);
+	return (core >= 0) ? this->topology.getCore(core).node : -1;
+}
+
+const Topology &JobSystem::getTopology() const
+{
+	return this->topology;
+}
+
+void JobSystem::report() const
+{
+	static const char *const MODE_NAMES[] = { "unpinned", "compact", "scatter" };
+
+	this->topology.report();
+	Trace::out("--- JobSystem: %d threads, %s ---\n", this->getNumThreads(), MODE_NAMES[(int)this->pinMode]);
+
+	for( int i = 0; i < this->getNumThreads(); i++ )
+	{
+		const int core = this->poThreadCore[i];
+		if( core < 0 )
+		{
+			Trace::out("  thread %2d: any core\n", i);
+			continue;
+		}
+
+		const CpuCore &info = this->topology.getCore(core);
+		Trace::out("  thread %2d: core %3d  group %d cpu %2d  node %lu\n",
+			i, core, (int)info.group, info.first, (unsigned long)this->topology.getNodeNumber(info.node));
+	}
+}
+
+FrameBarrier &JobSystem::getWakeBarrier()
+{
+	return this->wakeBarrier;
+}
+
+int JobSystem::getNumSlices() const
+{
+	return (this->numWorkers > 0) ? this->getNumThreads() * SLICES_PER_THREAD : 1;
+}
+
+int JobSystem::ThreadIndex()
+{
+	return t_threadIndex;
+}
+
+Job *JobSystem::create(JobFunc func, void *pContext, int begin, int end, int slice, Job *pParent)
+{
+	ThreadData &data = this->poThreadData[t_threadIndex];
+	Job *pJob = &data.poJobs[data.nextJob++ & (MAX_JOBS - 1)];
+
+	// ring wrapped onto a job that is still in flight
+	assert(pJob->unfinished.load(std::memory_order_relaxed) == 0);
+
+	pJob->func = func;
+	pJob->pContext = pContext;
+	pJob->begin = begin;
+	pJob->end = end;
+	pJob->slice = slice;
+	pJob->pParent = pParent;
+	pJob->pScope = AllocProfiler::GetScope();
+	pJob->pNextMail = nullptr;
+	pJob->unfinished.store(1, std::memory_order_relaxed);
+
+	if( pParent != nullptr )
+	{
+		pParent->unfinished.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return pJob;
+}
+
+void JobSystem::run(Job *pJob)
+{
+	this->privPush(pJob);
+	this->privWake();
+}
+
+void JobSystem::wait(Job *pJob)
+{
+	const int index = t_threadIndex;
+
+	// help out instead of blocking
+	while( pJob->unfinished.load(std::memory_order_acquire) > 0 )
+	{
+		Job *pNext = this->privFindJob(index);
+		if( pNext != nullptr )
+		{
+			this->privExecute(pNext);
+		}
+		else
+		{
+			_mm_pause();
+		}
+	}
+}
+
+bool JobSystem::help()
+{
+	Job *pJob = this->privFindJob(t_threadIndex);
+	if( pJob == nullptr )
+	{
+		return false;
+	}
+
+	this->privExecute(pJob);
+	return true;
+}
+
+void JobSystem::parallelFor(int count, JobFunc func, void *pContext)
+{
+	assert(func);
+
+	if( this->numWorkers == 0 )
+	{
+		func(pContext, 0, count, 0);
+		return;
+	}
+
+	const int numSlices = this->getNumSlices();
+
+	// the root only joins, its own count is dropped once every slice is queued
+	Job *pRoot = this->create(nullptr, nullptr, 0, 0, 0, nullptr);
+	for( int s = 0; s < numSlices; s++ )
+	{
+		const int begin = JobSystem::sliceBegin(count, s, numSlices);
+		const int end = JobSystem::sliceBegin(count, s + 1, numSlices);
+		this->privPush(this->create(func, pContext, begin, end, s, pRoot));
+	}
+	this->privWake();
+
+	this->privFinish(pRoot);
+	this->wait(pRoot);
+}
+
+void JobSystem::runOnEachThread(JobFunc func, void *pContext)
+{
+	assert(func);
+
+	const int self = t_threadIndex;
+	const int numThreads = this->getNumThreads();
+
+	Job *pRoot = this->create(nullptr, nullptr, 0, 0, 0, nullptr);
+	for( int t = 0; t < numThreads; t++ )
+	{
+		if( t != self )
+		{
+			// pushed onto whatever other callers already sent that thread
+			Job *pJob = this->create(func, pContext, t, t + 1, t, pRoot);
+			std::atomic<Job *> &mailbox = this->poThreadData[t].mailbox;
+			Job *pHead = mailbox.load(std::memory_order_relaxed);
+			do
+			{
+				pJob->pNextMail = pHead;
+			}
+			while( !mailbox.compare_exchange_weak(pHead, pJob, std::memory_order_release, std::memory_order_relaxed) );
+		}
+	}
+	this->privWake();
+
+	func(pContext, self, self + 1, self);
+
+	this->privFinish(pRoot);
+	this->wait(pRoot);
+}
+
+void JobSystem::privPush(Job *pJob)
+{
+	this->poThreadData[t_threadIndex].deque.push(pJob);
+}
+
+void JobSystem::privWake()
+{
+	// pairs with arm() then privHasWork() in privWorkerMain()
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if( this->wakeBarrier.hasWaiters() )
+	{
+		this->wakeBarrier.release();
+	}
+}
+
+Job *JobSystem::privFindJob(int index)
+{
+	ThreadData &data = this->poThreadData[index];
+
+	// own mail first - the whole mailbox is taken at once, then run one by one
+	if( (data.pMail == nullptr) && (data.mailbox.load(std::memory_order_relaxed) != nullptr) )
+	{
+		data.pMail = data.mailbox.exchange(nullptr, std::memory_order_acquire);
+	}
+
+	if( data.pMail != nullptr )
+	{
+		Job *pMail = data.pMail;
+		data.pMail = pMail->pNextMail;
+		return pMail;
+	}
+
+	Job *pJob = data.deque.pop();
+	if( pJob != nullptr )
+	{
+		return pJob;
+	}
+
+	// one round over the others, starting at a random victim
+	const int numThreads = this->getNumThreads();
+	data.rng ^= data.rng << 13;
+	data.rng ^= data.rng >> 17;
+	data.rng ^= data.rng << 5;
+	const int first = (int)(data.rng % (unsigned int)numThreads);
+
+	for( int i = 0; i < numThreads; i++ )
+	{
+		const int victim = (first + i) % numThreads;
+		if( victim == index )
+		{
+			continue;
+		}
+
+		pJob = this->poThreadData[victim].deque.steal();
+		if( pJob != nullptr )
+		{
+			return pJob;
+		}
+	}
+
+	return nullptr;
+}
+
+void JobSystem::privExecute(Job *pJob)
+{
+	if( pJob->func != nullptr )
+	{
+		AllocScope scope(pJob->pScope);
+		pJob->func(pJob->pContext, pJob->begin, pJob->end, pJob->slice);
+	}
+	this->privFinish(pJob);
+}
+
+void JobSystem::privFinish(Job *pJob)
+{
+	// read the parent first - the job slot can be reused once it hits zero
+	Job *pParent = pJob->pParent;
+
+	if( pJob->unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+	{
+		if( pParent != nullptr )
+		{
+			this->privFinish(pParent);
+		}
+	}
+}
+
+bool JobSystem::privHasWork(int index) const
+{
+	// own mail - only the owner asks
+	const ThreadData &data = this->poThreadData[index];
+	if( (data.pMail != nullptr) || (data.mailbox.load(std::memory_order_relaxed) != nullptr) )
+	{
+		return true;
+	}
+
+	for( int i = 0; i < this->getNumThreads(); i++ )
+	{
+		if( !this->poThreadData[i].deque.isEmpty() )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::privWorkerMain(int index)
+{
+	t_threadIndex = index;
+
+	while( true )
+	{
+		Job *pJob = this->privFindJob(index);
+		if( pJob != nullptr )
+		{
+			this->privExecute(pJob);
+			continue;
+		}
+
+		if( this->quit.load(std::memory_order_acquire) )
+		{
+			break;
+		}
+
+		// park - anything queued after arm() releases the barrier
+		const unsigned int ticket = this->wakeBarrier.arm();
+		if( this->privHasWork(index) || this->quit.load(std::memory_order_acquire) )
+		{
+			this->wakeBarrier.disarm();
+			continue;
+		}
+		this->wakeBarrier.wait(ticket);
+	}
+}
+
+// --- End of File ---
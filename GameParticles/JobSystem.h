@@ -0,0 +1,206 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <stdint.h>
+#include <thread>
+#include <atomic>
+#include "FrameBarrier.h"
+#include "Topology.h"
+
+struct Job;
+
+typedef void (*JobFunc)(void *pContext, int begin, int end, int slice);
+
+struct JobData
+{
+	JobFunc		func;			// nullptr: pure join point
+	void		*pContext;
+	int			begin;
+	int			end;
+	int			slice;
+	std::atomic<int>	unfinished;	// itself + children still running
+	Job			*pParent;
+	const char	*pScope;		// AllocProfiler scope of the creating thread
+	Job			*pNextMail;		// runOnEachThread() job queued behind this one
+};
+
+// one cache line, so siblings finishing at once - or neighbours in a ring
+// run by different workers - don't fight over it (the rings are aligned)
+struct alignas(64) Job : public JobData
+{
+	char pad[64 - sizeof(JobData)];
+};
+static_assert(sizeof(Job) == 64, "a Job is one cache line");
+
+// Chase-Lev deque - the owner pushes and pops at the bottom (LIFO, warm
+// cache), thieves take from the top (FIFO, biggest leftovers first).
+// Fixed capacity, jobs are recycled long before it could wrap.
+class JobDeque
+{
+public:
+	static const int CAPACITY = 4096;
+
+	JobDeque();
+	JobDeque(const JobDeque &) = delete;
+	JobDeque &operator = (const JobDeque &) = delete;
+	~JobDeque();
+
+	void push(Job *pJob);		// owner only
+	Job *pop();					// owner only
+	Job *steal();				// any thread
+	bool isEmpty() const;
+
+private:
+	std::atomic<int64_t>	top;
+	char					padTop[64 - sizeof(std::atomic<int64_t>)];
+	std::atomic<int64_t>	bottom;
+	char					padBottom[64 - sizeof(std::atomic<int64_t>)];
+	std::atomic<Job *>		jobs[CAPACITY];
+};
+
+// Work stealing job system
+//
+//     One deque per thread, the main thread is thread 0 and takes part:
+//     wait() keeps running (its own, then stolen) jobs until the job it
+//     waits on is done, so nested waits never block a worker.
+//
+//     A job counts itself plus every child created with it as parent, and
+//     finishing the last one finishes the parent - a single wait() on the
+//     root joins a whole tree.
+//
+//     Jobs come from a per thread ring, no allocation after construction.
+//     Idle workers park on a spin-then-futex FrameBarrier, queuing work
+//     releases it only when somebody is parked.
+//
+//     With a PinMode every thread (main included) is pinned to its own core,
+//     runOnEachThread() then reaches a known core and NUMA node - that is how
+//     per thread data gets first touched and later updated by its owner.
+class JobSystem
+{
+public:
+	// numWorkers: extra threads besides the main thread (0 = run everything inline)
+	// spinBudget: pauses an idle worker spins before it sleeps in the kernel
+	// pinMode: thread placement, the main thread gets its affinity back on destruction
+	JobSystem(int numWorkers, int spinBudget, PinMode pinMode = PinMode::None);
+	JobSystem() = delete;
+	JobSystem(const JobSystem &) = delete;
+	JobSystem &operator = (const JobSystem &) = delete;
+	~JobSystem();
+
+	int getNumThreads() const;
+
+	// placement, -1 core / node when the thread is not pinned
+	bool isPinned() const;
+	int getThreadCore(int threadIndex) const;
+	int getThreadNode(int threadIndex) const;
+	const Topology &getTopology() const;
+
+	// thread -> core -> node mapping
+	void report() const;
+
+	// wake up latency of the idle workers, see FrameBarrier
+	FrameBarrier &getWakeBarrier();
+
+	// parallelFor() always cuts the range in this many slices, so a pass can
+	// keep per slice data (histograms, partial sums) between two calls
+	int getNumSlices() const;
+
+	Job *create(JobFunc func, void *pContext, int begin, int end, int slice, Job *pParent);
+	void run(Job *pJob);
+	void wait(Job *pJob);
+
+	// runs one queued job on the calling thread, false if there was none
+	bool help();
+
+	// splits [0, count) into getNumSlices() jobs and waits for all of them
+	void parallelFor(int count, JobFunc func, void *pContext);
+
+	// f(begin, end, slice)
+	template <typename F>
+	void parallelFor(int count, F &f)
+	{
+		this->parallelFor(count, &JobSystem::privTrampoline<F>, &f);
+	}
+
+	// one call on every thread, begin = slice = thread index - never stolen
+	//     calls may overlap or nest (a stage waiting on one can pick up a
+	//     stage that makes another), every thread queues the jobs it is sent
+	void runOnEachThread(JobFunc func, void *pContext);
+
+	template <typename F>
+	void runOnEachThread(F &f)
+	{
+		this->runOnEachThread(&JobSystem::privTrampoline<F>, &f);
+	}
+
+	static int sliceBegin(int count, int slice, int numSlices)
+	{
+		return (int)(((long long)count * slice) / numSlices);
+	}
+
+	// calling thread: 0 for the main thread, 1..N for the workers
+	static int ThreadIndex();
+
+private:
+	template <typename F>
+	static void privTrampoline(void *pContext, int begin, int end, int slice)
+	{
+		(*static_cast<F *>(pContext))(begin, end, slice);
+	}
+
+	struct ThreadData
+	{
+		JobDeque		deque;
+		std::atomic<Job *>	mailbox;	// runOnEachThread() jobs sent to this thread, newest first
+		Job				*pMail;			// taken from mailbox, only the owner reads it
+		Job				*poJobs;		// ring of MAX_JOBS
+		unsigned int	nextJob;
+		unsigned int	rng;			// victim selection
+	};
+
+	void privWorkerMain(int index);
+	Job *privFindJob(int index);
+	void privExecute(Job *pJob);
+	void privFinish(Job *pJob);
+	void privPush(Job *pJob);
+	void privWake();
+	bool privHasWork(int index) const;
+	void privPin();
+
+	std::thread		*poThreads;
+	ThreadData		*poThreadData;
+	int				numWorkers;
+
+	// placement
+	Topology		topology;
+	PinMode			pinMode;
+	int				*poThreadCore;		// per thread, -1: not pinned
+	GROUP_AFFINITY	mainAffinity;		// restored on destruction
+	bool			mainPinned;
+
+	// idle workers
+	FrameBarrier			wakeBarrier;
+	std::atomic<bool>		quit;
+};
+
+// parallelFor() that also takes no job system (runs inline as slice 0)
+template <typename F>
+inline void RunSlices(JobSystem *pJobs, int count, F &f)
+{
+	if( pJobs != nullptr )
+	{
+		pJobs->parallelFor(count, f);
+	}
+	else
+	{
+		f(0, count, 0);
+	}
+}
+
+#endif
+
+// --- End of File ---
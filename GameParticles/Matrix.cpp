@@ -5,6 +5,8 @@
 #include <Math.h>
 #include "Vect4d.h"
 #include "Matrix.h"
+#include "Affine34.h"
+
 
 Matrix::Matrix()
 {	
@@ -12,6 +14,8 @@ Matrix::Matrix()
 	this->v1._m = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
 	this->v2._m = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
 	this->v3._m = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
+
+	this->structure = ZERO_W | DIAGONAL;
 }
 
 Matrix::Matrix(const Matrix& t)
@@ -20,6 +24,18 @@ Matrix::Matrix(const Matrix& t)
 	this->v1._m = t.v1._m;
 	this->v2._m = t.v2._m;
 	this->v3._m = t.v3._m;
+
+	this->structure = t.structure;
+}
+
+Matrix::Matrix(const Vect4D &row0, const Vect4D &row1, const Vect4D &row2, const Vect4D &row3)
+{
+	this->v0._m = row0._m;
+	this->v1._m = row1._m;
+	this->v2._m = row2._m;
+	this->v3._m = row3._m;
+
+	this->structure = this->privClassifyW();
 }
 
 Matrix::~Matrix()
@@ -27,12 +43,34 @@ Matrix::~Matrix()
 	
 }
 
+unsigned int Matrix::privClassifyW() const
+{
+	if( this->m3 != 0.0f || this->m7 != 0.0f || this->m11 != 0.0f )
+	{
+		return GENERAL;
+	}
+
+	if( this->m15 == 1.0f )
+	{
+		return AFFINE;
+	}
+
+	return (this->m15 == 0.0f) ? ZERO_W : GENERAL;
+}
+
+unsigned int Matrix::getStructure() const
+{
+	return this->structure;
+}
+
 void Matrix::setDefault()
 {
 	this->v0._m = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
 	this->v1._m = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
 	this->v2._m = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
 	this->v3._m = _mm_set_ps(0.0, 0.0, 0.0, 0.0);
+
+	this->structure = ZERO_W | DIAGONAL;
 }
 
 void Matrix::setIdentMatrix()
@@ -44,6 +82,8 @@ void Matrix::setIdentMatrix()
 	this->v2._m = _mm_set_ps(0.0, 1.0, 0.0, 0.0);
 	
 	this->v3._m = _mm_set_ps(1.0, 0.0, 0.0, 0.0);
+
+	this->structure = AFFINE | DIAGONAL | TRANSLATION | ROT_Z;
 }
 
 void Matrix::setTransMatrix(Vect4D &t)
@@ -55,6 +95,8 @@ void Matrix::setTransMatrix(Vect4D &t)
 	this->v2._m = _mm_set_ps(0.0, 1.0, 0.0, 0.0);
 	
 	this->v3._m = _mm_set_ps(1.0, t.z, t.y, t.x);
+
+	this->structure = AFFINE | TRANSLATION;
 }
 
 void Matrix::set( MatrixRow row, Vect4D &t )
@@ -81,10 +123,15 @@ void Matrix::set( MatrixRow row, Vect4D &t )
 		// should never get here, if we are here something bad has happened
 		assert(0);
 	}
+
+	this->structure = this->privClassifyW();
 }
 
 float &Matrix::operator[](Index e)
 {
+	// the caller may write through it
+	this->structure = GENERAL;
+
 	// get the individual elements
 	switch(e)
 	{
@@ -170,91 +217,115 @@ void Matrix::get( MatrixRow row, Vect4D &t ) const
 
 
 
-Matrix& Matrix::operator*=( const Matrix& rhs) // Check if (w remains 1)
+Matrix& Matrix::operator*=( const Matrix& rhs)
 { 
-	//Matrix tmp;
+	// Multiply() reads b all along - m *= m multiplies by a copy
+	if( &rhs == this )
+	{
+		const Matrix copy(rhs);
+		Matrix::Multiply(*this, copy, *this);
+	}
+	else
+	{
+		Matrix::Multiply(*this, rhs, *this);
+	}
 
-	// ROW 0 //
+	return *this;
+}
 
-	__m128 _x = _mm_set_ps1(this->v0.x);	// (x0, x0, x0, x0)
-	__m128 _y = _mm_set_ps1(this->v0.y);	// (y0, y0, y0, y0)
-	__m128 _z = _mm_set_ps1(this->v0.z);	// (z0, z0, z0, z0)
-	__m128 _w = _mm_set_ps1(this->v0.w);	// (w0, w0, w0, w0)
-	
-	_x = _mm_mul_ps(rhs.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-	_y = _mm_mul_ps(rhs.v1._m, _y);
-	_x = _mm_add_ps(_x, _y);
-	
-	_z = _mm_mul_ps(rhs.v2._m, _z);
-	_y = _mm_mul_ps(rhs.v3._m, _w);
-	_y = _mm_add_ps(_z, _y);
-	
-	_z = _mm_add_ps(_x, _y);
-	
-	this->v0._m = _z;
-	
-	
-	// ROW 1 //
-	
-	_x = _mm_set_ps1(this->v1.x);
-	_y = _mm_set_ps1(this->v1.y);
-	_z = _mm_set_ps1(this->v1.z);
-	_w = _mm_set_ps1(this->v1.w);
-	
-	_x = _mm_mul_ps(rhs.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-	_y = _mm_mul_ps(rhs.v1._m, _y);
-	_x = _mm_add_ps(_x, _y);
-	
-	_z = _mm_mul_ps(rhs.v2._m, _z);
-	_y = _mm_mul_ps(rhs.v3._m, _w);
-	_y = _mm_add_ps(_z, _y);
-	
-	_z = _mm_add_ps(_x, _y);
-	
-	this->v1._m = _z;
-	
-	
-	// ROW 2 //
-	
-	_x = _mm_set_ps1(this->v2.x);
-	_y = _mm_set_ps1(this->v2.y);
-	_z = _mm_set_ps1(this->v2.z);
-	_w = _mm_set_ps1(this->v2.w);
-	
-	_x = _mm_mul_ps(rhs.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-	_y = _mm_mul_ps(rhs.v1._m, _y);
-	_x = _mm_add_ps(_x, _y);
-	
-	_z = _mm_mul_ps(rhs.v2._m, _z);
-	_y = _mm_mul_ps(rhs.v3._m, _w);
-	_y = _mm_add_ps(_z, _y);
-	
-	_z = _mm_add_ps(_x, _y);
-	
-	this->v2._m = _z;
-	
-	
-	// ROW 3 //
-	
-	_x = _mm_set_ps1(this->v3.x);
-	_y = _mm_set_ps1(this->v3.y);
-	_z = _mm_set_ps1(this->v3.z);
-	_w = _mm_set_ps1(this->v3.w);
-	
-	_x = _mm_mul_ps(rhs.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-	_y = _mm_mul_ps(rhs.v1._m, _y);
-	_x = _mm_add_ps(_x, _y);
-	
-	_z = _mm_mul_ps(rhs.v2._m, _z);
-	_y = _mm_mul_ps(rhs.v3._m, _w);
-	_y = _mm_add_ps(_z, _y);
-	
-	_z = _mm_add_ps(_x, _y);
-	
-	this->v3._m = _z;
-	
+unsigned int Matrix::ProductStructure(const unsigned int a, const unsigned int b)
+{
+	// the last column of a * b is a times b's last column
+	unsigned int w = GENERAL;
+	if( b & ZERO_W )
+	{
+		w = ZERO_W;
+	}
+	else if( b & AFFINE )
+	{
+		w = a & (AFFINE | ZERO_W);
+	}
 
-	return *this;
+	return w | (a & b & (DIAGONAL | TRANSLATION | ROT_Z));
+}
+
+void Matrix::Multiply(const Matrix &a, const Matrix &b, Matrix &out)
+{
+	// a's rows are read before out's are written, b's are read all along
+	assert(&out != &b);
+
+	const unsigned int result = ProductStructure(a.structure, b.structure);
+
+	if( a.structure & DIAGONAL )
+	{
+		// row i is b's row i, scaled
+		out.v0._m = _mm_mul_ps(b.v0._m, _mm_set_ps1(a.m0));
+		out.v1._m = _mm_mul_ps(b.v1._m, _mm_set_ps1(a.m5));
+		out.v2._m = _mm_mul_ps(b.v2._m, _mm_set_ps1(a.m10));
+		out.v3._m = _mm_mul_ps(b.v3._m, _mm_set_ps1(a.m15));
+	}
+	else if( a.structure & TRANSLATION )
+	{
+		// rows 0-2 are b's, row 3 is the translation taken through b
+		__m128 _x = _mm_mul_ps(b.v0._m, _mm_set_ps1(a.m12));
+		__m128 _y = _mm_mul_ps(b.v1._m, _mm_set_ps1(a.m13));
+		_x = _mm_add_ps(_x, _y);
+
+		__m128 _z = _mm_mul_ps(b.v2._m, _mm_set_ps1(a.m14));
+		_y = _mm_add_ps(_z, b.v3._m);
+
+		out.v3._m = _mm_add_ps(_x, _y);
+		out.v0._m = b.v0._m;
+		out.v1._m = b.v1._m;
+		out.v2._m = b.v2._m;
+	}
+	else if( a.structure & b.structure & AFFINE )
+	{
+		// w is 0 in rows 0-2 and 1 in row 3 - 12 multiplies instead of 16
+		const Vect4D *pRowA[4] = { &a.v0, &a.v1, &a.v2, &a.v3 };
+		Vect4D *pRowOut[4] = { &out.v0, &out.v1, &out.v2, &out.v3 };
+
+		for( int i = 0; i < 4; i++ )
+		{
+			const Vect4D &row = *pRowA[i];
+
+			__m128 _x = _mm_mul_ps(b.v0._m, _mm_set_ps1(row.x));
+			__m128 _y = _mm_mul_ps(b.v1._m, _mm_set_ps1(row.y));
+			_x = _mm_add_ps(_x, _y);
+
+			__m128 _z = _mm_mul_ps(b.v2._m, _mm_set_ps1(row.z));
+			_z = (i == 3) ? _mm_add_ps(_z, b.v3._m) : _z;
+
+			pRowOut[i]->_m = _mm_add_ps(_x, _z);
+		}
+	}
+	else
+	{
+		const Vect4D *pRowA[4] = { &a.v0, &a.v1, &a.v2, &a.v3 };
+		Vect4D *pRowOut[4] = { &out.v0, &out.v1, &out.v2, &out.v3 };
+
+		for( int i = 0; i < 4; i++ )
+		{
+			const Vect4D &row = *pRowA[i];
+
+			__m128 _x = _mm_set_ps1(row.x);		// (x, x, x, x)
+			__m128 _y = _mm_set_ps1(row.y);		// (y, y, y, y)
+			__m128 _z = _mm_set_ps1(row.z);		// (z, z, z, z)
+			__m128 _w = _mm_set_ps1(row.w);		// (w, w, w, w)
+
+			_x = _mm_mul_ps(b.v0._m, _x);			// (m0, m1, m2, m3) (x, x, x, x) == (xm0, xm1, xm2, xm3)
+			_y = _mm_mul_ps(b.v1._m, _y);
+			_x = _mm_add_ps(_x, _y);
+
+			_z = _mm_mul_ps(b.v2._m, _z);
+			_y = _mm_mul_ps(b.v3._m, _w);
+			_y = _mm_add_ps(_z, _y);
+
+			pRowOut[i]->_m = _mm_add_ps(_x, _y);
+		}
+	}
+
+	out.structure = result;
 }
 
 Matrix& Matrix::operator/=(const float rhs)
@@ -270,12 +341,44 @@ Matrix& Matrix::operator/=(const float rhs)
 	this->v2._m = _mm_mul_ps(this->v2._m, div);
 	this->v3._m = _mm_mul_ps(this->v3._m, div);
 
+	// scaling keeps the zeros, not the ones
+	this->structure &= (DIAGONAL | ZERO_W);
+
 
 	return *this;
 }
 
 float Matrix::Determinant() const
 {
+	if( this->structure & ZERO_W )
+	{
+		// a zero column
+		return 0.0f;
+	}
+
+	if( this->structure & DIAGONAL )
+	{
+		return this->m0 * this->m5 * this->m10 * this->m15;
+	}
+
+	if( this->structure & TRANSLATION )
+	{
+		return 1.0f;
+	}
+
+	if( this->structure & ROT_Z )
+	{
+		return (this->m0 * this->m5) - (this->m1 * this->m4);
+	}
+
+	if( this->structure & AFFINE )
+	{
+		// m15 is the only non zero entry of the last column
+		return (this->m0 * ((this->m5 * this->m10) - (this->m6 * this->m9)))
+			- (this->m1 * ((this->m4 * this->m10) - (this->m6 * this->m8)))
+			+ (this->m2 * ((this->m4 * this->m9) - (this->m5 * this->m8)));
+	}
+
 	// Can improve with RVO (will look messy though)
 
 	float ta = (m10 * m15) - (m11 * m14);
@@ -391,12 +494,115 @@ Matrix Matrix::GetAdjugate() const
 	// unload	HN		(3)		Q-I-O
 	// q = a(ti) - b(to) + c(tq)
 	tmp.m15 = (m0*t3) - (m1*t5) + (m2*t1);				// m15	3
+
+	// written element by element, nothing known
+	tmp.structure = GENERAL;
 	
 	return tmp;
 }
 
+void Matrix::privInverseCramer( Matrix &out ) const
+{
+	// Cramer's rule on the columns (Intel AP-928): every step makes the
+	// products for four cofactors at once. Columns 1 and 3 go in with their
+	// halves swapped so the shuffles line the pairs up.
+	__m128 col0 = this->v0._m;
+	__m128 col1 = this->v1._m;
+	__m128 col2 = this->v2._m;
+	__m128 col3 = this->v3._m;
+	_MM_TRANSPOSE4_PS(col0, col1, col2, col3);
+
+	col1 = _mm_shuffle_ps(col1, col1, 0x4E);
+	col3 = _mm_shuffle_ps(col3, col3, 0x4E);
+
+	__m128 minor0;
+	__m128 minor1;
+	__m128 minor2;
+	__m128 minor3;
+	__m128 t;
+
+	t = _mm_mul_ps(col2, col3);
+	t = _mm_shuffle_ps(t, t, 0xB1);
+	minor0 = _mm_mul_ps(col1, t);
+	minor1 = _mm_mul_ps(col0, t);
+	t = _mm_shuffle_ps(t, t, 0x4E);
+	minor0 = _mm_sub_ps(_mm_mul_ps(col1, t), minor0);
+	minor1 = _mm_sub_ps(_mm_mul_ps(col0, t), minor1);
+	minor1 = _mm_shuffle_ps(minor1, minor1, 0x4E);
+
+	t = _mm_mul_ps(col1, col2);
+	t = _mm_shuffle_ps(t, t, 0xB1);
+	minor0 = _mm_add_ps(_mm_mul_ps(col3, t), minor0);
+	minor3 = _mm_mul_ps(col0, t);
+	t = _mm_shuffle_ps(t, t, 0x4E);
+	minor0 = _mm_sub_ps(minor0, _mm_mul_ps(col3, t));
+	minor3 = _mm_sub_ps(_mm_mul_ps(col0, t), minor3);
+	minor3 = _mm_shuffle_ps(minor3, minor3, 0x4E);
+
+	t = _mm_mul_ps(_mm_shuffle_ps(col1, col1, 0x4E), col3);
+	t = _mm_shuffle_ps(t, t, 0xB1);
+	col2 = _mm_shuffle_ps(col2, col2, 0x4E);
+	minor0 = _mm_add_ps(_mm_mul_ps(col2, t), minor0);
+	minor2 = _mm_mul_ps(col0, t);
+	t = _mm_shuffle_ps(t, t, 0x4E);
+	minor0 = _mm_sub_ps(minor0, _mm_mul_ps(col2, t));
+	minor2 = _mm_sub_ps(_mm_mul_ps(col0, t), minor2);
+	minor2 = _mm_shuffle_ps(minor2, minor2, 0x4E);
+
+	t = _mm_mul_ps(col0, col1);
+	t = _mm_shuffle_ps(t, t, 0xB1);
+	minor2 = _mm_add_ps(_mm_mul_ps(col3, t), minor2);
+	minor3 = _mm_sub_ps(_mm_mul_ps(col2, t), minor3);
+	t = _mm_shuffle_ps(t, t, 0x4E);
+	minor2 = _mm_sub_ps(_mm_mul_ps(col3, t), minor2);
+	minor3 = _mm_sub_ps(minor3, _mm_mul_ps(col2, t));
+
+	t = _mm_mul_ps(col0, col3);
+	t = _mm_shuffle_ps(t, t, 0xB1);
+	minor1 = _mm_sub_ps(minor1, _mm_mul_ps(col2, t));
+	minor2 = _mm_add_ps(_mm_mul_ps(col1, t), minor2);
+	t = _mm_shuffle_ps(t, t, 0x4E);
+	minor1 = _mm_add_ps(_mm_mul_ps(col2, t), minor1);
+	minor2 = _mm_sub_ps(minor2, _mm_mul_ps(col1, t));
+
+	t = _mm_mul_ps(col0, col2);
+	t = _mm_shuffle_ps(t, t, 0xB1);
+	minor1 = _mm_add_ps(_mm_mul_ps(col3, t), minor1);
+	minor3 = _mm_sub_ps(minor3, _mm_mul_ps(col1, t));
+	t = _mm_shuffle_ps(t, t, 0x4E);
+	minor1 = _mm_sub_ps(minor1, _mm_mul_ps(col3, t));
+	minor3 = _mm_add_ps(_mm_mul_ps(col1, t), minor3);
+
+	// minor0 are the cofactors of column 0, dot them for the determinant
+	__m128 det = _mm_mul_ps(col0, minor0);
+	det = _mm_add_ps(_mm_shuffle_ps(det, det, 0x4E), det);
+	det = _mm_add_ss(_mm_shuffle_ps(det, det, 0xB1), det);
+
+	const float d = _mm_cvtss_f32(det);
+	if( fabs(d) < 0.0001 )
+	{
+		// not invertible
+		out.setDefault();
+		return;
+	}
+
+	const __m128 invDet = _mm_set_ps1(1.0f / d);
+	out.v0._m = _mm_mul_ps(minor0, invDet);
+	out.v1._m = _mm_mul_ps(minor1, invDet);
+	out.v2._m = _mm_mul_ps(minor2, invDet);
+	out.v3._m = _mm_mul_ps(minor3, invDet);
+	out.structure = out.privClassifyW();
+}
+
 void Matrix::Inverse( Matrix &out ) const 
 {
+	if( this->structure == GENERAL )
+	{
+		// nothing to shortcut, SSE Cramer's rule - determinant on the way
+		this->privInverseCramer(out);
+		return;
+	}
+
 	Matrix tmp;
 	float det = Determinant();
 	if(fabs(det) < 0.0001)
@@ -404,10 +610,35 @@ void Matrix::Inverse( Matrix &out ) const
 		// do nothing, Matrix is not invertable
 		//tmp.setDefault();
 	}
+	else if( this->structure & DIAGONAL )
+	{
+		tmp.v0._m = _mm_set_ps(0.0, 0.0, 0.0, 1.0f / this->m0);
+		tmp.v1._m = _mm_set_ps(0.0, 0.0, 1.0f / this->m5, 0.0);
+		tmp.v2._m = _mm_set_ps(0.0, 1.0f / this->m10, 0.0, 0.0);
+		tmp.v3._m = _mm_set_ps(1.0f / this->m15, 0.0, 0.0, 0.0);
+		tmp.structure = this->structure & (AFFINE | DIAGONAL | TRANSLATION | ROT_Z);
+	}
+	else if( this->structure & TRANSLATION )
+	{
+		Vect4D t(-this->m12, -this->m13, -this->m14);
+		tmp.setTransMatrix(t);
+	}
+	else if( this->structure & ROT_Z )
+	{
+		// orthonormal - the transpose
+		tmp.v0._m = _mm_set_ps(0.0, 0.0, this->m4, this->m0);
+		tmp.v1._m = _mm_set_ps(0.0, 0.0, this->m5, this->m1);
+		tmp.v2._m = _mm_set_ps(0.0, 1.0, 0.0, 0.0);
+		tmp.v3._m = _mm_set_ps(1.0, 0.0, 0.0, 0.0);
+		tmp.structure = AFFINE | ROT_Z;
+	}
 	else
 	{
-		tmp = GetAdjugate();
-		tmp /= det;
+		// AFFINE - every other flag is handled above (ZERO_W has det 0)
+		// 3x3 inverse and a translation
+		Affine34 inverse;
+		Affine34(*this).Inverse(inverse);
+		inverse.toMatrix(tmp);
 	}
 
 	out = tmp;
@@ -429,6 +660,8 @@ void Matrix::setScaleMatrix(Vect4D &scale)
 	this->v2._m = _mm_set_ps(0, scale.z, 0, 0);
 	
 	this->v3._m = _mm_set_ps(1.0, 0, 0, 0);
+
+	this->structure = AFFINE | DIAGONAL;
 }
 
 void Matrix::setRotZMatrix(float az)
@@ -445,6 +678,8 @@ void Matrix::setRotZMatrix(float az)
 	this->v2._m = _mm_set_ps(0, 1.0, 0, 0);
 	
 	this->v3._m = _mm_set_ps(1.0, 0, 0, 0);
+
+	this->structure = AFFINE | ROT_Z;
 }
 
 
@@ -26,8 +26,23 @@ public:
 		MATRIX_ROW_3
 	};
 
+	// What is known about the layout, bit flags kept up by the setters and
+	// the products. Determinant(), Inverse() and Multiply() take closed forms
+	// on them - e.g. the diff of two affine matrices (Particle::Update) has
+	// a zero last column, so its determinant is 0 without computing it.
+	enum Structure : unsigned int
+	{
+		GENERAL		= 0x00,
+		AFFINE		= 0x01,		// last column 0 0 0 1
+		ZERO_W		= 0x02,		// last column 0 0 0 0
+		DIAGONAL	= 0x04,		// nothing off the diagonal
+		TRANSLATION	= 0x08,		// affine, identity 3x3
+		ROT_Z		= 0x10		// affine, rotation about z, no translation
+	};
+
 	Matrix();	
 	Matrix( const Matrix& t );	
+	Matrix( const Vect4D &row0, const Vect4D &row1, const Vect4D &row2, const Vect4D &row3 );
 	Matrix& operator = (const Matrix& t) = default;
 	~Matrix();
 
@@ -52,8 +67,22 @@ public:
 	
 	void Inverse( Matrix &out ) const;
 
+	unsigned int getStructure() const;
+
+	// out = a * b with the cheapest path the flags allow, out may be a (not b)
+	static void Multiply( const Matrix &a, const Matrix &b, Matrix &out );
+
+	// structure of a * b from the structures of a and b
+	static unsigned int ProductStructure( const unsigned int a, const unsigned int b );
+
 	
 private:
+
+	// structure from the values of the last column, the rest is unknown
+	unsigned int privClassifyW() const;
+
+	// general 4x4 inverse, all zero when not invertible
+	void privInverseCramer( Matrix &out ) const;
 	
 	union
 	{
@@ -94,923 +123,215 @@ private:
 		};
 	};
 
-	friend struct MxM;
-	friend struct MxM3;
-	friend struct MxM4;
-	friend struct MxM5;
+	unsigned int structure;
+
+	friend class Affine34;
+	friend class SoATranspose;
+	friend struct MatRef;
+	template <typename L, typename R> friend struct MatProduct;
 };
 
-struct MxM
+// Lazy matrix arithmetic
+//
+//     A * B * C ... builds a tree of MatProduct nodes, nothing is multiplied
+//     until the tree is converted to a Matrix. Then each row of the result
+//     is the row of A pushed through B, C, ... in turn - one row vector in a
+//     register for the whole chain, no intermediate matrices, any length.
+//     The adds and multiplies are the ones a product at a time would do, in
+//     the same order, so the bits are too.
+//
+//     When every matrix in the chain is affine the w terms are known (0 in
+//     rows 0-2, 1 in row 3) and left out, 12 multiplies a step instead of 16.
+//
+//     v * A * B (VecMat) pushes a vector through the same way. It is a
+//     VecNode, so it mixes with the Vect4D expressions.
+//
+//     Same rule as the vector nodes: leaves hold references, evaluate in the
+//     statement that builds the tree.
+struct MatNode
 {
-	const Matrix& m1;
-	const Matrix& m2;
-
-	MxM(const Matrix& t1, const Matrix& t2)
-		:m1(t1), m2(t2) {};
-
-	operator Matrix()
-	{
-		Matrix tmp;
-
-		// ROW 0 //
-
-		__m128 _x = _mm_set_ps1(m1.v0.x);		// (x0, x0, x0, x0)
-		__m128 _y = _mm_set_ps1(m1.v0.y);		// (y0, y0, y0, y0)
-		__m128 _z = _mm_set_ps1(m1.v0.z);		// (z0, z0, z0, z0)
-		__m128 _w = _mm_set_ps1(m1.v0.w);		// (w0, w0, w0, w0)
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v0._m = _z;
-
-
-		// ROW 1 //
-
-		_x = _mm_set_ps1(m1.v1.x);
-		_y = _mm_set_ps1(m1.v1.y);
-		_z = _mm_set_ps1(m1.v1.z);
-		_w = _mm_set_ps1(m1.v1.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v1._m = _z;
-
-
-		// ROW 2 //
-
-		_x = _mm_set_ps1(m1.v2.x);
-		_y = _mm_set_ps1(m1.v2.y);
-		_z = _mm_set_ps1(m1.v2.z);
-		_w = _mm_set_ps1(m1.v2.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v2._m = _z;
-
-
-		// ROW 3 //
-
-		_x = _mm_set_ps1(m1.v3.x);
-		_y = _mm_set_ps1(m1.v3.y);
-		_z = _mm_set_ps1(m1.v3.z);
-		_w = _mm_set_ps1(m1.v3.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v3._m = _z;
-
-
-		return tmp;
-	}
-
 };
 
-struct MxM3
+// what a row holds in w, all affine chains only
+enum class MatRowKind
 {
-	const Matrix& m1;
-	const Matrix& m2;
-	const Matrix& m3;
+	General,
+	AffineLinear,		// rows 0-2: w is 0
+	AffineTranslation	// row 3: w is 1
+};
 
-	MxM3(const MxM& t1, const Matrix& t2)
-		:m1(t1.m1), m2(t1.m2), m3(t2) {};
+// a Matrix as a leaf
+struct MatRef : public MatNode
+{
+	const Matrix &m;
 
-	operator Matrix()
+	explicit MatRef(const Matrix &t)
+		: m(t)
 	{
-		Matrix tmp;
-
-		// (Matrix) * (Matrix) // ===============================================//
-
-		// ROW 0 //
-
-		__m128 _x = _mm_set_ps1(m1.v0.x);	
-		__m128 _y = _mm_set_ps1(m1.v0.y);	
-		__m128 _z = _mm_set_ps1(m1.v0.z);	
-		__m128 _w = _mm_set_ps1(m1.v0.w);	
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v0._m = _z;
-
-
-		// ROW 1 //
-
-		_x = _mm_set_ps1(m1.v1.x);
-		_y = _mm_set_ps1(m1.v1.y);
-		_z = _mm_set_ps1(m1.v1.z);
-		_w = _mm_set_ps1(m1.v1.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v1._m = _z;
-
-
-		// ROW 2 //
-
-		_x = _mm_set_ps1(m1.v2.x);
-		_y = _mm_set_ps1(m1.v2.y);
-		_z = _mm_set_ps1(m1.v2.z);
-		_w = _mm_set_ps1(m1.v2.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v2._m = _z;
-
-
-		// ROW 3 //
-
-		_x = _mm_set_ps1(m1.v3.x);
-		_y = _mm_set_ps1(m1.v3.y);
-		_z = _mm_set_ps1(m1.v3.z);
-		_w = _mm_set_ps1(m1.v3.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v3._m = _z;
-
-
-		// (MxM) * (Matrix) // ===============================================//
-
-		// ROW 0 //
-
-		_x = _mm_set_ps1(tmp.v0.x);	
-		_y = _mm_set_ps1(tmp.v0.y);	
-		_z = _mm_set_ps1(tmp.v0.z);	
-		_w = _mm_set_ps1(tmp.v0.w);	
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v0._m = _z;
-
-		// ROW 1 //
-
-		_x = _mm_set_ps1(tmp.v1.x);
-		_y = _mm_set_ps1(tmp.v1.y);
-		_z = _mm_set_ps1(tmp.v1.z);
-		_w = _mm_set_ps1(tmp.v1.w);
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v1._m = _z;
-
+	}
 
-		// ROW 2 //
+	__m128 row(const int i, const MatRowKind) const
+	{
+		return (&m.v0)[i]._m;
+	}
 
-		_x = _mm_set_ps1(tmp.v2.x);
-		_y = _mm_set_ps1(tmp.v2.y);
-		_z = _mm_set_ps1(tmp.v2.z);
-		_w = _mm_set_ps1(tmp.v2.w);
+	// v * m
+	__m128 apply(const __m128 v, const MatRowKind kind) const
+	{
+		__m128 _x = _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));		// (x, x, x, x)
+		__m128 _y = _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));		// (y, y, y, y)
+		__m128 _z = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));		// (z, z, z, z)
 
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
+		_x = _mm_mul_ps(m.v0._m, _x);			// (m0, m1, m2, m3) (x, x, x, x) == (xm0, xm1, xm2, xm3)
+		_y = _mm_mul_ps(m.v1._m, _y);
 		_x = _mm_add_ps(_x, _y);
 
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
+		_z = _mm_mul_ps(m.v2._m, _z);
 
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v2._m = _z;
-
-
-		// ROW 3 //
-
-		_x = _mm_set_ps1(tmp.v3.x);
-		_y = _mm_set_ps1(tmp.v3.y);
-		_z = _mm_set_ps1(tmp.v3.z);
-		_w = _mm_set_ps1(tmp.v3.w);
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
+		switch( kind )
+		{
+		case MatRowKind::AffineLinear:
+			break;
 
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
+		case MatRowKind::AffineTranslation:
+			_z = _mm_add_ps(_z, m.v3._m);
+			break;
 
-		_z = _mm_add_ps(_x, _y);
+		default:
+			_y = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));		// (w, w, w, w)
+			_y = _mm_mul_ps(m.v3._m, _y);
+			_z = _mm_add_ps(_z, _y);
+			break;
+		}
 
-		tmp.v3._m = _z;
+		return _mm_add_ps(_x, _z);
+	}
 
+	unsigned int structure() const
+	{
+		return m.structure;
+	}
 
-		return tmp;
+	// AND over the leaves
+	unsigned int leafStructure() const
+	{
+		return m.structure;
 	}
 };
 
-struct MxM4
+template <typename L, typename R>
+struct MatProduct : public MatNode
 {
-	const Matrix& m1;
-	const Matrix& m2;
-	const Matrix& m3;
-	const Matrix& m4;
+	L	l;
+	R	r;
 
-	MxM4(const MxM3& t1, const Matrix& t2)
-		:m1(t1.m1), m2(t1.m2), m3(t1.m3), m4(t2) {};
-
-	operator Matrix()
+	MatProduct(const L &tl, const R &tr)
+		: l(tl), r(tr)
 	{
-		Matrix tmp;
-
-		// (Matrix) * (Matrix) // ===============================================//
-
-		// ROW 0 //
-
-		__m128 _x = _mm_set_ps1(m1.v0.x);
-		__m128 _y = _mm_set_ps1(m1.v0.y);
-		__m128 _z = _mm_set_ps1(m1.v0.z);
-		__m128 _w = _mm_set_ps1(m1.v0.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v0._m = _z;
-
-
-		// ROW 1 //
-
-		_x = _mm_set_ps1(m1.v1.x);
-		_y = _mm_set_ps1(m1.v1.y);
-		_z = _mm_set_ps1(m1.v1.z);
-		_w = _mm_set_ps1(m1.v1.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v1._m = _z;
-
-
-		// ROW 2 //
-
-		_x = _mm_set_ps1(m1.v2.x);
-		_y = _mm_set_ps1(m1.v2.y);
-		_z = _mm_set_ps1(m1.v2.z);
-		_w = _mm_set_ps1(m1.v2.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v2._m = _z;
-
-
-		// ROW 3 //
-
-		_x = _mm_set_ps1(m1.v3.x);
-		_y = _mm_set_ps1(m1.v3.y);
-		_z = _mm_set_ps1(m1.v3.z);
-		_w = _mm_set_ps1(m1.v3.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v3._m = _z;
-
-
-		// (MxM) * (Matrix) // ===============================================//
-
-		// ROW 0 //
-
-		_x = _mm_set_ps1(tmp.v0.x);
-		_y = _mm_set_ps1(tmp.v0.y);
-		_z = _mm_set_ps1(tmp.v0.z);
-		_w = _mm_set_ps1(tmp.v0.w);
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v0._m = _z;
-
-		// ROW 1 //
-
-		_x = _mm_set_ps1(tmp.v1.x);
-		_y = _mm_set_ps1(tmp.v1.y);
-		_z = _mm_set_ps1(tmp.v1.z);
-		_w = _mm_set_ps1(tmp.v1.w);
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v1._m = _z;
-
-
-		// ROW 2 //
-
-		_x = _mm_set_ps1(tmp.v2.x);
-		_y = _mm_set_ps1(tmp.v2.y);
-		_z = _mm_set_ps1(tmp.v2.z);
-		_w = _mm_set_ps1(tmp.v2.w);
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v2._m = _z;
-
-
-		// ROW 3 //
-
-		_x = _mm_set_ps1(tmp.v3.x);
-		_y = _mm_set_ps1(tmp.v3.y);
-		_z = _mm_set_ps1(tmp.v3.z);
-		_w = _mm_set_ps1(tmp.v3.w);
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v3._m = _z;
-
-
-		// (MxM3) * (Matrix) // ===============================================//
-
-		// ROW 0 //
-
-		_x = _mm_set_ps1(tmp.v0.x);
-		_y = _mm_set_ps1(tmp.v0.y);
-		_z = _mm_set_ps1(tmp.v0.z);
-		_w = _mm_set_ps1(tmp.v0.w);
-
-		_x = _mm_mul_ps(m4.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-		_y = _mm_mul_ps(m4.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m4.v2._m, _z);
-		_y = _mm_mul_ps(m4.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v0._m = _z;
-
-		// ROW 1 //
-
-		_x = _mm_set_ps1(tmp.v1.x);
-		_y = _mm_set_ps1(tmp.v1.y);
-		_z = _mm_set_ps1(tmp.v1.z);
-		_w = _mm_set_ps1(tmp.v1.w);
-
-		_x = _mm_mul_ps(m4.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-		_y = _mm_mul_ps(m4.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m4.v2._m, _z);
-		_y = _mm_mul_ps(m4.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v1._m = _z;
-
-
-		// ROW 2 //
-
-		_x = _mm_set_ps1(tmp.v2.x);
-		_y = _mm_set_ps1(tmp.v2.y);
-		_z = _mm_set_ps1(tmp.v2.z);
-		_w = _mm_set_ps1(tmp.v2.w);
-
-		_x = _mm_mul_ps(m4.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-		_y = _mm_mul_ps(m4.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m4.v2._m, _z);
-		_y = _mm_mul_ps(m4.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v2._m = _z;
-
+	}
 
-		// ROW 3 //
+	__m128 row(const int i, const MatRowKind kind) const
+	{
+		return r.apply(l.row(i, kind), kind);
+	}
 
-		_x = _mm_set_ps1(tmp.v3.x);
-		_y = _mm_set_ps1(tmp.v3.y);
-		_z = _mm_set_ps1(tmp.v3.z);
-		_w = _mm_set_ps1(tmp.v3.w);
+	__m128 apply(const __m128 v, const MatRowKind kind) const
+	{
+		return r.apply(l.apply(v, kind), kind);
+	}
 
-		_x = _mm_mul_ps(m4.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-		_y = _mm_mul_ps(m4.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
+	unsigned int structure() const
+	{
+		return Matrix::ProductStructure(l.structure(), r.structure());
+	}
 
-		_z = _mm_mul_ps(m4.v2._m, _z);
-		_y = _mm_mul_ps(m4.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
+	unsigned int leafStructure() const
+	{
+		return l.leafStructure() & r.leafStructure();
+	}
 
-		_z = _mm_add_ps(_x, _y);
+	operator Matrix() const
+	{
+		const bool affine = (this->leafStructure() & Matrix::AFFINE) != 0;
+		const MatRowKind linear = affine ? MatRowKind::AffineLinear : MatRowKind::General;
+		const MatRowKind translation = affine ? MatRowKind::AffineTranslation : MatRowKind::General;
 
-		tmp.v3._m = _z;
+		Matrix tmp;
+		tmp.v0._m = this->row(0, linear);
+		tmp.v1._m = this->row(1, linear);
+		tmp.v2._m = this->row(2, linear);
+		tmp.v3._m = this->row(3, translation);
+		tmp.structure = this->structure();
 
 		return tmp;
 	}
 };
 
-struct MxM5
+// row vector times a matrix expression
+template <typename V, typename M>
+struct VecMat : public VecNode
 {
-	const Matrix& m1;
-	const Matrix& m2;
-	const Matrix& m3;
-	const Matrix& m4;
-	const Matrix& m5;
-
-	MxM5(const MxM4& t1, const Matrix& t2)
-		:m1(t1.m1), m2(t1.m2), m3(t1.m3), m4(t1.m4), m5(t2) {};
+	V	v;
+	M	m;
 
-	operator Matrix()
+	VecMat(const V &tv, const M &tm)
+		: v(tv), m(tm)
 	{
-		Matrix tmp;
-
-		// (Matrix) * (Matrix) // ===============================================//
-
-		// ROW 0 //
-
-		__m128 _x = _mm_set_ps1(m1.v0.x);
-		__m128 _y = _mm_set_ps1(m1.v0.y);
-		__m128 _z = _mm_set_ps1(m1.v0.z);
-		__m128 _w = _mm_set_ps1(m1.v0.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v0._m = _z;
-
-
-		// ROW 1 //
-
-		_x = _mm_set_ps1(m1.v1.x);
-		_y = _mm_set_ps1(m1.v1.y);
-		_z = _mm_set_ps1(m1.v1.z);
-		_w = _mm_set_ps1(m1.v1.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v1._m = _z;
-
-
-		// ROW 2 //
-
-		_x = _mm_set_ps1(m1.v2.x);
-		_y = _mm_set_ps1(m1.v2.y);
-		_z = _mm_set_ps1(m1.v2.z);
-		_w = _mm_set_ps1(m1.v2.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v2._m = _z;
-
-
-		// ROW 3 //
-
-		_x = _mm_set_ps1(m1.v3.x);
-		_y = _mm_set_ps1(m1.v3.y);
-		_z = _mm_set_ps1(m1.v3.z);
-		_w = _mm_set_ps1(m1.v3.w);
-
-		_x = _mm_mul_ps(m2.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-		_y = _mm_mul_ps(m2.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m2.v2._m, _z);
-		_y = _mm_mul_ps(m2.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v3._m = _z;
-
-
-		// (MxM) * (Matrix) // ===============================================//
-
-		// ROW 0 //
-
-		_x = _mm_set_ps1(tmp.v0.x);
-		_y = _mm_set_ps1(tmp.v0.y);
-		_z = _mm_set_ps1(tmp.v0.z);
-		_w = _mm_set_ps1(tmp.v0.w);
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v0._m = _z;
-
-		// ROW 1 //
-
-		_x = _mm_set_ps1(tmp.v1.x);
-		_y = _mm_set_ps1(tmp.v1.y);
-		_z = _mm_set_ps1(tmp.v1.z);
-		_w = _mm_set_ps1(tmp.v1.w);
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v1._m = _z;
-
-
-		// ROW 2 //
-
-		_x = _mm_set_ps1(tmp.v2.x);
-		_y = _mm_set_ps1(tmp.v2.y);
-		_z = _mm_set_ps1(tmp.v2.z);
-		_w = _mm_set_ps1(tmp.v2.w);
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v2._m = _z;
-
-
-		// ROW 3 //
-
-		_x = _mm_set_ps1(tmp.v3.x);
-		_y = _mm_set_ps1(tmp.v3.y);
-		_z = _mm_set_ps1(tmp.v3.z);
-		_w = _mm_set_ps1(tmp.v3.w);
-
-		_x = _mm_mul_ps(m3.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-		_y = _mm_mul_ps(m3.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m3.v2._m, _z);
-		_y = _mm_mul_ps(m3.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v3._m = _z;
-
-
-		// (MxM3) * (Matrix) // ===============================================//
-
-		// ROW 0 //
-
-		_x = _mm_set_ps1(tmp.v0.x);
-		_y = _mm_set_ps1(tmp.v0.y);
-		_z = _mm_set_ps1(tmp.v0.z);
-		_w = _mm_set_ps1(tmp.v0.w);
-
-		_x = _mm_mul_ps(m4.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-		_y = _mm_mul_ps(m4.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m4.v2._m, _z);
-		_y = _mm_mul_ps(m4.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v0._m = _z;
-
-		// ROW 1 //
-
-		_x = _mm_set_ps1(tmp.v1.x);
-		_y = _mm_set_ps1(tmp.v1.y);
-		_z = _mm_set_ps1(tmp.v1.z);
-		_w = _mm_set_ps1(tmp.v1.w);
-
-		_x = _mm_mul_ps(m4.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-		_y = _mm_mul_ps(m4.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m4.v2._m, _z);
-		_y = _mm_mul_ps(m4.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v1._m = _z;
-
-
-		// ROW 2 //
-
-		_x = _mm_set_ps1(tmp.v2.x);
-		_y = _mm_set_ps1(tmp.v2.y);
-		_z = _mm_set_ps1(tmp.v2.z);
-		_w = _mm_set_ps1(tmp.v2.w);
-
-		_x = _mm_mul_ps(m4.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-		_y = _mm_mul_ps(m4.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m4.v2._m, _z);
-		_y = _mm_mul_ps(m4.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v2._m = _z;
-
-
-		// ROW 3 //
-
-		_x = _mm_set_ps1(tmp.v3.x);
-		_y = _mm_set_ps1(tmp.v3.y);
-		_z = _mm_set_ps1(tmp.v3.z);
-		_w = _mm_set_ps1(tmp.v3.w);
-
-		_x = _mm_mul_ps(m4.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-		_y = _mm_mul_ps(m4.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m4.v2._m, _z);
-		_y = _mm_mul_ps(m4.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v3._m = _z;
-
-
-		// (MxM4) * (Matrix) // ===============================================//
-
-
-		// ROW 0 //
-
-		_x = _mm_set_ps1(tmp.v0.x);
-		_y = _mm_set_ps1(tmp.v0.y);
-		_z = _mm_set_ps1(tmp.v0.z);
-		_w = _mm_set_ps1(tmp.v0.w);
-
-		_x = _mm_mul_ps(m5.v0._m, _x);			// (m0, m1, m2, m3) (x0, x0, x0, x0) == (x0m0, x0m1, x0m2, x0m3)
-		_y = _mm_mul_ps(m5.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m5.v2._m, _z);
-		_y = _mm_mul_ps(m5.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v0._m = _z;
-
-		// ROW 1 //
-
-		_x = _mm_set_ps1(tmp.v1.x);
-		_y = _mm_set_ps1(tmp.v1.y);
-		_z = _mm_set_ps1(tmp.v1.z);
-		_w = _mm_set_ps1(tmp.v1.w);
-
-		_x = _mm_mul_ps(m5.v0._m, _x);			// (m0, m1, m2, m3) (x1, x1, x1, x1) == (x1m0, x1m1, x1m2, x1m3)
-		_y = _mm_mul_ps(m5.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m5.v2._m, _z);
-		_y = _mm_mul_ps(m5.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v1._m = _z;
-
-
-		// ROW 2 //
-
-		_x = _mm_set_ps1(tmp.v2.x);
-		_y = _mm_set_ps1(tmp.v2.y);
-		_z = _mm_set_ps1(tmp.v2.z);
-		_w = _mm_set_ps1(tmp.v2.w);
-
-		_x = _mm_mul_ps(m5.v0._m, _x);			// (m0, m1, m2, m3) (x2, x2, x2, x2) == (x2m0, x2m1, x2m2, x2m3)
-		_y = _mm_mul_ps(m5.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m5.v2._m, _z);
-		_y = _mm_mul_ps(m5.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
-
-		tmp.v2._m = _z;
-
-
-		// ROW 3 //
-
-		_x = _mm_set_ps1(tmp.v3.x);
-		_y = _mm_set_ps1(tmp.v3.y);
-		_z = _mm_set_ps1(tmp.v3.z);
-		_w = _mm_set_ps1(tmp.v3.w);
-
-		_x = _mm_mul_ps(m5.v0._m, _x);			// (m0, m1, m2, m3) (x3, x3, x3, x3) == (x3m0, x3m1, x3m2, x3m3)
-		_y = _mm_mul_ps(m5.v1._m, _y);
-		_x = _mm_add_ps(_x, _y);
-
-		_z = _mm_mul_ps(m5.v2._m, _z);
-		_y = _mm_mul_ps(m5.v3._m, _w);
-		_y = _mm_add_ps(_z, _y);
-
-		_z = _mm_add_ps(_x, _y);
+	}
 
-		tmp.v3._m = _z;
+	__m128 eval() const
+	{
+		// nothing known about the vector's w
+		return m.apply(v.eval(), MatRowKind::General);
+	}
 
-		return tmp;
+	operator Vect4D() const
+	{
+		return Vect4D(this->eval());
 	}
 };
 
+// nodes stay, Matrix is wrapped, anything else isn't a matrix
+template <typename T, bool = std::is_base_of<MatNode, T>::value>
+struct MatArg
+{
+};
 
-// INLINE FUNCTIONS
-
-inline MxM operator * (const Matrix& m1, const Matrix& m2)
+template <typename T>
+struct MatArg<T, true>
 {
+	typedef T type;
+
+	static const T &Wrap(const T &t)
 	{
-		return MxM(m1, m2);
+		return t;
 	}
-}
+};
 
-inline MxM3 operator * (const MxM& m1, const Matrix& m2)
+template <>
+struct MatArg<Matrix, false>
 {
+	typedef MatRef type;
+
+	static MatRef Wrap(const Matrix &t)
 	{
-		return MxM3(m1, m2);
+		return MatRef(t);
 	}
-}
+};
+
 
-inline MxM4 operator * (const MxM3& m1, const Matrix& m2)
+// INLINE FUNCTIONS
+
+template <typename L, typename R>
+inline MatProduct<typename MatArg<L>::type, typename MatArg<R>::type> operator * (const L &m1, const R &m2)
 {
-	{
-		return MxM4(m1, m2);
-	}
+	return MatProduct<typename MatArg<L>::type, typename MatArg<R>::type>(MatArg<L>::Wrap(m1), MatArg<R>::Wrap(m2));
 }
 
-inline MxM5 operator * (const MxM4& m1, const Matrix& m2)
+template <typename L, typename R>
+inline VecMat<typename VecArg<L>::type, typename MatArg<R>::type> operator * (const L &v1, const R &m2)
 {
-	{
-		return MxM5(m1, m2);
-	}
+	return VecMat<typename VecArg<L>::type, typename MatArg<R>::type>(VecArg<L>::Wrap(v1), MatArg<R>::Wrap(m2));
 }
 
 #endif  
@@ -0,0 +1,139 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include "MatrixArray.h"
+#include "Simd.h"
+
+// the 16 elements of n matrices starting at i
+template <typename V>
+static void Load(const MatrixStreams &a, const int i, const int n, V *m)
+{
+	for( int e = 0; e < 16; e++ )
+	{
+		m[e] = SimdIn<V>(a.pm[e] + i, n);
+	}
+}
+
+template <typename V>
+static void Store(const V *m, const MatrixStreams &out, const int i, const int n)
+{
+	for( int e = 0; e < 16; e++ )
+	{
+		SimdOut(m[e], out.pm[e] + i, n);
+	}
+}
+
+void MatrixArray::Multiply(const MatrixStreams &a, const MatrixStreams &b, const MatrixStreams &out, const int count)
+{
+	SimdForEach(count, [&a, &b, &out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+
+		// all of both in before anything goes out - out may be a or b
+		V ma[16];
+		V mb[16];
+		Load(a, i, n, ma);
+		Load(b, i, n, mb);
+
+		V mo[16];
+		for( int r = 0; r < 16; r += 4 )
+		{
+			for( int c = 0; c < 4; c++ )
+			{
+				// (x + y) + (z + w), as Matrix::Multiply
+				const V xy = ma[r + 0] * mb[c + 0] + ma[r + 1] * mb[c + 4];
+				const V zw = ma[r + 2] * mb[c + 8] + ma[r + 3] * mb[c + 12];
+				mo[r + c] = xy + zw;
+			}
+		}
+
+		Store(mo, out, i, n);
+	});
+}
+
+void MatrixArray::Determinant(const MatrixStreams &a, float *pOut, const int count)
+{
+	SimdForEach(count, [&a, pOut](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+
+		V m[16];
+		Load(a, i, n, m);
+
+		// Matrix::Determinant's expansion, term for term
+		const V ta = (m[10] * m[15]) - (m[11] * m[14]);
+		const V tb = (m[9] * m[15]) - (m[11] * m[13]);
+		const V tc = (m[9] * m[14]) - (m[10] * m[13]);
+		const V td = (m[8] * m[15]) - (m[11] * m[12]);
+		const V te = (m[8] * m[13]) - (m[9] * m[12]);
+		const V tf = (m[8] * m[14]) - (m[10] * m[12]);
+
+		const V det = ((m[0] * ((m[5] * ta) - (m[6] * tb) + (m[7] * tc)))
+			- (m[1] * ((m[4] * ta) - (m[6] * td) + (m[7] * tf)))
+			+ (m[2] * ((m[4] * tb) - (m[5] * td) + (m[7] * te)))
+			- (m[3] * ((m[4] * tc) - (m[5] * tf) + (m[6] * te))));
+
+		SimdOut(det, pOut + i, n);
+	});
+}
+
+void MatrixArray::Inverse(const MatrixStreams &a, const MatrixStreams &out, const int count)
+{
+	SimdForEach(count, [&a, &out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+
+		V m[16];
+		Load(a, i, n, m);
+
+		// 2x2 minors of the top two rows ...
+		const V s0 = (m[0] * m[5]) - (m[4] * m[1]);
+		const V s1 = (m[0] * m[6]) - (m[4] * m[2]);
+		const V s2 = (m[0] * m[7]) - (m[4] * m[3]);
+		const V s3 = (m[1] * m[6]) - (m[5] * m[2]);
+		const V s4 = (m[1] * m[7]) - (m[5] * m[3]);
+		const V s5 = (m[2] * m[7]) - (m[6] * m[3]);
+
+		// ... and of the bottom two
+		const V c0 = (m[8] * m[13]) - (m[12] * m[9]);
+		const V c1 = (m[8] * m[14]) - (m[12] * m[10]);
+		const V c2 = (m[8] * m[15]) - (m[12] * m[11]);
+		const V c3 = (m[9] * m[14]) - (m[13] * m[10]);
+		const V c4 = (m[9] * m[15]) - (m[13] * m[11]);
+		const V c5 = (m[10] * m[15]) - (m[14] * m[11]);
+
+		const V det = (s0 * c5) - (s1 * c4) + (s2 * c3) + (s3 * c2) - (s4 * c1) + (s5 * c0);
+
+		// singular lanes come out 0, like Matrix::Inverse
+		const V eps = V::Set1(0.0001f);
+		const typename V::Mask singular = V::CmpLT(V::Max(det, V::Zero() - det), eps);
+		const V inv = V::Select(singular, V::Zero(), V::Set1(1.0f) / det);
+
+		// adjugate (transposed cofactors) over the determinant
+		V o[16];
+		o[0] = ((m[5] * c5) - (m[6] * c4) + (m[7] * c3)) * inv;
+		o[1] = ((m[2] * c4) - (m[1] * c5) - (m[3] * c3)) * inv;
+		o[2] = ((m[13] * s5) - (m[14] * s4) + (m[15] * s3)) * inv;
+		o[3] = ((m[10] * s4) - (m[9] * s5) - (m[11] * s3)) * inv;
+
+		o[4] = ((m[6] * c2) - (m[4] * c5) - (m[7] * c1)) * inv;
+		o[5] = ((m[0] * c5) - (m[2] * c2) + (m[3] * c1)) * inv;
+		o[6] = ((m[14] * s2) - (m[12] * s5) - (m[15] * s1)) * inv;
+		o[7] = ((m[8] * s5) - (m[10] * s2) + (m[11] * s1)) * inv;
+
+		o[8] = ((m[4] * c4) - (m[5] * c2) + (m[7] * c0)) * inv;
+		o[9] = ((m[1] * c2) - (m[0] * c4) - (m[3] * c0)) * inv;
+		o[10] = ((m[12] * s4) - (m[13] * s2) + (m[15] * s0)) * inv;
+		o[11] = ((m[9] * s2) - (m[8] * s4) - (m[11] * s0)) * inv;
+
+		o[12] = ((m[5] * c1) - (m[4] * c3) - (m[6] * c0)) * inv;
+		o[13] = ((m[0] * c3) - (m[1] * c1) + (m[2] * c0)) * inv;
+		o[14] = ((m[13] * s1) - (m[12] * s3) - (m[14] * s0)) * inv;
+		o[15] = ((m[8] * s3) - (m[9] * s1) + (m[10] * s0)) * inv;
+
+		Store(o, out, i, n);
+	});
+}
+
+// --- End of File ---
@@ -0,0 +1,43 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef MATRIX_ARRAY_H
+#define MATRIX_ARRAY_H
+
+// an array of 4x4 matrices as 16 float streams - pm[e][k] is element e
+// (m0..m15, row major like Matrix) of matrix k
+struct MatrixStreams
+{
+	float	*pm[16];
+};
+
+// Matrix math over count matrices at once
+//
+//     Lane k of every register is matrix k, so a step does SimdWidth()
+//     whole matrices - 8 determinants or inverses per AVX2 pass, 16 on
+//     AVX-512. The tail goes through LoadN / storeN like Vect4DArray.
+//
+//     Multiply and Determinant use Matrix's general formulas in Matrix's
+//     order, so each lane gives the bits Matrix::Multiply / Determinant
+//     would for a GENERAL matrix. Inverse is Cramer's rule off the twelve
+//     2x2 minors, like the single SSE Matrix::Inverse - it agrees with that
+//     one to rounding, not to the bit.
+//
+//     Structure flags don't apply here, every matrix takes the full path.
+//     Output may be one of the inputs.
+class MatrixArray
+{
+public:
+	// out = a * b
+	static void Multiply(const MatrixStreams &a, const MatrixStreams &b, const MatrixStreams &out, const int count);
+
+	static void Determinant(const MatrixStreams &a, float *pOut, const int count);
+
+	// all zero when |det| < 0.0001, like Matrix::Inverse
+	static void Inverse(const MatrixStreams &a, const MatrixStreams &out, const int count);
+};
+
+#endif
+
+// --- End of File ---
@@ -0,0 +1,66 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <Psapi.h>
+#include "PageFaultMonitor.h"
+
+PageFaultMonitor::PageFaultMonitor(int _numFrames)
+	: poFrameFaults(nullptr),
+	numFrames(_numFrames > 0 ? _numFrames : 0),
+	frames(0),
+	setupFaults(0),
+	last(PageFaultMonitor::privFaults())
+{
+	this->poFrameFaults = new DWORD[(unsigned int)(this->numFrames > 0 ? this->numFrames : 1)];
+}
+
+PageFaultMonitor::~PageFaultMonitor()
+{
+	delete[] this->poFrameFaults;
+}
+
+DWORD PageFaultMonitor::privFaults()
+{
+	PROCESS_MEMORY_COUNTERS counters = {};
+	counters.cb = sizeof(counters);
+	if( !GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) )
+	{
+		return 0;
+	}
+	return counters.PageFaultCount;
+}
+
+void PageFaultMonitor::startup()
+{
+	const DWORD now = PageFaultMonitor::privFaults();
+	this->setupFaults = now - this->last;
+	this->last = now;
+}
+
+void PageFaultMonitor::frame()
+{
+	if( this->frames >= this->numFrames )
+	{
+		return;
+	}
+
+	const DWORD now = PageFaultMonitor::privFaults();
+	this->poFrameFaults[this->frames++] = now - this->last;
+	this->last = now;
+}
+
+void PageFaultMonitor::report() const
+{
+	Trace::out("--- PageFaultMonitor: %lu faults during setup ---\n", (unsigned long)this->setupFaults);
+
+	unsigned long total = 0;
+	for( int i = 0; i < this->frames; i++ )
+	{
+		Trace::out("  frame %3d: %6lu faults\n", i, (unsigned long)this->poFrameFaults[i]);
+		total += this->poFrameFaults[i];
+	}
+	Trace::out("  first %d frames: %lu faults\n", this->frames, total);
+}
+
+// --- End of File ---
@@ -0,0 +1,40 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef PAGE_FAULT_MONITOR_H
+#define PAGE_FAULT_MONITOR_H
+
+// Process page faults during setup and each of the first frames
+//
+//     Soft and hard faults together (GetProcessMemoryInfo), so it shows
+//     whether pre-faulting kept fresh memory out of the frame loop.
+//     Created before the emitter, startup() closes the setup interval,
+//     frame() closes one frame - the first numFrames are kept.
+class PageFaultMonitor
+{
+public:
+	explicit PageFaultMonitor(int numFrames);
+	PageFaultMonitor() = delete;
+	PageFaultMonitor(const PageFaultMonitor &) = delete;
+	PageFaultMonitor &operator = (const PageFaultMonitor &) = delete;
+	~PageFaultMonitor();
+
+	void startup();
+	void frame();
+
+	void report() const;
+
+private:
+	static DWORD privFaults();
+
+	DWORD	*poFrameFaults;
+	int		numFrames;
+	int		frames;			// recorded so far
+	DWORD	setupFaults;
+	DWORD	last;
+};
+
+#endif
+
+// --- End of File ---
@@ -10,10 +10,15 @@ Particle::Particle()
 	// construtor
 	this->life = 0.0f;
 	this->position.set( 0.0f, 0.0f,  -10.0f );
-	this->velocity.set( -3.0f, 0.0f,  0.0f );
-	this->scale.set( 1.0f, 1.0f, 1.0f );
+	this->setVelocity( Vect4D( -3.0f, 0.0f,  0.0f ) );
+	this->setScale( Vect4D( 1.0f, 1.0f, 1.0f ) );
+#if PARTICLE_INCREMENTAL_ROTATION
+	this->rotation_cos = 1.0f;
+	this->rotation_sin = 0.0f;
+#else
 	this->rotation = 0.0f;
-	this->rotation_velocity = -0.25f;
+#endif
+	this->setRotationVelocity( -0.25f );
 	this->next = nullptr;
 	this->prev = nullptr;
 }
@@ -31,51 +36,110 @@ void Particle::CopyDataOnly(const Particle &p )
 	this->position = p.position;
 	this->velocity = p.velocity;
 	this->scale    = p.scale;
+#if PARTICLE_INCREMENTAL_ROTATION
+	this->rotation_cos = p.rotation_cos;
+	this->rotation_sin = p.rotation_sin;
+#else
 	this->rotation = p.rotation;
+#endif
 	this->rotation_velocity = p.rotation_velocity;
 	this->life     = p.life;
 }
 
-void Particle::Update(const float& time_elapsed)
+void Particle::Spawn(const Vect4D &pos, const Vect4D &vel, const Vect4D &sc)
 {
-	// Rotate the matrices
-
-
-	this->prev_Row0 = this->curr_Row0;
-	this->prev_Row1 = this->curr_Row1;
-	this->prev_Row2 = this->curr_Row2;
-	this->prev_Row3 = this->curr_Row3;
-
-
-	tmp.set(Matrix::MatrixRow::MATRIX_ROW_0, this->diff_Row0); //88
-	tmp.set(Matrix::MatrixRow::MATRIX_ROW_1, this->diff_Row1); //88
-	tmp.set(Matrix::MatrixRow::MATRIX_ROW_2, this->diff_Row2); //88
-	tmp.set(Matrix::MatrixRow::MATRIX_ROW_3, this->diff_Row3); //88
-
-	float MatrixScale = -3.0f*tmp.Determinant();
+	this->life = 0.0f;
+	this->position = pos;
+	this->setVelocity(vel);
+	this->setScale(sc);
+}
 
-	// serious math below - magic secret sauce
+void Particle::Age(const float& time_elapsed)
+{
 	this->life += time_elapsed;
-	this->position += (this->velocity * time_elapsed);		// Implemented +=  88888
+}
 
+void Particle::Move(const float& time_elapsed)
+{
+	const Vect4D vel = this->getVelocity();
+	this->position += (vel * time_elapsed);		// Implemented +=  88888
+}
 
+void Particle::Swirl()
+{
+	// serious math below - magic secret sauce
 	Vect4D z_axis(0.0f, 0.0f, 3.0f);			
 	Vect4D v(2,2,0);
 	position.Cross( z_axis, v);	// Might Change so that it's not a function call 888
 
-
 	v.norm(v);
 	position += (v * 0.05f * life); // += IMPLEMENT HERE 88888888
+}
+
+float Particle::Kick()
+{
+	// zero last column once the particle has been drawn twice - then
+	// Determinant() knows it is 0 without the expansion (see Matrix::Structure)
+	const Matrix tmp(this->diff_Row0, this->diff_Row1, this->diff_Row2, this->diff_Row3);
+
+	return this->Kick(tmp.Determinant());
+}
+
+float Particle::Kick(const float determinant)
+{
+	assert(determinant == Matrix(this->diff_Row0, this->diff_Row1, this->diff_Row2, this->diff_Row3).Determinant());
+
+	// Rotate the matrices
+	this->prev_Row0 = this->curr_Row0;
+	this->prev_Row1 = this->curr_Row1;
+	this->prev_Row2 = this->curr_Row2;
+	this->prev_Row3 = this->curr_Row3;
+
+	float MatrixScale = -3.0f*determinant;
 
 	if( MatrixScale > 1.0 )
 	{
 		MatrixScale = 1.0f/MatrixScale;
 	};
 
+	return MatrixScale;
+}
 
-
+void Particle::Spin(const float angle, RotationStep &spin)
+{
 	// Changes the rotation of the particle
-	rotation += MatrixScale + rotation_velocity * time_elapsed * 2;
+#if PARTICLE_INCREMENTAL_ROTATION
+	spin.Apply(angle, this->rotation_cos, this->rotation_sin);
+#else
+	AZUL_UNUSED_VAR(spin);
+	rotation += angle;
+#endif
+}
+
+void Particle::getRotation(Affine34 &rot) const
+{
+#if PARTICLE_INCREMENTAL_ROTATION
+	rot.setRotZMatrix(this->rotation_cos, this->rotation_sin);
+#else
+	rot.setRotZMatrix(this->rotation);
+#endif
+}
+
+void Particle::Record(const Affine34 &world)
+{
+	// squirrel away matrix for next update
+	Matrix worldRows;
+	world.toMatrix(worldRows);
+	worldRows.get(Matrix::MatrixRow::MATRIX_ROW_0, this->curr_Row0);		  //88
+	worldRows.get(Matrix::MatrixRow::MATRIX_ROW_1, this->curr_Row1);		  //88
+	worldRows.get(Matrix::MatrixRow::MATRIX_ROW_2, this->curr_Row2);		  //88
+	worldRows.get(Matrix::MatrixRow::MATRIX_ROW_3, this->curr_Row3);		  //88
+
+	// difference vector
+	this->diff_Row0 = this->curr_Row0 - this->prev_Row0;
+	this->diff_Row1 = this->curr_Row1 - this->prev_Row1;
+	this->diff_Row2 = this->curr_Row2 - this->prev_Row2;
+	this->diff_Row3 = this->curr_Row3 - this->prev_Row3;
 }
 
 // --- End of File ---
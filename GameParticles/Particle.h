@@ -8,6 +8,10 @@
 // include
 #include "Vect4D.h"
 #include "Matrix.h"
+#include "Affine34.h"
+#include "HalfFloat.h"
+#include "RotationStep.h"
+#include "Settings.h"
 #include <new>
 
 class Matrix;
@@ -15,7 +19,7 @@ class Matrix;
 class Particle
 {
 public:
-	friend class ParticleEmitter;
+	template <typename Policies> friend class BasicParticleEmitter;
 	
 	Particle();	
 	Particle(const Particle& r) = default;					//888
@@ -23,9 +27,106 @@ public:
 	~Particle();
 
 
-	void Update(const float& time_elapsed);
 	void CopyDataOnly( const Particle &p );
 
+	// the steps of an update, put together by the emitter's policies
+	// (see ParticlePolicies.h) - a configuration only pays for what it calls
+	void Spawn(const Vect4D &pos, const Vect4D &vel, const Vect4D &sc);
+	void Age(const float& time_elapsed);
+	void Move(const float& time_elapsed);
+	void Swirl();
+
+	// rotation angle from the matrix history, read before the next Record()
+	float Kick();
+
+	// the same off the diff rows' determinant, worked out by the caller -
+	// the chunk integrate does the fresh ones together (see MatrixArray)
+	float Kick(const float determinant);
+
+	// spin is shared by a batch of updates, see RotationStep
+	void Spin(const float angle, RotationStep &spin);
+	void getRotation(Affine34 &rot) const;
+
+	// keeps the world transform for the next Kick()
+	void Record(const Affine34 &world);
+
+	float getLife() const
+	{
+		return this->life;
+	}
+
+	// The first draw leaves diff rows = curr - default rows, whose w column
+	// is not zero, so the next Kick() gets a one time rotation kick from
+	// the determinant. After the second draw the w column is zero for good.
+	// Culling has to keep building the transform until then.
+	bool isFresh() const
+	{
+		return this->diff_Row0.w != 0.0f;
+	}
+
+	// cold attributes - IEEE halves with PARTICLE_HALF_ATTRIBUTES, see HalfFloat
+#if PARTICLE_HALF_ATTRIBUTES
+	Vect4D getVelocity() const
+	{
+		return Vect4D(HalfFloat::Load(this->velocity));
+	}
+
+	void setVelocity(const Vect4D &v)
+	{
+		HalfFloat::Store(this->velocity, v._m);
+	}
+
+	Vect4D getScale() const
+	{
+		return Vect4D(HalfFloat::Load(this->scale));
+	}
+
+	void setScale(const Vect4D &s)
+	{
+		HalfFloat::Store(this->scale, s._m);
+	}
+
+	float getRotationVelocity() const
+	{
+		return HalfFloat::ToFloat(this->rotation_velocity);
+	}
+
+	void setRotationVelocity(const float r)
+	{
+		this->rotation_velocity = HalfFloat::FromFloat(r);
+	}
+#else
+	Vect4D getVelocity() const
+	{
+		return this->velocity;
+	}
+
+	void setVelocity(const Vect4D &v)
+	{
+		this->velocity = v;
+	}
+
+	Vect4D getScale() const
+	{
+		return this->scale;
+	}
+
+	void setScale(const Vect4D &s)
+	{
+		this->scale = s;
+	}
+
+	float getRotationVelocity() const
+	{
+		return this->rotation_velocity;
+	}
+
+	void setRotationVelocity(const float r)
+	{
+		this->rotation_velocity = r;
+	}
+#endif
+
 	#undef new
 	void* operator new(size_t i)
 	{
@@ -47,8 +148,6 @@ private:
 	
 	// Padding makes it a factor of 16 (might be wrong because it could be doing allignment instead
 
-	Matrix tmp;
-
 	Vect4D	prev_Row0;		// 64 16	//	72	24
 	Vect4D	prev_Row1;		
 	Vect4D  prev_Row2;		
@@ -65,12 +164,25 @@ private:
 	Vect4D  curr_Row3;	
 
 	Vect4D	position;		// 60 24	//	260	80
-	Vect4D	velocity;
-	Vect4D	scale;
 
 	float	life;
+#if PARTICLE_INCREMENTAL_ROTATION
+	float	rotation_cos;	// unit, the angle is never stored
+	float	rotation_sin;
+#else
 	float	rotation;
+#endif
+
+	// read once per update, never written after the spawn: half is enough
+#if PARTICLE_HALF_ATTRIBUTES
+	Half4		velocity;
+	Half4		scale;
+	uint16_t	rotation_velocity;
+#else
+	Vect4D	velocity;
+	Vect4D	scale;
 	float	rotation_velocity;
+#endif
 
 	
 
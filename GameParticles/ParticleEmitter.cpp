@@ -5,29 +5,112 @@
 #include "OpenGLDevice.h"
 #include "ParticleEmitter.h"
 #include "Settings.h"
+#include "JobSystem.h"
+#include "FrameGraph.h"
 
 PerformanceTimer globalTimer;
 
-ParticleEmitter::ParticleEmitter()
-:	start_position( 0.0f, 2.0f, 2.0f ),
-	start_velocity( -4.0f, 4.0f, 0.0f), 
+static void ResetStats(CullStats& stats)
+{
+	stats.chunksOutside = 0;
+	stats.chunksInside = 0;
+	stats.chunksIntersect = 0;
+	stats.chunksSubPixel = 0;
+	stats.particlesCulled = 0;
+	stats.particlesSubPixel = 0;
+	stats.particlesDrawn = 0;
+}
+
+static int ChunksFor(const int count)
+{
+	return (count + PARTICLE_CHUNK_SIZE - 1) / PARTICLE_CHUNK_SIZE;
+}
+
+// every frame arena allocation of the pipeline for count particles
+static size_t FrameBytesFor(const int count)
+{
+	// depths, keys, radix scratch, list scratch, cull lanes - plus slices, stats, camera
+	const size_t perParticle = sizeof(float) + 2 * sizeof(uint64_t) + sizeof(Particle *) + 7 * sizeof(float);
+	return VirtualMemory::RoundUp(perParticle * (size_t)count + VirtualMemory::COMMIT_GRANULE, VirtualMemory::COMMIT_GRANULE);
+}
+
+static void AddStats(CullStats& to, const CullStats& from)
+{
+	to.chunksOutside += from.chunksOutside;
+	to.chunksInside += from.chunksInside;
+	to.chunksIntersect += from.chunksIntersect;
+	to.chunksSubPixel += from.chunksSubPixel;
+	to.particlesCulled += from.particlesCulled;
+	to.particlesSubPixel += from.particlesSubPixel;
+	to.particlesDrawn += from.particlesDrawn;
+}
+
+template <typename Policies>
+BasicParticleEmitter<Policies>::BasicParticleEmitter(int maxParticles, int reserve)
+:	spawn(),
+	lifetime(),
 	spawn_frequency(0.00001f),		
 	last_spawn(globalTimer.GetGlobalTime()),		
 	last_loop(globalTimer.GetGlobalTime()),
-	max_life( MAX_LIFE ),
-	max_particles( NUM_PARTICLES ),
+	frame_elapsed(0.0f),
+	max_particles( maxParticles ),
+	reserved_particles( (reserve > maxParticles) ? reserve : maxParticles ),
 	last_active_particle(-1),
 	bufferCount(0),
 	headParticle(nullptr),
-	vel_variance(15.0f, 0.70f, -1.0f),
-	pos_variance(1.50f, 0.50f, 10.0f),
-	scale_variance(3.0f)
+	drawListMemory(),
+	retiredMemory(),
+	chunkMemory(),
+	instanceMemory(),
+	pDrawList(nullptr),
+	pChunks(nullptr),
+	pRetired(nullptr),
+	retiredCount(0),
+	pInstances(nullptr),
+	pSliceStats(nullptr),
+	lanes(),
+	sliceCount(1),
+	drawCount(0),
+	chunkCount(0),
+	bounds(),
+	frustum(),
+	cullStats(),
+	depthSort(),
+	sortOrder((SortOrder)PARTICLE_SORT_ORDER),
+	pJobSystem(nullptr),
+	camOffset(),
+	pPool(nullptr),
+	ownsPool(true),
+	ownedIntegrate(false),
+	poFrameMemory(nullptr),
+	pSharedScratch(nullptr)
 {
-	// nothing to do
 	bufferCount = 0;
+
+	assert(maxParticles > 0);
+
+	// address space for the reserve, max_particles committed up front
+	this->drawListMemory.create(reserved_particles, max_particles, -1, false);
+	this->retiredMemory.create(reserved_particles, max_particles, -1, false);
+	this->chunkMemory.create(ChunksFor(reserved_particles), ChunksFor(max_particles), -1, false);
+	this->instanceMemory.create(reserved_particles, max_particles, -1, false);
+
+	this->pDrawList = this->drawListMemory.data();
+	this->pRetired = this->retiredMemory.data();
+	this->pChunks = this->chunkMemory.data();
+	this->pInstances = this->instanceMemory.data();
+
+	// faulted in now, not in the first frames
+	VirtualMemory::Touch(this->pDrawList, this->drawListMemory.getCommittedBytes());
+	VirtualMemory::Touch(this->pRetired, this->retiredMemory.getCommittedBytes());
+	VirtualMemory::Touch(this->pChunks, this->chunkMemory.getCommittedBytes());
+	VirtualMemory::Touch(this->pInstances, this->instanceMemory.getCommittedBytes());
+
+	// pool and scratch wait for the threads (see privCreateMemory)
 }
 
-ParticleEmitter::~ParticleEmitter()
+template <typename Policies>
+BasicParticleEmitter<Policies>::~BasicParticleEmitter()
 {
 	Particle *pTmp = this->headParticle;
 
@@ -37,28 +120,216 @@ ParticleEmitter::~ParticleEmitter()
 		Particle *pDeleteMe = pTmp;
 		//pDeleteMe = pTmp;
 		pTmp = pTmp->next;
-		delete pDeleteMe;
+		this->pPool->release(pDeleteMe);
+	}
+
+	// never updated or attached - nothing was created
+	if( this->pPool != nullptr )
+	{
+		this->privRelease();
+	}
+
+	if( this->ownsPool )
+	{
+		delete this->pPool;
+	}
+	delete this->poFrameMemory;
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::setViewFrustum(const ViewFrustum& f)
+{
+	this->frustum = f;
+}
+
+template <typename Policies>
+const BoundingBox& BasicParticleEmitter<Policies>::getBounds() const
+{
+	return this->bounds;
+}
+
+template <typename Policies>
+const CullStats& BasicParticleEmitter<Policies>::getCullStats() const
+{
+	return this->cullStats;
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::setJobSystem(JobSystem* pJobs)
+{
+	this->pJobSystem = pJobs;
+
+	// one stats block per slice, summed after the build
+	this->sliceCount = (pJobs != nullptr) ? pJobs->getNumSlices() : 1;
+
+	// storage follows the threads - only before the first spawn
+	assert(this->headParticle == nullptr);
+	if( this->ownsPool )
+	{
+		delete this->pPool;
+		this->pPool = nullptr;
+	}
+	this->ownedIntegrate = this->ownsPool && (pJobs != nullptr) && pJobs->isPinned();
+
+	delete this->poFrameMemory;
+	this->poFrameMemory = nullptr;
+
+	this->privCreateMemory();
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::setSharedMemory(ParticlePool* pSharedPool, FrameMemory* pScratch)
+{
+	assert(this->headParticle == nullptr);
+	assert(pSharedPool);
+
+	if( this->ownsPool )
+	{
+		delete this->pPool;
+	}
+	this->pPool = pSharedPool;
+	this->ownsPool = false;
+
+	// its partitions hold other emitters' particles too
+	this->ownedIntegrate = false;
+
+	// created against it by setJobSystem() or the first update
+	this->pSharedScratch = pScratch;
+	delete this->poFrameMemory;
+	this->poFrameMemory = nullptr;
+}
+
+// once, with the threads known - setJobSystem() or else the first update,
+// so a pool is not faulted in for a job system it is then replaced for
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privCreateMemory()
+{
+	if( this->pPool == nullptr )
+	{
+		this->pPool = new ParticlePool(this->reserved_particles, this->max_particles, this->pJobSystem, PARTICLE_LARGE_PAGES != 0);
+	}
+
+	if( this->poFrameMemory == nullptr )
+	{
+		// one scratch arena per thread
+		this->poFrameMemory = new FrameMemory((this->pJobSystem != nullptr) ? this->pJobSystem->getNumThreads() : 1,
+			FrameBytesFor(this->reserved_particles), FrameBytesFor(this->max_particles), this->pSharedScratch);
+
+		// depth keys are built in update(), before the first draw
+		this->privUpdateCamera();
+
+		// a spawn table is drawn now, not in the first frame's spawn stage
+		this->spawn.prepare();
+	}
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::setSortOrder(SortOrder order)
+{
+	this->sortOrder = order;
+}
+
+template <typename Policies>
+const DepthSortStats& BasicParticleEmitter<Policies>::getSortStats() const
+{
+	return this->depthSort.getStats();
+}
+
+template <typename Policies>
+const ParticlePool& BasicParticleEmitter<Policies>::getPool() const
+{
+	// created by setJobSystem() or the first update
+	assert(this->pPool);
+	return *this->pPool;
+}
+
+template <typename Policies>
+int BasicParticleEmitter<Policies>::getParticleCount() const
+{
+	return this->last_active_particle + 1;
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::setMaxParticles(int count)
+{
+	// a large page pool can't grow past its base - not created yet, it gets the new one
+	const int poolMax = (this->pPool != nullptr) ? this->pPool->getMaxCapacity() : this->reserved_particles;
+	int limit = (this->reserved_particles < poolMax) ? this->reserved_particles : poolMax;
+
+	count = (count > 1) ? count : 1;
+	this->max_particles = (count < limit) ? count : limit;
+}
+
+template <typename Policies>
+int BasicParticleEmitter<Policies>::getMaxParticles() const
+{
+	return this->max_particles;
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::setSpawnFrequency(float seconds)
+{
+	assert(seconds > 0.0f);
+	this->spawn_frequency = seconds;
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::reportMemory() const
+{
+	// a shared pool is the owner's to report
+	const size_t poolBytes = (this->ownsPool && this->pPool != nullptr) ? this->pPool->getCommittedBytes() : 0;
+	const size_t scratchBytes = (this->poFrameMemory != nullptr) ? this->poFrameMemory->getCommittedBytes() : 0;
+	const size_t committed = this->drawListMemory.getCommittedBytes() + this->retiredMemory.getCommittedBytes()
+		+ this->chunkMemory.getCommittedBytes() + this->instanceMemory.getCommittedBytes()
+		+ scratchBytes + poolBytes;
+
+	Trace::out("--- ParticleEmitter memory: %d live, max %d, reserve %d, %.2f MB committed ---\n",
+		this->getParticleCount(), this->max_particles, this->reserved_particles, (double)committed / (1024.0 * 1024.0));
+
+	this->drawListMemory.report("draw list");
+	this->retiredMemory.report("retired");
+	this->chunkMemory.report("chunks");
+	this->instanceMemory.report("instances");
+	if( this->ownsPool )
+	{
+		Trace::out("  %-14s committed %8.2f MB\n", "particle pool", (double)poolBytes / (1024.0 * 1024.0));
 	}
+	else
+	{
+		Trace::out("  %-14s shared\n", "particle pool");
+	}
+	if( this->poFrameMemory != nullptr )
+	{
+		this->poFrameMemory->report();
+	}
+}
+
+template <typename Policies>
+typename BasicParticleEmitter<Policies>::Spawn& BasicParticleEmitter<Policies>::getSpawn()
+{
+	return this->spawn;
+}
+
+template <typename Policies>
+typename BasicParticleEmitter<Policies>::Lifetime& BasicParticleEmitter<Policies>::getLifetime()
+{
+	return this->lifetime;
 }
 
 //999
-void ParticleEmitter::SpawnParticle()
+template <typename Policies>
+void BasicParticleEmitter<Policies>::SpawnParticle()
 {
 	// eate another particle if there are ones free
 	if( last_active_particle < max_particles-1 )
 	{
 		// create a new particle
-		pNewParticle = new Particle();
+		pNewParticle = this->pPool->alloc();
+		assert(pNewParticle);
 
 		// 999 
 		// initialize the particle
-		pNewParticle->life     = 0.0f;
-		pNewParticle->position = start_position;
-		pNewParticle->velocity = start_velocity;
-		pNewParticle->scale    = Vect4D(-1.0, -1.0, -1.0, 1.0);
-
-		// apply the variance
-		this->Execute(pNewParticle->position, pNewParticle->velocity, pNewParticle->scale);
+		this->spawn.init(*pNewParticle);
 
 		// increment count
 		last_active_particle++;
@@ -73,8 +344,96 @@ void ParticleEmitter::SpawnParticle()
 
 
 // OLD UPDATE
-void ParticleEmitter::update()
+template <typename Policies>
+void BasicParticleEmitter<Policies>::update()
+{
+	this->privCreateMemory();
+
+	// same stages the frame graph runs, in program order
+	this->privStageSpawn();
+	this->privStageCompact();
+	this->privStageIntegrate();
+	this->privStageSort();
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::draw()
+{
+	this->privCreateMemory();
+
+	this->privStageCull();
+	this->privStageBuild();
+	this->privStageStats();
+	this->privStageSubmit();
+}
+
+// call after setSortOrder() - the sort stage only exists when sorting
+template <typename Policies>
+void BasicParticleEmitter<Policies>::registerStages(FrameGraph& updateGraph, FrameGraph& drawGraph)
 {
+	// the stages never check for it - the last chance to create it
+	this->privCreateMemory();
+
+	const bool sorting = (this->sortOrder != SortOrder::None);
+
+	// rand() has per thread state in the CRT - spawn stays on the main thread,
+	// it is also the only stage using a shared pool: Random orders it against
+	// the spawns of the emitters sharing it
+	updateGraph.addStage("spawn", this,
+		Stream::Particles,
+		Stream::Particles | Stream::Motion | Stream::Random,
+		&FrameGraph::Call<BasicParticleEmitter, &BasicParticleEmitter::privStageSpawn>, this, true);
+
+	// also grows / trims the memory of every per particle stream
+	updateGraph.addStage("compact", this,
+		Stream::Particles | Stream::Motion,
+		Stream::Particles | Stream::DrawList | Stream::Chunks | Stream::Depth | Stream::Instances,
+		&FrameGraph::Call<BasicParticleEmitter, &BasicParticleEmitter::privStageCompact>, this);
+
+	// the owned path walks the pool instead of the draw list
+	updateGraph.addStage("integrate", this,
+		Stream::DrawList | Stream::Motion | Stream::Rows | Stream::Camera | (this->ownedIntegrate ? Stream::Particles : Stream::None),
+		Stream::Motion | (sorting ? Stream::Depth : Stream::Chunks),
+		&FrameGraph::Call<BasicParticleEmitter, &BasicParticleEmitter::privStageIntegrate>, this);
+
+	if( sorting )
+	{
+		updateGraph.addStage("sort", this,
+			Stream::Depth | Stream::DrawList | Stream::Motion,
+			Stream::DrawList | Stream::Particles | Stream::Chunks,
+			&FrameGraph::Call<BasicParticleEmitter, &BasicParticleEmitter::privStageSort>, this);
+	}
+
+	drawGraph.addStage("cull", this,
+		Stream::Chunks,
+		Stream::Camera | Stream::Visibility,
+		&FrameGraph::Call<BasicParticleEmitter, &BasicParticleEmitter::privStageCull>, this);
+
+	drawGraph.addStage("build", this,
+		Stream::DrawList | Stream::Motion | Stream::Chunks | Stream::Visibility | Stream::Camera,
+		Stream::Rows | Stream::Instances | Stream::SliceStats,
+		&FrameGraph::Call<BasicParticleEmitter, &BasicParticleEmitter::privStageBuild>, this);
+
+	drawGraph.addStage("stats", this,
+		Stream::SliceStats,
+		Stream::CullStats,
+		&FrameGraph::Call<BasicParticleEmitter, &BasicParticleEmitter::privStageStats>, this);
+
+	// OpenGL context lives on the main thread
+	drawGraph.addStage("submit", this,
+		Stream::Instances,
+		Stream::Device,
+		&FrameGraph::Call<BasicParticleEmitter, &BasicParticleEmitter::privStageSubmit>, this, true);
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privStageSpawn()
+{
+	// last frame's draw is done, its scratch can go
+	this->poFrameMemory->reset();
+
+	// last compact's retirees go back first, spawning can reuse their slots
+	this->privRelease();
 
 	// get current time
 	float current_time = globalTimer.GetGlobalTime();
@@ -94,41 +453,393 @@ void ParticleEmitter::update()
 	}
 	
 	// total elapsed
-	time_elapsed = current_time - last_loop;
+	this->frame_elapsed = current_time - last_loop;
+
+	last_loop = current_time;
+}
 
-	Particle *p = this->headParticle;
-	// walk the particles
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privStageCompact()
+{
+	// room for every live particle, then retire the old ones and gather the rest
+	this->privGrow(this->last_active_particle + 1);
+	this->privCompact(this->frame_elapsed);
 
-	while( p != nullptr )
+	// nobody else allocates from an own pool - it takes the retirees back now,
+	// so its live slots are the survivors (see privIntegrateOwned)
+	if( this->ownsPool )
 	{
-		// call every particle and update its position 
-		p->Update(time_elapsed);
+		this->privRelease();
+	}
 
-		// if life is greater that the max_life 
-		// and there is some left on the list
-		// remove node
-		if((last_active_particle > 0) && (p->life > max_life))
+	// SoA copy of what the per particle cull reads, frame scratch
+	FrameArena &arena = this->poFrameMemory->getFrameArena();
+	float **pLanes[7] = { &this->lanes.pPosX, &this->lanes.pPosY, &this->lanes.pPosZ,
+		&this->lanes.pScaleX, &this->lanes.pScaleY, &this->lanes.pScaleZ, &this->lanes.pFresh };
+	for( int k = 0; k < 7; k++ )
+	{
+		*pLanes[k] = arena.allocArray<float>(this->drawCount, 64);
+		assert(*pLanes[k] || this->drawCount == 0);
+	}
+
+	// depths and sort keys for the survivors, frame scratch
+	if( this->sortOrder != SortOrder::None )
+	{
+		this->depthSort.allocate(this->poFrameMemory->getFrameArena(), this->drawCount, this->pJobSystem);
+	}
+
+	// pages a burst left behind go back to the OS
+	this->privTrim();
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privGrow(const int count)
+{
+	const bool ok = this->drawListMemory.ensure(count)
+		&& this->retiredMemory.ensure(count)
+		&& this->chunkMemory.ensure(ChunksFor(count))
+		&& this->instanceMemory.ensure(count);
+	assert(ok);
+	AZUL_UNUSED_VAR(ok);
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privTrim()
+{
+	this->drawListMemory.trim(this->drawCount);
+	this->retiredMemory.trim(this->drawCount);
+	this->chunkMemory.trim(this->chunkCount);
+	this->instanceMemory.trim(this->drawCount);
+}
+
+// spawn stage - the one that may touch a shared pool - or compact on an own pool
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privRelease()
+{
+	for( int i = 0; i < this->retiredCount; i++ )
+	{
+		this->pPool->release(this->pRetired[i]);
+	}
+	this->retiredCount = 0;
+
+	this->pPool->trim();
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privStageIntegrate()
+{
+	// pinned: every thread moves its own partition first, the pass below only reads
+	if( this->ownedIntegrate )
+	{
+		this->privIntegrateOwned(this->frame_elapsed);
+	}
+	const bool integrate = !this->ownedIntegrate;
+
+	if( this->sortOrder == SortOrder::None )
+	{
+		// move the survivors, growing the chunk bounds as we go
+		this->privBuildChunks(this->frame_elapsed, integrate);
+	}
+	else
+	{
+		// move the survivors, depths for the sort
+		this->privIntegrate(this->frame_elapsed, integrate);
+	}
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privStageSort()
+{
+	if( this->sortOrder != SortOrder::None )
+	{
+		// order them by depth, then bound the chunks in draw order
+		this->privSort();
+		this->privBuildChunks(this->frame_elapsed, false);
+	}
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privStageCull()
+{
+	this->privUpdateCamera();
+
+	// whole chunks rejected or accepted before touching any particle
+	auto cull = [this](int begin, int end, int)
+	{
+		for( int c = begin; c < end; c++ )
 		{
-			// particle to remove
-			Particle *s = p;
+			ParticleChunk &chunk = this->pChunks[c];
+#if PARTICLE_CULLING
+			chunk.result = this->frustum.classify(chunk.positionBounds, chunk.scaleBounds, this->camOffset);
+#else
+			chunk.result = CullResult::Inside;
+#endif
+		}
+	};
+	RunSlices(this->pJobSystem, this->chunkCount, cull);
+}
 
-			// need to squirrel it away.
-			p=p->next;
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privStageBuild()
+{
+	// read by the stats stage, same frame
+	this->pSliceStats = this->poFrameMemory->getFrameArena().allocArray<CullStats>(this->sliceCount);
+	assert(this->pSliceStats);
 
-			// remove last node
-			this->removeParticleFromList(s);
+	// build every transform, one job per slice of chunks
+	auto build = [this](int begin, int end, int slice)
+	{
+		this->privBuildTransforms(begin, end, this->pSliceStats[slice]);
+	};
+	RunSlices(this->pJobSystem, this->chunkCount, build);
+}
 
-			// update the number of particles
-			last_active_particle--;
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privStageStats()
+{
+	CullStats &stats = this->cullStats;
+	ResetStats(stats);
+	for( int t = 0; t < this->sliceCount; t++ )
+	{
+		AddStats(stats, this->pSliceStats[t]);
+	}
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privStageSubmit()
+{
+	// single submission on this thread, in draw list order
+	for( int c = 0; c < this->chunkCount; c++ )
+	{
+		const ParticleChunk &chunk = this->pChunks[c];
+		Output::Submit(this->pInstances + chunk.first, chunk.drawn);
+	}
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privCompact(const float time_elapsed)
+{
+	// per thread scratch - life lanes, survivor and retiree indices
+	FrameArena &scratch = this->poFrameMemory->getThreadArena();
+	const size_t mark = scratch.getMark();
+	const int total = this->last_active_particle + 1;
+	float *pLife = scratch.allocArray<float>(total, 64);
+	int32_t *pKeep = scratch.allocArray<int32_t>(total, 64);
+	int32_t *pDrop = scratch.allocArray<int32_t>(total, 64);
+	assert((pLife && pKeep && pDrop) || total == 0);
+
+	// one walk of the list, the only pointer chase left
+	int count = 0;
+	for( Particle *p = this->headParticle; p != nullptr; p = p->next )
+	{
+		this->pDrawList[count] = p;
+		pLife[count] = p->getLife();
+		count++;
+	}
+	assert(count == total);
+
+	// expired or not, SimdWidth() at a time - both compressed in list order
+	const Lifetime &retire = this->lifetime;
+	int numKeep = 0;
+	int numDrop = 0;
+	SimdForEach(count, [&](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		typedef typename V::Mask Mask;
+		typedef typename V::Int Int;
+
+		const Mask active = V::Active(n);
+		const Mask expired = retire.expired(SimdIn<V>(pLife + i, n), time_elapsed) & active;
+		const Int index = Int::Ramp() + Int::Set1(i);
+
+		numDrop += V::CompressStore(pDrop + numDrop, index, expired);
+		numKeep += V::CompressStore(pKeep + numKeep, index, active & ~expired);
+	});
+
+	// there is always one left - if all of them expired, the last in the list
+	if( numKeep == 0 && numDrop > 0 )
+	{
+		pKeep[numKeep++] = pDrop[--numDrop];
+	}
+
+	// remove the retirees, the pool gets them in the next spawn
+	for( int k = 0; k < numDrop; k++ )
+	{
+		Particle *s = this->pDrawList[pDrop[k]];
+		this->privUnlink(s);
+		this->pRetired[this->retiredCount++] = s;
+	}
+	this->last_active_particle -= numDrop;
+
+	// then pack the survivors, pKeep[k] >= k
+	for( int k = 0; k < numKeep; k++ )
+	{
+		this->pDrawList[k] = this->pDrawList[pKeep[k]];
+	}
+
+	scratch.rewind(mark);
+
+	this->drawCount = numKeep;
+	this->chunkCount = ChunksFor(numKeep);
+}
+
+// the integrate loop of this configuration - the policies inline here
+template <typename Policies>
+inline void BasicParticleEmitter<Policies>::privMove(Particle &p, const float time_elapsed, RotationStep &spin)
+{
+	p.Age(time_elapsed);
+	Integrator::Integrate(p, time_elapsed);
+	Force::Apply(p);
+	Rotation::Advance(p, time_elapsed, spin);
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privIntegrate(const float time_elapsed, const bool integrate)
+{
+	float *pDepth = this->depthSort.getDepthBuffer();
+
+	auto depth = [this, pDepth, time_elapsed, integrate](int begin, int end, int)
+	{
+		RotationStep spin;
+		for( int i = begin; i < end; i++ )
+		{
+			Particle *p = this->pDrawList[i];
+
+			if( integrate )
+			{
+				// call every particle and update its position 
+				BasicParticleEmitter::privMove(*p, time_elapsed, spin);
+			}
+
+			pDepth[i] = this->frustum.depth(p->position, p->getScale(), this->camOffset);
+		}
+	};
+	RunSlices(this->pJobSystem, this->drawCount, depth);
+}
+
+// own pool only: the compact released the retirees, so every live slot is a
+// survivor - no list needed
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privIntegrateOwned(const float time_elapsed)
+{
+	const ParticlePool *pParticles = this->pPool;
+
+	auto move = [pParticles, time_elapsed](int begin, int, int)
+	{
+		// begin is the thread index - its partition is on its node
+		RotationStep spin;
+		auto update = [time_elapsed, &spin](Particle *p)
+		{
+			BasicParticleEmitter::privMove(*p, time_elapsed, spin);
+		};
+		pParticles->forEachLive(begin, update);
+	};
+	this->pJobSystem->runOnEachThread(move);
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privSort()
+{
+	this->depthSort.sort(this->pDrawList, this->drawCount, this->sortOrder, this->pJobSystem);
+
+	if( !this->depthSort.getStats().wasSorted )
+	{
+		this->privRelink();
+	}
+}
+
+// list order follows the draw order, next frame's keys arrive nearly sorted
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privRelink()
+{
+	Particle *pPrev = nullptr;
+
+	for( int i = 0; i < this->drawCount; i++ )
+	{
+		Particle *p = this->pDrawList[i];
+		p->prev = pPrev;
+		p->next = nullptr;
+
+		if( pPrev == nullptr )
+		{
+			this->headParticle = p;
 		}
 		else
 		{
-			// increment to next point
-			p = p->next;
+			pPrev->next = p;
 		}
+		pPrev = p;
 	}
+}
 
-	last_loop = current_time;
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privBuildChunks(const float time_elapsed, const bool integrate)
+{
+	// chunks are independent, each job owns a run of them
+	auto build = [this, time_elapsed, integrate](int begin, int end, int)
+	{
+		RotationStep spin;
+
+		// per thread scratch for the moving chunk
+		FrameArena &scratch = this->poFrameMemory->getThreadArena();
+		const size_t mark = scratch.getMark();
+		ParticleBatch batch;
+		if( integrate )
+		{
+			this->privAllocBatch(scratch, batch);
+		}
+
+		for( int c = begin; c < end; c++ )
+		{
+			ParticleChunk &chunk = this->pChunks[c];
+			chunk.first = c * PARTICLE_CHUNK_SIZE;
+			chunk.count = this->drawCount - chunk.first;
+			if( chunk.count > PARTICLE_CHUNK_SIZE )
+			{
+				chunk.count = PARTICLE_CHUNK_SIZE;
+			}
+
+			chunk.positionBounds.reset();
+			chunk.scaleBounds.reset();
+			chunk.freshCount = 0;
+
+			if( integrate )
+			{
+				// the whole chunk moves at once, in its lanes
+				this->privMoveChunk(chunk, batch, time_elapsed, spin);
+			}
+
+			Particle **pList = this->pDrawList + chunk.first;
+			for( int i = 0; i < chunk.count; i++ )
+			{
+				Particle *p = pList[i];
+
+				const Vect4D scale = p->getScale();
+				chunk.positionBounds.add(p->position);
+				chunk.scaleBounds.add(scale);
+				const bool fresh = Rotation::IsFresh(*p);
+				chunk.freshCount += fresh ? 1 : 0;
+
+				const int k = chunk.first + i;
+				this->lanes.pPosX[k] = p->position.x;
+				this->lanes.pPosY[k] = p->position.y;
+				this->lanes.pPosZ[k] = p->position.z;
+				this->lanes.pScaleX[k] = scale.x;
+				this->lanes.pScaleY[k] = scale.y;
+				this->lanes.pScaleZ[k] = scale.z;
+				this->lanes.pFresh[k] = fresh ? 1.0f : 0.0f;
+			}
+		}
+
+		scratch.rewind(mark);
+	};
+	RunSlices(this->pJobSystem, this->chunkCount, build);
+
+	this->bounds.reset();
+	for( int c = 0; c < this->chunkCount; c++ )
+	{
+		this->bounds.merge(this->pChunks[c].positionBounds);
+	}
 }
 	   
 
@@ -142,8 +853,126 @@ void ParticleEmitter::update()
 
 
 
+// everything but the chunk's position lanes
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privAllocBatch(FrameArena &scratch, ParticleBatch &batch) const
+{
+	float **pStreams[12] = { &batch.position.pw,
+		&batch.velocity.px, &batch.velocity.py, &batch.velocity.pz, &batch.velocity.pw,
+		&batch.step.px, &batch.step.py, &batch.step.pz, &batch.step.pw,
+		&batch.pWeight, &batch.pLife, &batch.pDeterminant };
+	for( int k = 0; k < 12; k++ )
+	{
+		*pStreams[k] = scratch.allocArray<float>(PARTICLE_CHUNK_SIZE, 64);
+		assert(*pStreams[k]);
+	}
+	batch.count = 0;
+}
+
+// privMove for a chunk: gathered into streams, x y z straight into the
+// lanes, aged and moved there by the policies, then scattered back - the
+// rotation still goes one particle at a time, in list order
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privMoveChunk(const ParticleChunk &chunk, ParticleBatch &batch, const float time_elapsed, RotationStep &spin)
+{
+	Particle **pList = this->pDrawList + chunk.first;
+	batch.position.px = this->lanes.pPosX + chunk.first;
+	batch.position.py = this->lanes.pPosY + chunk.first;
+	batch.position.pz = this->lanes.pPosZ + chunk.first;
+	batch.count = chunk.count;
+
+	for( int i = 0; i < batch.count; i++ )
+	{
+		const Particle *p = pList[i];
+		const Vect4D vel = p->getVelocity();
+		batch.position.px[i] = p->position.x;
+		batch.position.py[i] = p->position.y;
+		batch.position.pz[i] = p->position.z;
+		batch.position.pw[i] = p->position.w;
+		batch.velocity.px[i] = vel.x;
+		batch.velocity.py[i] = vel.y;
+		batch.velocity.pz[i] = vel.z;
+		batch.velocity.pw[i] = vel.w;
+		batch.pLife[i] = p->life;
+	}
+
+	// Age(), then the integrator and the force
+	float *pLife = batch.pLife;
+	SimdForEach(batch.count, [pLife, time_elapsed](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		SimdOut(SimdIn<V>(pLife + i, n) + V::Set1(time_elapsed), pLife + i, n);
+	});
+	Integrator::Integrate(batch, time_elapsed);
+	Force::Apply(batch);
+
+	if( Rotation::BATCH_KICK )
+	{
+		this->privKickDeterminants(pList, batch);
+	}
+
+	for( int i = 0; i < batch.count; i++ )
+	{
+		Particle *p = pList[i];
+		p->position = Vect4D(batch.position.px[i], batch.position.py[i], batch.position.pz[i], batch.position.pw[i]);
+		p->life = pLife[i];
+
+		const float determinant = Rotation::BATCH_KICK ? batch.pDeterminant[i] : 0.0f;
+		Rotation::Advance(*p, determinant, time_elapsed, spin);
+	}
+}
+
+// Kick()'s determinant for a chunk. Past the second draw the diff rows have
+// a zero last column and Matrix's flags make it 0 - only the fresh ones take
+// the full expansion, SimdWidth() at a time through MatrixArray
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privKickDeterminants(Particle *const *pList, const ParticleBatch &batch) const
+{
+	FrameArena &scratch = this->poFrameMemory->getThreadArena();
+	const size_t mark = scratch.getMark();
+	MatrixStreams diff;
+	for( int e = 0; e < 16; e++ )
+	{
+		diff.pm[e] = scratch.allocArray<float>(batch.count, 64);
+		assert(diff.pm[e]);
+	}
+	int32_t *pFresh = scratch.allocArray<int32_t>(batch.count, 64);
+	float *pFreshDeterminant = scratch.allocArray<float>(batch.count, 64);
+	assert(pFresh && pFreshDeterminant);
+
+	// the fresh particles' diff rows, packed
+	int numFresh = 0;
+	for( int i = 0; i < batch.count; i++ )
+	{
+		const Particle *p = pList[i];
+		batch.pDeterminant[i] = 0.0f;
+
+		if( p->isFresh() )
+		{
+			const Vect4D *pRows[4] = { &p->diff_Row0, &p->diff_Row1, &p->diff_Row2, &p->diff_Row3 };
+			for( int r = 0; r < 4; r++ )
+			{
+				diff.pm[4 * r + 0][numFresh] = pRows[r]->x;
+				diff.pm[4 * r + 1][numFresh] = pRows[r]->y;
+				diff.pm[4 * r + 2][numFresh] = pRows[r]->z;
+				diff.pm[4 * r + 3][numFresh] = pRows[r]->w;
+			}
+			pFresh[numFresh++] = i;
+		}
+	}
+
+	MatrixArray::Determinant(diff, pFreshDeterminant, numFresh);
+	for( int k = 0; k < numFresh; k++ )
+	{
+		batch.pDeterminant[pFresh[k]] = pFreshDeterminant[k];
+	}
+
+	scratch.rewind(mark);
+}
+
 //999 I wonder if changing the little bit from the unopt code would make a diff?
-void ParticleEmitter::addParticleToList(Particle *p )
+template <typename Policies>
+void BasicParticleEmitter<Policies>::addParticleToList(Particle *p )
 {
 	assert(p);
 	if( this->headParticle == nullptr )
@@ -164,7 +993,17 @@ void ParticleEmitter::addParticleToList(Particle *p )
 
 
 // NO CHANGES NEEDED //
-void ParticleEmitter::removeParticleFromList( Particle *p )
+template <typename Policies>
+void BasicParticleEmitter<Policies>::removeParticleFromList( Particle *p )
+{
+	this->privUnlink(p);
+	
+	// bye bye
+	this->pPool->release(p);
+}
+
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privUnlink( Particle *p )
 {
 	// make sure we are not screwed with a null pointer
 	assert(p);
@@ -187,13 +1026,11 @@ void ParticleEmitter::removeParticleFromList( Particle *p )
 		p->prev->next = p->next;
 		p->next->prev = p->prev;
 	}
-	
-	// bye bye
-	delete p;
 }
 
 
-void ParticleEmitter::draw()
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privUpdateCamera()
 {
 	// initialize the camera matrix
 	//Matrix cameraMatrix;
@@ -209,146 +1046,171 @@ void ParticleEmitter::draw()
 	tmp = cameraMatrix * transMatrix;
 
 	// get the inverse matrix
-	Matrix inverseCameraMatrix;
+	Matrix &inverseCameraMatrix = *this->poFrameMemory->getFrameArena().make<Matrix>();
 	tmp.Inverse(inverseCameraMatrix);
 
 
-	// iterate throught the list of particles
-	Particle* temp = this->headParticle;
+	// get the position from this matrix
+	Vect4D camPosVect;
+	inverseCameraMatrix.get(Matrix::MatrixRow::MATRIX_ROW_3, camPosVect); //88
 
-	while (temp != 0)
-	{
+	// camera position
+	//Matrix transCamera;
+	transCamera.setTransMatrix(camPosVect); //88
+
+	this->camOffset = camPosVect;
+}
+
+// runs on the workers - chunk c only writes instances [first, first + count)
+// and its own particles, so slices never overlap
+template <typename Policies>
+void BasicParticleEmitter<Policies>::privBuildTransforms(const int firstChunk, const int lastChunk, CullStats& stats)
+{
+	ResetStats(stats);
+
+	// per thread scratch - the member matrices are shared
+	FrameArena &scratch = this->poFrameMemory->getThreadArena();
+	const size_t mark = scratch.getMark();
+	Affine34 &transParticle = *scratch.make<Affine34>();
+	Affine34 &scaleMatrix = *scratch.make<Affine34>();
+	int32_t *pBuild = scratch.allocArray<int32_t>(PARTICLE_CHUNK_SIZE, 64);
+	int32_t *pVisible = scratch.allocArray<int32_t>(PARTICLE_CHUNK_SIZE, 64);
+	assert(pBuild && pVisible);
 
-		// get the position from this matrix
-		Vect4D camPosVect;
-		inverseCameraMatrix.get(Matrix::MatrixRow::MATRIX_ROW_3, camPosVect); //88
+	// iterate throught the chunks of particles
+	for( int c = firstChunk; c < lastChunk; c++ )
+	{
+		ParticleChunk &chunk = this->pChunks[c];
+		chunk.drawn = 0;
 
-		// camera position
-		//Matrix transCamera;
-		transCamera.setTransMatrix(camPosVect); //88
+		const CullResult result = chunk.result;
 
-		// particle position
-		//Matrix transParticle;
-		transParticle.setTransMatrix(temp->position); //88
+#if PARTICLE_CULLING
+		if( result == CullResult::Outside || result == CullResult::SubPixel )
+		{
+			int &chunkCounter = (result == CullResult::Outside) ? stats.chunksOutside : stats.chunksSubPixel;
+			int &particleCounter = (result == CullResult::Outside) ? stats.particlesCulled : stats.particlesSubPixel;
+			chunkCounter++;
+			if( chunk.freshCount == 0 )
+			{
+				particleCounter += chunk.count;
+				continue;
+			}
+		}
+		else if( result == CullResult::Inside )
+		{
+			stats.chunksInside++;
+		}
+		else
+		{
+			stats.chunksIntersect++;
+		}
+#endif
 
-		// rotation matrix
-		//Matrix rotParticle;
-		rotParticle.setRotZMatrix(temp->rotation);
+		Particle **pList = this->pDrawList + chunk.first;
+		ParticleInstance *pInstance = this->pInstances + chunk.first;
 
-		// scale Matrix
-		scaleMatrix.setScaleMatrix(temp->scale); //55
+		// the particles that need a transform, and which of them are drawn
+		const int numBuild = this->privCullChunk(chunk, pBuild, pVisible, stats);
 
-		// total transformation of particle
-		tmp = scaleMatrix * transCamera * transParticle * rotParticle * scaleMatrix; ///99999 PROXIES!!!!!
+		for( int k = 0; k < numBuild; k++ )
+		{
+			Particle *temp = pList[pBuild[k]];
+			const bool visible = (pVisible[k] != 0);
 
-		// ------------------------------------------------
-		//  Set the Transform Matrix and Draws Triangle
-		//  Note: 
-		//       this method is using doubles... 
-		//       there is a float version (hint)
-		// ------------------------------------------------
-		OpenGLDevice::SetTransformMatrixFloat((const float*)&tmp);
+			// particle position
+			transParticle.setTransMatrix(temp->position); //88
 
-		// squirrel away matrix for next update
-		tmp.get(Matrix::MatrixRow::MATRIX_ROW_0, temp->curr_Row0);		  //88
-		tmp.get(Matrix::MatrixRow::MATRIX_ROW_1, temp->curr_Row1);		  //88
-		tmp.get(Matrix::MatrixRow::MATRIX_ROW_2, temp->curr_Row2);		  //88
-		tmp.get(Matrix::MatrixRow::MATRIX_ROW_3, temp->curr_Row3);		  //88
+			// scale Matrix
+			Vect4D particleScale = temp->getScale();
+			scaleMatrix.setScaleMatrix(particleScale); //55
 
-		// difference vector
-		temp->diff_Row0 = temp->curr_Row0 - temp->prev_Row0;
-		temp->diff_Row1 = temp->curr_Row1 - temp->prev_Row1;
-		temp->diff_Row2 = temp->curr_Row2 - temp->prev_Row2;
-		temp->diff_Row3 = temp->curr_Row3 - temp->prev_Row3;
+			// total transformation of particle - all affine, 3x4 products (see Affine34)
+			// scale * camera * trans * rotation * scale, the rotation is the policy's
+			Affine34 world = scaleMatrix * transCamera * transParticle;
+			Rotation::Orient(*temp, world);
+			world = world * scaleMatrix;
 
+			if( visible )
+			{
+				// packed at the front of the chunk's slice
+				Output::Emit(pInstance[chunk.drawn++], world);
+				stats.particlesDrawn++;
+			}
 
-		// Get the next particle in the list!
-		temp = temp->next;
+			// matrix history for the next update, if the rotation reads it
+			Rotation::Record(*temp, world);
+		}
 	}
 
+	scratch.rewind(mark);
 }
 
-void ParticleEmitter::Execute(Vect4D& pos, Vect4D& vel, Vect4D& sc)
+// SimdWidth() particles per step off the lanes - 16 with AVX-512. pBuild gets
+// the chunk indices to transform (drawn ones and fresh ones), compressed in
+// draw order, pVisible whether each of them is drawn. The culled counters
+// are done here, the drawn one by the caller.
+template <typename Policies>
+int BasicParticleEmitter<Policies>::privCullChunk(const ParticleChunk& chunk, int32_t* pBuild, int32_t* pVisible, CullStats& stats) const
 {
-	// Ses it's ugly - I didn't write this so don't bitch at me
-	// Sometimes code like this is inside real commerical code ( so know you now how it feels )
-	
-	// x - variance
-	float var = static_cast<float>(rand() % 1000) * 0.001f;
-	float sign = static_cast<float>(rand() % 2);
-	float *t_pos = reinterpret_cast<float*>(&pos);
-	float *t_var = &pos_variance[Vect::X];
-	if(sign == 0)
-	{
-		var *= -1.0;
-	}
-	*t_pos += *t_var * var;
+	const CullResult result = chunk.result;
+	const ParticleLanes &l = this->lanes;
+	const int first = chunk.first;
+	int numBuild = 0;
 
-	// y - variance
-	var = static_cast<float>(rand() % 1000) * 0.001f;
-	sign = static_cast<float>(rand() % 2);
-	t_pos++;
-	t_var++;
-	if(sign == 0)
-	{
-		var *= -1.0;
-	}
-	*t_pos += *t_var * var;
-	
-	// z - variance
-	var = static_cast<float>(rand() % 1000) * 0.001f;
-	sign = static_cast<float>(rand() % 2);
-	t_pos++;
-	t_var++;
-	if(sign == 0)
-	{
-		var *= -1.0;
-	}
-	*t_pos += *t_var * var;
-	
-	var = static_cast<float>(rand() % 1000) * 0.001f;
-	sign = static_cast<float>(rand() % 2);
-	
-	// x  - add velocity
-	t_pos = &vel[Vect::X];
-	t_var = &vel_variance[Vect::X];
-	if(sign == 0)
-	{
-		var *= -1.0;
-	}
-	*t_pos += *t_var * var;
-	
-	// y - add velocity
-	var = static_cast<float>(rand() % 1000) * 0.001f;
-	sign = static_cast<float>(rand() % 2);
-	t_pos++;
-	t_var++;
-	if(sign == 0)
-	{
-		var *= -2.0;
-	}
-	*t_pos += *t_var * var;
-	
-	// z - add velocity
-	var = static_cast<float>(rand() % 1000) * 0.001f;
-	sign = static_cast<float>(rand() % 2);
-	t_pos++;
-	t_var++;
-	if(sign == 0)
+	if( result == CullResult::Outside || result == CullResult::SubPixel )
 	{
-		var *= -2.0;
+		int &particleCounter = (result == CullResult::Outside) ? stats.particlesCulled : stats.particlesSubPixel;
+		particleCounter += chunk.count;
 	}
-	*t_pos += *t_var * var;
-	
-	// correct the sign
-	var = 2.0f * static_cast<float>(rand() % 1000) * 0.001f;
-	sign = static_cast<float>(rand() % 2);
-	
-	if(sign == 0)
+
+	SimdForEach(chunk.count, [&](const auto &v, const int i, const int n)
 	{
-		var *= -2.0;
-	}
-	sc = sc * var;	// *= 8888
+		typedef std::decay_t<decltype(v)> V;
+		typedef typename V::Mask Mask;
+		typedef typename V::Int Int;
+
+		// loads past n are 0 - keep those lanes out of every mask
+		const Mask active = V::Active(n);
+		const Mask fresh = V::CmpLT(V::Zero(), SimdIn<V>(l.pFresh + first + i, n)) & active;
+
+		Mask inside = active;
+		if( result == CullResult::Intersect )
+		{
+			const V qx = SimdIn<V>(l.pPosX + first + i, n) + V::Set1(this->camOffset.x);
+			const V qy = SimdIn<V>(l.pPosY + first + i, n) + V::Set1(this->camOffset.y);
+			const V qz = SimdIn<V>(l.pPosZ + first + i, n) + V::Set1(this->camOffset.z);
+
+			Mask outside;
+			Mask subPixel;
+			this->frustum.classifyLanes(qx, qy, qz, SimdIn<V>(l.pScaleX + first + i, n),
+				SimdIn<V>(l.pScaleY + first + i, n), SimdIn<V>(l.pScaleZ + first + i, n), outside, subPixel);
+
+			outside = outside & active;
+			subPixel = subPixel & active;
+			stats.particlesCulled += outside.count();
+			stats.particlesSubPixel += subPixel.count();
+			inside = active & ~(outside | subPixel);
+		}
+		else if( result != CullResult::Inside )
+		{
+			inside = V::CmpLT(V::Zero(), V::Zero());
+		}
+
+		// culled particles drop out here, no branch per particle in the build
+		const Mask build = inside | fresh;
+		const Int index = Int::Ramp() + Int::Set1(i);
+		const Int drawn = V::Select(inside, V::Set1(1.0f), V::Zero()).toInt();
+
+		V::CompressStore(pVisible + numBuild, drawn, build);
+		numBuild += V::CompressStore(pBuild + numBuild, index, build);
+	});
+
+	return numBuild;
 }
 
+// the configurations in use - add one here before declaring its emitter
+template class BasicParticleEmitter<DefaultParticlePolicies>;
+template class BasicParticleEmitter<BallisticParticlePolicies>;
+
 // --- End of File ---
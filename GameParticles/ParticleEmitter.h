@@ -6,59 +6,228 @@
 #define PARTICLEEMITTER_H
 
 #include "Matrix.h"
+#include "Affine34.h"
 #include "Vect4D.h"
+#include "MatrixArray.h"
 #include "Particle.h"
+#include "ParticlePolicies.h"
+#include "BoundingBox.h"
+#include "ViewFrustum.h"
+#include "DepthSort.h"
+#include "ParticlePool.h"
+#include "GrowableArray.h"
+#include "FrameArena.h"
+#include "Settings.h"
+
+class JobSystem;
+class FrameGraph;
 
 //#include <list>
 
-class ParticleEmitter
+// fixed size run of the draw list with the bounds of its particles
+struct ParticleChunk : public Align16
+{
+	BoundingBox positionBounds;
+	BoundingBox scaleBounds;
+	int first;		// index into the draw list
+	int count;
+	int freshCount;	// particles that must be transformed even when culled
+	int drawn;		// visible instances packed at the front of its slice (Instances stream)
+	CullResult result;	// chunk vs frustum, from the cull stage
+};
+
+// position, scale and fresh flag of every particle in draw list order, SoA -
+// written with the chunk bounds, read by the per particle cull (frame arena)
+struct ParticleLanes
+{
+	float	*pPosX;
+	float	*pPosY;
+	float	*pPosZ;
+	float	*pScaleX;
+	float	*pScaleY;
+	float	*pScaleZ;
+	float	*pFresh;		// 1.0f: Particle::isFresh()
+};
+
+// per frame culling counters
+struct CullStats
+{
+	int chunksOutside;
+	int chunksInside;
+	int chunksIntersect;
+	int chunksSubPixel;
+	int particlesCulled;	// outside the frustum
+	int particlesSubPixel;	// in view but below the screen size threshold
+	int particlesDrawn;
+};
+
+// Emitter put together from behavior policies (see ParticlePolicies.h)
+//
+//     Policies is a ParticlePolicies<> configuration. Memory, chunks,
+//     culling, sorting and the frame graph stages are the same for all of
+//     them; the per particle loops call the policies directly, so every
+//     configuration gets its own integrate and build loops with nothing of
+//     the behaviors it leaves out.
+//
+//     The member functions live in ParticleEmitter.cpp - a configuration
+//     is instantiated at the bottom of that file before it can be used.
+//
+//     The pool is only touched by the spawn stage: compact unlinks the
+//     retired particles and the next spawn hands them back. Spawn stages
+//     are ordered by the Random stream, so emitters can share a pool.
+template <typename Policies>
+class BasicParticleEmitter : public Align16
 {
 public:
-	ParticleEmitter();
-	ParticleEmitter(const ParticleEmitter& r) = default;
-	ParticleEmitter& operator= (const ParticleEmitter& r) = default;
-	~ParticleEmitter();
+	typedef typename Policies::Spawn		Spawn;
+	typedef typename Policies::Integrator	Integrator;
+	typedef typename Policies::Force		Force;
+	typedef typename Policies::Rotation		Rotation;
+	typedef typename Policies::Lifetime		Lifetime;
+	typedef typename Policies::Output		Output;
+
+	// storage is reserved for max(maxParticles, reserve) particles
+	explicit BasicParticleEmitter(int maxParticles = NUM_PARTICLES, int reserve = PARTICLE_RESERVE);
+	BasicParticleEmitter(const BasicParticleEmitter& r) = delete;
+	BasicParticleEmitter& operator= (const BasicParticleEmitter& r) = delete;
+	~BasicParticleEmitter();
 	
 	void SpawnParticle();
 	void update();
 	void draw();
 
+	// the same work as update() / draw(), as frame graph stages
+	void registerStages(FrameGraph& updateGraph, FrameGraph& drawGraph);
+
+	void setViewFrustum(const ViewFrustum& f);
+
+	// creates the pool and scratch for its threads - unattached, the first update does
+	void setJobSystem(JobSystem* pJobs);
+
+	// particles from a pool other emitters use too, thread scratch from
+	// pSharedScratch's arenas - only before the first spawn, and before
+	// setJobSystem() so no own pool is created on the way
+	void setSharedMemory(ParticlePool* pSharedPool, FrameMemory* pScratch);
+	void setSortOrder(SortOrder order);
+	const BoundingBox& getBounds() const;
+	const CullStats& getCullStats() const;
+	const DepthSortStats& getSortStats() const;
+	const ParticlePool& getPool() const;
+	int getParticleCount() const;
+
+	// live cap, up to the reserve - memory follows the live count
+	void setMaxParticles(int count);
+	int getMaxParticles() const;
+
+	// seconds between two spawns
+	void setSpawnFrequency(float seconds);
+
+	// reserved / committed / peak bytes of every particle stream and arena
+	void reportMemory() const;
+
+	// the parameters of this emitter's spawn and lifetime policies
+	Spawn& getSpawn();
+	Lifetime& getLifetime();
+
 	void addParticleToList(Particle *p );
 	void removeParticleFromList( Particle *p );
 
-	void Execute(Vect4D& pos, Vect4D& vel, Vect4D& sc);
-
 private:
+	// one update of one particle, the integrate loops inline it
+	static void privMove(Particle &p, const float time_elapsed, RotationStep &spin);
+
+	void privStageSpawn();
+	void privStageCompact();
+	void privStageIntegrate();
+	void privStageSort();
+	void privStageCull();
+	void privStageBuild();
+	void privStageStats();
+	void privStageSubmit();
+
+	void privCreateMemory();
+	void privCompact(const float time_elapsed);
+	void privRelease();
+	void privUnlink(Particle *p);
+	void privGrow(const int count);
+	void privTrim();
+	void privIntegrate(const float time_elapsed, const bool integrate);
+	void privIntegrateOwned(const float time_elapsed);
+	void privSort();
+	void privRelink();
+	void privBuildChunks(const float time_elapsed, const bool integrate);
+	void privAllocBatch(FrameArena &scratch, ParticleBatch &batch) const;
+	void privMoveChunk(const ParticleChunk &chunk, ParticleBatch &batch, const float time_elapsed, RotationStep &spin);
+	void privKickDeterminants(Particle *const *pList, const ParticleBatch &batch) const;
+	void privUpdateCamera();
+	void privBuildTransforms(const int firstChunk, const int lastChunk, CullStats& stats);
+	int privCullChunk(const ParticleChunk& chunk, int32_t* pBuild, int32_t* pVisible, CullStats& stats) const;
 
 	Particle* pNewParticle;
 	Particle* headParticle;
 
-	Vect4D	start_position;
-	Vect4D	start_velocity;
+	Spawn		spawn;
+	Lifetime	lifetime;
 
 	float	spawn_frequency;
 	float	last_spawn;
 	float	last_loop;	
-	float	max_life;
+	float	frame_elapsed;	// spawn stage -> the rest of the update
 	int		max_particles;
+	int		reserved_particles;	// every stream has address space for this many
 	int		last_active_particle;
 	int bufferCount;
-	float	scale_variance;
-	
-	Vect4D	vel_variance;
-	Vect4D	pos_variance;
 	
 	Matrix cameraMatrix;
 	Matrix transMatrix;
 	Matrix tmp;
-	Matrix transCamera;
-	Matrix transParticle;
-	Matrix rotParticle;
-	Matrix pivotParticle;
-	Matrix scaleMatrix;
+	Affine34 transCamera;
+
+	// reserved once, committed as the live count grows - never move
+	GrowableArray<Particle*>		drawListMemory;
+	GrowableArray<Particle*>		retiredMemory;
+	GrowableArray<ParticleChunk>	chunkMemory;
+	GrowableArray<ParticleInstance>	instanceMemory;
 
+	// survivors of this frame in list order, split in chunks
+	Particle**		pDrawList;
+	ParticleChunk*	pChunks;
+
+	// unlinked by the compact, back to the pool in the next spawn
+	Particle**		pRetired;
+	int				retiredCount;
+
+	// same indexing as the draw list, chunks write disjoint slices
+	ParticleInstance*	pInstances;
+	CullStats*		pSliceStats;	// one per job slice, frame arena
+	ParticleLanes	lanes;
+	int				sliceCount;
+	int		drawCount;
+	int		chunkCount;
+
+	BoundingBox		bounds;		// whole emitter
+	ViewFrustum		frustum;
+	CullStats		cullStats;
+
+	// optional depth ordering of the draw list
+	DepthSort		depthSort;
+	SortOrder		sortOrder;
+	JobSystem*		pJobSystem;
+	Vect4D			camOffset;	// camera position in particle space
+
+	// particle storage, partitioned per thread
+	ParticlePool*	pPool;
+	bool			ownsPool;
+	bool			ownedIntegrate;	// pinned threads move their own partition
+
+	// transient buffers, reset when the next frame starts
+	FrameMemory*	poFrameMemory;
+	FrameMemory*	pSharedScratch;	// thread arenas, nullptr: our own
 };
 
+typedef BasicParticleEmitter<DefaultParticlePolicies> ParticleEmitter;
+typedef BasicParticleEmitter<BallisticParticlePolicies> BallisticParticleEmitter;
+
 #endif 
 
 // --- End of File ---
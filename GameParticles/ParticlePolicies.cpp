@@ -0,0 +1,488 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <algorithm>
+#include <math.h>
+#include "OpenGLDevice.h"
+#include "ParticlePolicies.h"
+
+// compared per component by TableSpawn::report()
+static const int SPAWN_COMPONENTS = 7;
+
+static void SpawnComponents(const SpawnState &s, float *pOut)
+{
+	pOut[0] = s.position.x;
+	pOut[1] = s.position.y;
+	pOut[2] = s.position.z;
+	pOut[3] = s.velocity.x;
+	pOut[4] = s.velocity.y;
+	pOut[5] = s.velocity.z;
+	pOut[6] = s.scale.x;	// x y z and w share one factor
+}
+
+static void MeanDeviation(const float *pValues, const int count, double &mean, double &deviation)
+{
+	double sum = 0.0;
+	double sumSq = 0.0;
+	for( int i = 0; i < count; i++ )
+	{
+		sum += pValues[i];
+		sumSq += (double)pValues[i] * pValues[i];
+	}
+	mean = sum / count;
+	const double variance = sumSq / count - mean * mean;
+	deviation = sqrt(variance > 0.0 ? variance : 0.0);
+}
+
+// largest gap between the two empirical CDFs - both sorted, ties step together
+static double KolmogorovSmirnov(const float *pA, const int countA, const float *pB, const int countB)
+{
+	double d = 0.0;
+	int i = 0;
+	int j = 0;
+	while( i < countA && j < countB )
+	{
+		const float v = (pA[i] < pB[j]) ? pA[i] : pB[j];
+		while( i < countA && pA[i] == v )
+		{
+			i++;
+		}
+		while( j < countB && pB[j] == v )
+		{
+			j++;
+		}
+
+		const double gap = fabs((double)i / countA - (double)j / countB);
+		d = (gap > d) ? gap : d;
+	}
+	return d;
+}
+
+VarianceSpawn::VarianceSpawn()
+:	start_position( 0.0f, 2.0f, 2.0f ),
+	start_velocity( -4.0f, 4.0f, 0.0f),
+	pos_variance(1.50f, 0.50f, 10.0f),
+	vel_variance(15.0f, 0.70f, -1.0f),
+	scale_variance(3.0f)
+{
+}
+
+void VarianceSpawn::setStart(const Vect4D &position, const Vect4D &velocity)
+{
+	this->start_position = position;
+	this->start_velocity = velocity;
+}
+
+void VarianceSpawn::setVariance(const Vect4D &position, const Vect4D &velocity)
+{
+	this->pos_variance = position;
+	this->vel_variance = velocity;
+}
+
+const Vect4D &VarianceSpawn::getStartPosition() const
+{
+	return this->start_position;
+}
+
+const Vect4D &VarianceSpawn::getStartVelocity() const
+{
+	return this->start_velocity;
+}
+
+void VarianceSpawn::share(SpawnTable *pTable)
+{
+	AZUL_UNUSED_VAR(pTable);
+}
+
+void VarianceSpawn::prepare()
+{
+	// nothing to draw up front
+}
+
+void VarianceSpawn::init(Particle &p)
+{
+	Vect4D position;
+	Vect4D velocity;
+	Vect4D scale;
+	this->draw(position, velocity, scale);
+	p.Spawn(position, velocity, scale);
+}
+
+void VarianceSpawn::draw(Vect4D &pos, Vect4D &vel, Vect4D &sc)
+{
+	CrtRandom random;
+	this->draw(pos, vel, sc, random);
+}
+
+template <typename Random>
+void VarianceSpawn::draw(Vect4D &pos, Vect4D &vel, Vect4D &sc, Random &random)
+{
+	pos = this->start_position;
+	vel = this->start_velocity;
+	sc  = Vect4D(-1.0, -1.0, -1.0, 1.0);
+
+	// apply the variance
+	this->Execute(pos, vel, sc, random);
+}
+
+SpawnTable::SpawnTable(const int tableSize)
+:	memory(),
+	pStates(nullptr),
+	size(tableSize)
+{
+	assert(tableSize > 0);
+}
+
+void SpawnTable::fill(const VarianceSpawn &source)
+{
+	if( this->pStates == nullptr )
+	{
+		this->memory.create(this->size, this->size, -1, false);
+		this->pStates = this->memory.data();
+		VirtualMemory::Touch(this->pStates, this->memory.getCommittedBytes());
+	}
+
+	// w 0 - adding the offsets keeps the start's w
+	VarianceSpawn offsets(source);
+	offsets.setStart(Vect4D(0.0f, 0.0f, 0.0f, 0.0f), Vect4D(0.0f, 0.0f, 0.0f, 0.0f));
+
+	for( int i = 0; i < this->size; i++ )
+	{
+		SpawnState &s = this->pStates[i];
+		offsets.draw(s.position, s.velocity, s.scale);
+	}
+}
+
+const SpawnState *SpawnTable::getStates() const
+{
+	// fill() first
+	assert(this->pStates);
+	return this->pStates;
+}
+
+int SpawnTable::getSize() const
+{
+	return this->size;
+}
+
+size_t SpawnTable::getCommittedBytes() const
+{
+	return this->memory.getCommittedBytes();
+}
+
+TableSpawn::TableSpawn(const int tableSize)
+:	source(),
+	spawned(),
+	pTable(nullptr),
+	poTable(nullptr),
+	pStates(nullptr),
+	size((unsigned int)tableSize),
+	state(0)
+{
+	assert(tableSize > 0);
+}
+
+TableSpawn::~TableSpawn()
+{
+	delete this->poTable;
+}
+
+VarianceSpawn &TableSpawn::getSource()
+{
+	return this->source;
+}
+
+void TableSpawn::setStart(const Vect4D &position, const Vect4D &velocity)
+{
+	// the table holds offsets, only the sum moves
+	this->source.setStart(position, velocity);
+}
+
+int TableSpawn::getTableSize() const
+{
+	return (int)this->size;
+}
+
+void TableSpawn::share(SpawnTable *_pTable)
+{
+	assert(_pTable);
+
+	if( this->poTable == nullptr )
+	{
+		this->privBind(_pTable);
+	}
+}
+
+void TableSpawn::refill()
+{
+	if( this->poTable == nullptr )
+	{
+		this->poTable = new SpawnTable((int)this->size);
+	}
+	this->poTable->fill(this->source);
+	this->privBind(this->poTable);
+}
+
+void TableSpawn::prepare()
+{
+	if( this->pTable == nullptr )
+	{
+		this->refill();
+	}
+
+	// emitters sharing the table each get their own order
+	if( this->state == 0u )
+	{
+		this->state = (unsigned int)rand() * 2654435761u | 1u;
+	}
+}
+
+void TableSpawn::privBind(SpawnTable *_pTable)
+{
+	// already drawn - an own table by refill(), a shared one by its owner
+	this->pTable = _pTable;
+	this->pStates = _pTable->getStates();
+	this->size = (unsigned int)_pTable->getSize();
+}
+
+void TableSpawn::init(Particle &p)
+{
+	// prepare() ran when the emitter set up
+	assert(this->pStates && this->state != 0u);
+
+	// high bits onto [0, size) with a multiply - no modulo, no low bit bias
+	const unsigned int index = (unsigned int)(((unsigned long long)this->privRandom() * this->size) >> 32);
+
+	// summed in whole registers into a member - Vect4D temporaries cost as much as the copy
+	const SpawnState &s = this->pStates[index];
+	this->spawned.position._m = _mm_add_ps(this->source.getStartPosition()._m, s.position._m);
+	this->spawned.velocity._m = _mm_add_ps(this->source.getStartVelocity()._m, s.velocity._m);
+	p.Spawn(this->spawned.position, this->spawned.velocity, s.scale);
+}
+
+unsigned int TableSpawn::privRandom()
+{
+	// xorshift32 - never 0 once seeded odd
+	unsigned int x = this->state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	this->state = x;
+	return x;
+}
+
+void TableSpawn::report()
+{
+	if( this->pStates == nullptr )
+	{
+		Trace::out("--- TableSpawn: not prepared yet, no table picked ---\n");
+		return;
+	}
+
+	const int count = this->getTableSize();
+
+	// per component columns, table then live
+	float *pTableValues = static_cast<float *>(_mm_malloc(sizeof(float) * SPAWN_COMPONENTS * (size_t)count, 16));
+	float *pLiveValues = static_cast<float *>(_mm_malloc(sizeof(float) * SPAWN_COMPONENTS * (size_t)count, 16));
+	assert(pTableValues && pLiveValues);
+
+	// own generator and spawn order - the emitters' sequences stay where they were
+	LcgRandom random(1u);
+	const unsigned int savedState = this->state;
+
+	float row[SPAWN_COMPONENTS];
+	for( int i = 0; i < count; i++ )
+	{
+		// what init() hands the particle
+		SpawnState entry = this->pStates[i];
+		entry.position += this->source.getStartPosition();
+		entry.velocity += this->source.getStartVelocity();
+		SpawnComponents(entry, row);
+		for( int c = 0; c < SPAWN_COMPONENTS; c++ )
+		{
+			pTableValues[c * count + i] = row[c];
+		}
+
+		SpawnState live;
+		this->source.draw(live.position, live.velocity, live.scale, random);
+		SpawnComponents(live, row);
+		for( int c = 0; c < SPAWN_COMPONENTS; c++ )
+		{
+			pLiveValues[c * count + i] = row[c];
+		}
+	}
+
+	// cost of one spawn, best of a few runs into a scratch particle
+	Particle scratch;
+	double liveNs = 0.0;
+	double tableNs = 0.0;
+	for( int rep = 0; rep < 3; rep++ )
+	{
+		PerformanceTimer timer;
+		timer.Tic();
+		for( int i = 0; i < count; i++ )
+		{
+			SpawnState live;
+			this->source.draw(live.position, live.velocity, live.scale, random);
+			scratch.Spawn(live.position, live.velocity, live.scale);
+		}
+		timer.Toc();
+		const double ns = timer.TimeInSeconds() * 1.0e9 / count;
+		liveNs = (rep == 0 || ns < liveNs) ? ns : liveNs;
+
+		timer.Tic();
+		for( int i = 0; i < count; i++ )
+		{
+			this->init(scratch);
+		}
+		timer.Toc();
+		const double tns = timer.TimeInSeconds() * 1.0e9 / count;
+		tableNs = (rep == 0 || tns < tableNs) ? tns : tableNs;
+	}
+	this->state = savedState;
+
+	// KS 5% critical distance for two samples of count
+	const double critical = 1.36 * sqrt(2.0 / count);
+
+	Trace::out("--- TableSpawn: %d states, %.2f MB %s, table vs %d live draws ---\n",
+		count, (double)this->pTable->getCommittedBytes() / (1024.0 * 1024.0),
+		(this->poTable != nullptr) ? "own" : "shared", count);
+	Trace::out("  component    table mean  table dev   live mean   live dev   KS dist  (5%%: %.4f)\n", critical);
+
+	static const char *names[SPAWN_COMPONENTS] = { "position x", "position y", "position z",
+		"velocity x", "velocity y", "velocity z", "scale" };
+	for( int c = 0; c < SPAWN_COMPONENTS; c++ )
+	{
+		float *pT = pTableValues + c * count;
+		float *pL = pLiveValues + c * count;
+
+		double tableMean;
+		double tableDev;
+		double liveMean;
+		double liveDev;
+		MeanDeviation(pT, count, tableMean, tableDev);
+		MeanDeviation(pL, count, liveMean, liveDev);
+
+		std::sort(pT, pT + count);
+		std::sort(pL, pL + count);
+		const double d = KolmogorovSmirnov(pT, count, pL, count);
+
+		Trace::out("  %-11s %10.4f %10.4f  %10.4f %10.4f   %7.4f  %s\n", names[c],
+			tableMean, tableDev, liveMean, liveDev, d, (d < critical) ? "same" : "DIFFERENT");
+	}
+
+	// the live cost is the CRT's recurrence inline, without rand()'s per thread lookup
+	Trace::out("  spawn: live %.1f ns, table %.1f ns\n", liveNs, tableNs);
+
+	_mm_free(pTableValues);
+	_mm_free(pLiveValues);
+}
+
+void VarianceSpawn::Execute(Vect4D& pos, Vect4D& vel, Vect4D& sc)
+{
+	CrtRandom random;
+	this->Execute(pos, vel, sc, random);
+}
+
+template <typename Random>
+void VarianceSpawn::Execute(Vect4D& pos, Vect4D& vel, Vect4D& sc, Random &random)
+{
+	// Ses it's ugly - I didn't write this so don't bitch at me
+	// Sometimes code like this is inside real commerical code ( so know you now how it feels )
+	
+	// x - variance
+	float var = static_cast<float>(random() % 1000) * 0.001f;
+	float sign = static_cast<float>(random() % 2);
+	float *t_pos = reinterpret_cast<float*>(&pos);
+	float *t_var = &pos_variance[Vect::X];
+	if(sign == 0)
+	{
+		var *= -1.0;
+	}
+	*t_pos += *t_var * var;
+
+	// y - variance
+	var = static_cast<float>(random() % 1000) * 0.001f;
+	sign = static_cast<float>(random() % 2);
+	t_pos++;
+	t_var++;
+	if(sign == 0)
+	{
+		var *= -1.0;
+	}
+	*t_pos += *t_var * var;
+	
+	// z - variance
+	var = static_cast<float>(random() % 1000) * 0.001f;
+	sign = static_cast<float>(random() % 2);
+	t_pos++;
+	t_var++;
+	if(sign == 0)
+	{
+		var *= -1.0;
+	}
+	*t_pos += *t_var * var;
+	
+	var = static_cast<float>(random() % 1000) * 0.001f;
+	sign = static_cast<float>(random() % 2);
+	
+	// x  - add velocity
+	t_pos = &vel[Vect::X];
+	t_var = &vel_variance[Vect::X];
+	if(sign == 0)
+	{
+		var *= -1.0;
+	}
+	*t_pos += *t_var * var;
+	
+	// y - add velocity
+	var = static_cast<float>(random() % 1000) * 0.001f;
+	sign = static_cast<float>(random() % 2);
+	t_pos++;
+	t_var++;
+	if(sign == 0)
+	{
+		var *= -2.0;
+	}
+	*t_pos += *t_var * var;
+	
+	// z - add velocity
+	var = static_cast<float>(random() % 1000) * 0.001f;
+	sign = static_cast<float>(random() % 2);
+	t_pos++;
+	t_var++;
+	if(sign == 0)
+	{
+		var *= -2.0;
+	}
+	*t_pos += *t_var * var;
+	
+	// correct the sign
+	var = 2.0f * static_cast<float>(random() % 1000) * 0.001f;
+	sign = static_cast<float>(random() % 2);
+	
+	if(sign == 0)
+	{
+		var *= -2.0;
+	}
+	sc = sc * var;	// *= 8888
+}
+
+void InstanceOutput::Submit(const ParticleInstance *pInstances, const int count)
+{
+	for( int i = 0; i < count; i++ )
+	{
+		// ------------------------------------------------
+		//  Set the Transform Matrix and Draws Triangle
+		//  Note: 
+		//       this method is using doubles... 
+		//       there is a float version (hint)
+		// ------------------------------------------------
+		Matrix world;
+		pInstances[i].world.toMatrix(world);
+		OpenGLDevice::SetTransformMatrixFloat((const float*)&world);
+	}
+}
+
+// --- End of File ---
@@ -0,0 +1,517 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef PARTICLE_POLICIES_H
+#define PARTICLE_POLICIES_H
+
+#include "Vect4D.h"
+#include "Vect4DArray.h"
+#include "Simd.h"
+#include "Affine34.h"
+#include "Particle.h"
+#include "RotationStep.h"
+#include "GrowableArray.h"
+#include "Settings.h"
+
+// Behaviors an emitter is put together from - see BasicParticleEmitter
+//
+//     One struct per slot, picked at compile time:
+//
+//         Spawn       start state of a new particle      VarianceSpawn, TableSpawn
+//         Integrator  motion from its velocity           EulerIntegrator, NoIntegrator
+//         Force       what else pushes it                SwirlForce, NoForce
+//         Rotation    how it turns                       KickRotation, SpinRotation, NoRotation
+//         Lifetime    when it is retired                 MaxLifeRetire, Immortal
+//         Output      what the build hands the device    InstanceOutput, NoOutput
+//
+//     Integrator, Force, Rotation and Output are static inline functions:
+//     the integrate and build loops are generated per configuration, and an
+//     empty policy leaves no call and no branch behind. Spawn and Lifetime
+//     carry parameters, every emitter owns one of each.
+//
+//     Integrator and Force also take a ParticleBatch, a chunk of particles
+//     as float streams: the unsorted integrate moves a chunk at a time
+//     through Vect4DArray, with the bits of the per particle calls. The
+//     rotation stays per particle, but with BATCH_KICK the chunk's kick
+//     determinants come from MatrixArray first.
+//
+//     Only KickRotation reads the matrix history, so only it makes the build
+//     record the world transform and keep building fresh particles that are
+//     culled (see Particle::isFresh). NoRotation drops the rotation product.
+
+// one slot of the instance buffer, filled by the transform build -
+// 48 bytes, expanded to the 4x4 the device wants at submit
+struct ParticleInstance : public Align16
+{
+	Affine34 world;
+};
+
+// where VarianceSpawn's draws come from - rand() on the live path
+struct CrtRandom
+{
+	int operator()() const
+	{
+		return rand();
+	}
+};
+
+// the CRT's rand() recurrence and range on a state of its own - for a
+// report that must not move the shared sequence the emitters spawn from
+struct LcgRandom
+{
+	explicit LcgRandom(const unsigned int seed)
+	:	state(seed)
+	{
+	}
+
+	int operator()()
+	{
+		this->state = this->state * 214013u + 2531011u;
+		return (int)((this->state >> 16) & 0x7FFFu);
+	}
+
+	unsigned int	state;
+};
+
+class SpawnTable;
+
+// start +- variance per component, 14 rand() calls a particle
+class VarianceSpawn : public Align16
+{
+public:
+	VarianceSpawn();
+	VarianceSpawn(const VarianceSpawn &) = default;
+	VarianceSpawn &operator = (const VarianceSpawn &) = default;
+	~VarianceSpawn() = default;
+
+	void init(Particle &p);
+
+	// the start state init() would give, without a particle
+	void draw(Vect4D &pos, Vect4D &vel, Vect4D &sc);
+
+	// the same, from another generator than rand()
+	template <typename Random>
+	void draw(Vect4D &pos, Vect4D &vel, Vect4D &sc, Random &random);
+
+	void setStart(const Vect4D &position, const Vect4D &velocity);
+	void setVariance(const Vect4D &position, const Vect4D &velocity);
+	const Vect4D &getStartPosition() const;
+	const Vect4D &getStartVelocity() const;
+
+	// no table to share or draw
+	void share(SpawnTable *pTable);
+	void prepare();
+
+	void Execute(Vect4D& pos, Vect4D& vel, Vect4D& sc);
+
+	template <typename Random>
+	void Execute(Vect4D& pos, Vect4D& vel, Vect4D& sc, Random &random);
+
+private:
+	Vect4D	start_position;
+	Vect4D	start_velocity;
+	Vect4D	pos_variance;
+	Vect4D	vel_variance;
+	float	scale_variance;
+};
+
+// one precomputed start state
+struct SpawnState : public Align16
+{
+	Vect4D	position;
+	Vect4D	velocity;
+	Vect4D	scale;
+};
+
+// VarianceSpawn states drawn around a zero start, the start is added at
+// spawn - emitters at different places can draw from one table. Nothing is
+// reserved or drawn until the first fill().
+class SpawnTable : public Align16
+{
+public:
+	explicit SpawnTable(const int tableSize = PARTICLE_SPAWN_TABLE_SIZE);
+	SpawnTable(const SpawnTable &) = delete;
+	SpawnTable &operator = (const SpawnTable &) = delete;
+	~SpawnTable() = default;
+
+	// every entry drawn again with source's variances, its start ignored
+	void fill(const VarianceSpawn &source);
+
+	const SpawnState *getStates() const;
+	int getSize() const;
+	size_t getCommittedBytes() const;
+
+private:
+	GrowableArray<SpawnState>	memory;
+	SpawnState		*pStates;	// nullptr until drawn
+	int				size;
+};
+
+// VarianceSpawn drawn once up front - PARTICLE_SPAWN_TABLE
+//
+//     A spawn is one copy out of a SpawnTable plus the start: no rand(), no
+//     branches. The table is the one share() hands over - an EmitterSystem
+//     draws one for all its emitters when it builds - or else one of its own,
+//     drawn by prepare() when the emitter sets up, before the first frame.
+//     refill() after changing the source's variances draws an own table from
+//     them; the start only moves what is added.
+//
+//     Every spawn picks its entry with a step of its own xorshift, scaled
+//     onto the table by its high bits - no fixed stride, so no period or
+//     correlation tied to the table size, at the cost of sampling with
+//     replacement: the table's histogram is spawned on average rather than
+//     exactly once a pass.
+//
+//     report() draws as many states from the live recurrence on a private
+//     generator and prints mean, deviation and the two sample
+//     Kolmogorov-Smirnov distance per component, plus the cost of a spawn
+//     both ways. It leaves rand() and the spawn order where they were, so
+//     it only reports once prepare() has picked the table.
+class TableSpawn : public Align16
+{
+public:
+	explicit TableSpawn(const int tableSize = PARTICLE_SPAWN_TABLE_SIZE);
+	TableSpawn(const TableSpawn &) = delete;
+	TableSpawn &operator = (const TableSpawn &) = delete;
+	~TableSpawn();
+
+	void init(Particle &p);
+
+	// the live path's parameters - refill() draws an own table from them
+	VarianceSpawn &getSource();
+	void refill();
+
+	// draw from pTable - an own table stays
+	void share(SpawnTable *pTable);
+
+	// own table unless one is shared, and the spawn order's seed
+	void prepare();
+
+	void setStart(const Vect4D &position, const Vect4D &velocity);
+
+	int getTableSize() const;
+	void report();
+
+private:
+	void privBind(SpawnTable *pTable);
+	unsigned int privRandom();
+
+	VarianceSpawn	source;
+	SpawnState		spawned;	// start plus the picked entry
+	SpawnTable		*pTable;	// shared or poTable
+	SpawnTable		*poTable;
+	const SpawnState	*pStates;	// pTable's states, nullptr until one is bound
+	unsigned int	size;
+	unsigned int	state;		// xorshift, 0 until prepare() seeds it from rand()
+};
+
+// one chunk's moving state, SoA - the integrate gathers it from the
+// particles, the batch policies update it in place, it is scattered back
+struct ParticleBatch
+{
+	Vect4DStreams	position;
+	Vect4DStreams	velocity;
+	Vect4DStreams	step;		// scratch for the policies
+	float			*pWeight;	// scratch, one per particle
+	float			*pLife;		// aged already
+	float			*pDeterminant;	// of the diff rows, when Rotation::BATCH_KICK
+	int				count;
+};
+
+struct EulerIntegrator
+{
+	static void Integrate(Particle &p, const float time_elapsed)
+	{
+		p.Move(time_elapsed);
+	}
+
+	// scale then add, unfused like Move()
+	static void Integrate(const ParticleBatch &b, const float time_elapsed)
+	{
+		Vect4DArray::Scale(b.velocity, time_elapsed, b.step, b.count);
+		Vect4DArray::Add(b.position, b.step, b.position, b.count);
+	}
+};
+
+// particles stay where they spawned
+struct NoIntegrator
+{
+	static void Integrate(Particle &p, const float time_elapsed)
+	{
+		AZUL_UNUSED_VAR(p);
+		AZUL_UNUSED_VAR(time_elapsed);
+	}
+
+	static void Integrate(const ParticleBatch &b, const float time_elapsed)
+	{
+		AZUL_UNUSED_VAR(b);
+		AZUL_UNUSED_VAR(time_elapsed);
+	}
+};
+
+// the original drift around the z axis, growing with the age
+struct SwirlForce
+{
+	static void Apply(Particle &p)
+	{
+		p.Swirl();
+	}
+
+	// Swirl() step for step: position x z, normalized, * (life * 0.05) -
+	// the expression folds the two scalars first (see VecScale)
+	static void Apply(const ParticleBatch &b)
+	{
+		const float *pLife = b.pLife;
+		float *pWeight = b.pWeight;
+		SimdForEach(b.count, [pLife, pWeight](const auto &v, const int i, const int n)
+		{
+			typedef std::decay_t<decltype(v)> V;
+			SimdOut(SimdIn<V>(pLife + i, n) * V::Set1(0.05f), pWeight + i, n);
+		});
+
+		const Vect4D z_axis(0.0f, 0.0f, 3.0f);
+		Vect4DArray::CrossConst(b.position, z_axis, b.step, b.count);
+		Vect4DArray::Normalize(b.step, b.step, b.count);
+		Vect4DArray::Scale(b.step, pWeight, b.step, b.count);
+		Vect4DArray::Add(b.position, b.step, b.position, b.count);
+	}
+};
+
+struct NoForce
+{
+	static void Apply(Particle &p)
+	{
+		AZUL_UNUSED_VAR(p);
+	}
+
+	static void Apply(const ParticleBatch &b)
+	{
+		AZUL_UNUSED_VAR(b);
+	}
+};
+
+// rotation velocity plus the one time kick from the determinant of the
+// last transform change - the original behavior
+struct KickRotation
+{
+	// the chunk integrate works the diff determinants out first
+	static const bool BATCH_KICK = true;
+
+	static void Advance(Particle &p, const float time_elapsed, RotationStep &spin)
+	{
+		const float kick = p.Kick();
+		p.Spin(kick + p.getRotationVelocity() * time_elapsed * 2, spin);
+	}
+
+	static void Advance(Particle &p, const float determinant, const float time_elapsed, RotationStep &spin)
+	{
+		const float kick = p.Kick(determinant);
+		p.Spin(kick + p.getRotationVelocity() * time_elapsed * 2, spin);
+	}
+
+	// world * rotation
+	static void Orient(const Particle &p, Affine34 &world)
+	{
+		Affine34 rot;
+		p.getRotation(rot);
+		world = world * rot;
+	}
+
+	static bool IsFresh(const Particle &p)
+	{
+		return p.isFresh();
+	}
+
+	static void Record(Particle &p, const Affine34 &world)
+	{
+		p.Record(world);
+	}
+};
+
+// rotation velocity only, no matrix history
+struct SpinRotation
+{
+	static const bool BATCH_KICK = false;
+
+	static void Advance(Particle &p, const float time_elapsed, RotationStep &spin)
+	{
+		p.Spin(p.getRotationVelocity() * time_elapsed * 2, spin);
+	}
+
+	static void Advance(Particle &p, const float determinant, const float time_elapsed, RotationStep &spin)
+	{
+		AZUL_UNUSED_VAR(determinant);
+		SpinRotation::Advance(p, time_elapsed, spin);
+	}
+
+	static void Orient(const Particle &p, Affine34 &world)
+	{
+		KickRotation::Orient(p, world);
+	}
+
+	static bool IsFresh(const Particle &p)
+	{
+		AZUL_UNUSED_VAR(p);
+		return false;
+	}
+
+	static void Record(Particle &p, const Affine34 &world)
+	{
+		AZUL_UNUSED_VAR(p);
+		AZUL_UNUSED_VAR(world);
+	}
+};
+
+struct NoRotation
+{
+	static const bool BATCH_KICK = false;
+
+	static void Advance(Particle &p, const float time_elapsed, RotationStep &spin)
+	{
+		AZUL_UNUSED_VAR(p);
+		AZUL_UNUSED_VAR(time_elapsed);
+		AZUL_UNUSED_VAR(spin);
+	}
+
+	static void Advance(Particle &p, const float determinant, const float time_elapsed, RotationStep &spin)
+	{
+		AZUL_UNUSED_VAR(determinant);
+		NoRotation::Advance(p, time_elapsed, spin);
+	}
+
+	static void Orient(const Particle &p, Affine34 &world)
+	{
+		AZUL_UNUSED_VAR(p);
+		AZUL_UNUSED_VAR(world);
+	}
+
+	static bool IsFresh(const Particle &p)
+	{
+		return SpinRotation::IsFresh(p);
+	}
+
+	static void Record(Particle &p, const Affine34 &world)
+	{
+		SpinRotation::Record(p, world);
+	}
+};
+
+// retired once the age passes max life - as long as one is left
+class MaxLifeRetire
+{
+public:
+	explicit MaxLifeRetire(const float maxLife = MAX_LIFE)
+	:	max_life(maxLife)
+	{
+	}
+
+	bool expired(const Particle &p, const float time_elapsed) const
+	{
+		return (p.getLife() + time_elapsed) > this->max_life;
+	}
+
+	// the same compare over lanes of life, for the compact
+	template <typename V>
+	typename V::Mask expired(const V &life, const float time_elapsed) const
+	{
+		return V::CmpLT(V::Set1(this->max_life), life + V::Set1(time_elapsed));
+	}
+
+	void setMaxLife(const float maxLife)
+	{
+		this->max_life = maxLife;
+	}
+
+	float getMaxLife() const
+	{
+		return this->max_life;
+	}
+
+private:
+	float	max_life;
+};
+
+// never retired - the emitter fills up to its max and stops spawning
+class Immortal
+{
+public:
+	bool expired(const Particle &p, const float time_elapsed) const
+	{
+		AZUL_UNUSED_VAR(p);
+		AZUL_UNUSED_VAR(time_elapsed);
+		return false;
+	}
+
+	template <typename V>
+	typename V::Mask expired(const V &life, const float time_elapsed) const
+	{
+		AZUL_UNUSED_VAR(life);
+		AZUL_UNUSED_VAR(time_elapsed);
+		return V::CmpLT(V::Zero(), V::Zero());
+	}
+
+	// no max life to set
+	void setMaxLife(const float maxLife)
+	{
+		AZUL_UNUSED_VAR(maxLife);
+	}
+};
+
+// one float transform per drawn particle, on the main thread
+struct InstanceOutput
+{
+	static void Emit(ParticleInstance &slot, const Affine34 &world)
+	{
+		slot.world = world;
+	}
+
+	static void Submit(const ParticleInstance *pInstances, const int count);
+};
+
+// simulation only - culled and counted, nothing reaches the device
+struct NoOutput
+{
+	static void Emit(ParticleInstance &slot, const Affine34 &world)
+	{
+		AZUL_UNUSED_VAR(slot);
+		AZUL_UNUSED_VAR(world);
+	}
+
+	static void Submit(const ParticleInstance *pInstances, const int count)
+	{
+		AZUL_UNUSED_VAR(pInstances);
+		AZUL_UNUSED_VAR(count);
+	}
+};
+
+// a configuration: one policy per slot
+template <typename SpawnPolicy = VarianceSpawn,
+	typename IntegratorPolicy = EulerIntegrator,
+	typename ForcePolicy = SwirlForce,
+	typename RotationPolicy = KickRotation,
+	typename LifetimePolicy = MaxLifeRetire,
+	typename OutputPolicy = InstanceOutput>
+struct ParticlePolicies
+{
+	typedef SpawnPolicy			Spawn;
+	typedef IntegratorPolicy	Integrator;
+	typedef ForcePolicy			Force;
+	typedef RotationPolicy		Rotation;
+	typedef LifetimePolicy		Lifetime;
+	typedef OutputPolicy		Output;
+};
+
+// the original emitter - spawning from a table with PARTICLE_SPAWN_TABLE
+#if PARTICLE_SPAWN_TABLE
+typedef ParticlePolicies<TableSpawn> DefaultParticlePolicies;
+#else
+typedef ParticlePolicies<> DefaultParticlePolicies;
+#endif
+
+// straight lines and a steady spin - no swirl, no matrix history
+typedef ParticlePolicies<VarianceSpawn, EulerIntegrator, NoForce, SpinRotation> BallisticParticlePolicies;
+
+#endif
+
+// --- End of File ---
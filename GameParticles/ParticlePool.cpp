@@ -0,0 +1,247 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <algorithm>
+#include <functional>
+#include "ParticlePool.h"
+#include "JobSystem.h"
+
+ParticlePool::ParticlePool(int reserve, int base, JobSystem *_pJobs, bool tryLargePages)
+	: poPartitions(nullptr),
+	numPartitions((_pJobs != nullptr) ? _pJobs->getNumThreads() : 1),
+	live(0),
+	nextPartition(0),
+	pJobs(_pJobs),
+	prefaultMs(0.0f)
+{
+	assert(base > 0 && reserve >= base);
+
+	const int maxPerPartition = (reserve + this->numPartitions - 1) / this->numPartitions;
+	const int basePerPartition = (base + this->numPartitions - 1) / this->numPartitions;
+
+	this->poPartitions = new Partition[(unsigned int)this->numPartitions];
+	for( int i = 0; i < this->numPartitions; i++ )
+	{
+		Partition &part = this->poPartitions[i];
+		part.numFree = 0;
+		part.highWater = 0;
+		part.live = 0;
+		part.node = (_pJobs != nullptr) ? _pJobs->getThreadNode(i) : -1;
+
+		// base committed, not touched yet - no physical page
+		const int nodeNumber = (part.node >= 0) ? (int)_pJobs->getTopology().getNodeNumber(part.node) : -1;
+		part.slots.create(maxPerPartition, basePerPartition, nodeNumber, tryLargePages);
+
+		// bookkeeping follows the slots, large pages or not
+		const int maxSlots = part.slots.getMaxCount();
+		part.alive.create(maxSlots, basePerPartition, nodeNumber, false);
+		part.freeSlots.create(maxSlots, basePerPartition, nodeNumber, false);
+	}
+
+	// every thread faults in the pages of its own partition
+	PerformanceTimer timer;
+	timer.Tic();
+	if( _pJobs != nullptr )
+	{
+		_pJobs->runOnEachThread(&ParticlePool::privTouch, this);
+	}
+	else
+	{
+		ParticlePool::privTouch(this, 0, 1, 0);
+	}
+	timer.Toc();
+	this->prefaultMs = (float)timer.TimeInSeconds() * 1000.0f;
+}
+
+ParticlePool::~ParticlePool()
+{
+	// particles are plain data, the emitter released the live ones
+	assert(this->live == 0);
+
+	delete[] this->poPartitions;
+}
+
+void ParticlePool::privTouch(void *pContext, int begin, int, int)
+{
+	const Partition &part = static_cast<const ParticlePool *>(pContext)->poPartitions[begin];
+
+	// large pages are resident from the start
+	if( !part.slots.isLarge() )
+	{
+		VirtualMemory::Touch(part.slots.data(), part.slots.getCommittedBytes());
+	}
+	VirtualMemory::Touch(part.alive.data(), part.alive.getCommittedBytes());
+	VirtualMemory::Touch(part.freeSlots.data(), part.freeSlots.getCommittedBytes());
+}
+
+bool ParticlePool::privGrow(Partition &part, int count)
+{
+	return part.slots.ensure(count)
+		&& part.alive.ensure(count)
+		&& part.freeSlots.ensure(count);
+}
+
+Particle *ParticlePool::alloc()
+{
+	for( int tries = 0; tries < this->numPartitions; tries++ )
+	{
+		Partition &part = this->poPartitions[this->nextPartition];
+		this->nextPartition = (this->nextPartition + 1 < this->numPartitions) ? this->nextPartition + 1 : 0;
+
+		int *pFree = part.freeSlots.data();
+
+		int slot;
+		if( part.numFree > 0 )
+		{
+			std::pop_heap(pFree, pFree + part.numFree, std::greater<int>());
+			slot = pFree[--part.numFree];
+		}
+		else if( this->privGrow(part, part.highWater + 1) )
+		{
+			slot = part.highWater++;
+		}
+		else
+		{
+			continue;
+		}
+
+		part.alive.data()[slot] = 1;
+		part.live++;
+		this->live++;
+
+		Particle *p;
+		AZUL_PLACEMENT_NEW_BEGIN
+		#undef new
+			p = ::new(part.slots.data() + slot) Particle();
+		AZUL_PLACEMENT_NEW_END
+
+		return p;
+	}
+
+	return nullptr;
+}
+
+void ParticlePool::release(Particle *p)
+{
+	assert(p);
+
+	for( int i = 0; i < this->numPartitions; i++ )
+	{
+		Partition &part = this->poPartitions[i];
+		Particle *pSlots = part.slots.data();
+
+		if( p >= pSlots && p < pSlots + part.highWater )
+		{
+			const int slot = (int)(p - pSlots);
+			assert(part.alive.data()[slot]);
+
+			p->~Particle();
+
+			int *pFree = part.freeSlots.data();
+			part.alive.data()[slot] = 0;
+			pFree[part.numFree++] = slot;
+			std::push_heap(pFree, pFree + part.numFree, std::greater<int>());
+
+			part.live--;
+			this->live--;
+			return;
+		}
+	}
+
+	// not one of ours
+	assert(false);
+}
+
+void ParticlePool::trim()
+{
+	for( int i = 0; i < this->numPartitions; i++ )
+	{
+		Partition &part = this->poPartitions[i];
+		const unsigned char *pAlive = part.alive.data();
+
+		const int oldHighWater = part.highWater;
+		while( part.highWater > 0 && !pAlive[part.highWater - 1] )
+		{
+			part.highWater--;
+		}
+
+		if( part.highWater != oldHighWater )
+		{
+			// drop the free slots above the new mark, the rest stays a heap
+			int *pFree = part.freeSlots.data();
+			int kept = 0;
+			for( int f = 0; f < part.numFree; f++ )
+			{
+				if( pFree[f] < part.highWater )
+				{
+					pFree[kept++] = pFree[f];
+				}
+			}
+			part.numFree = kept;
+			std::make_heap(pFree, pFree + part.numFree, std::greater<int>());
+		}
+
+		part.slots.trim(part.highWater);
+		part.alive.trim(part.highWater);
+		part.freeSlots.trim(part.highWater);
+	}
+}
+
+int ParticlePool::getMaxCapacity() const
+{
+	int total = 0;
+	for( int i = 0; i < this->numPartitions; i++ )
+	{
+		total += this->poPartitions[i].slots.getMaxCount();
+	}
+	return total;
+}
+
+int ParticlePool::getLiveCount() const
+{
+	return this->live;
+}
+
+int ParticlePool::getNumPartitions() const
+{
+	return this->numPartitions;
+}
+
+size_t ParticlePool::getCommittedBytes() const
+{
+	size_t total = 0;
+	for( int i = 0; i < this->numPartitions; i++ )
+	{
+		const Partition &part = this->poPartitions[i];
+		total += part.slots.getCommittedBytes() + part.alive.getCommittedBytes() + part.freeSlots.getCommittedBytes();
+	}
+	return total;
+}
+
+void ParticlePool::report() const
+{
+	Trace::out("--- ParticlePool: up to %d particles, %d partitions, %d bytes per particle, pre-faulted in %.2f ms ---\n",
+		this->getMaxCapacity(), this->numPartitions, (int)sizeof(Particle), this->prefaultMs);
+
+	for( int i = 0; i < this->numPartitions; i++ )
+	{
+		const Partition &part = this->poPartitions[i];
+		const int core = (this->pJobs != nullptr) ? this->pJobs->getThreadCore(i) : -1;
+
+		if( part.node >= 0 )
+		{
+			Trace::out("  partition %2d: thread %2d  core %3d  node %lu  live %d  high water %d\n",
+				i, i, core, (unsigned long)this->pJobs->getTopology().getNodeNumber(part.node),
+				part.live, part.highWater);
+		}
+		else
+		{
+			Trace::out("  partition %2d: thread %2d  unpinned  live %d  high water %d\n",
+				i, i, part.live, part.highWater);
+		}
+		part.slots.report("  slots");
+	}
+}
+
+// --- End of File ---
@@ -0,0 +1,96 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef PARTICLE_POOL_H
+#define PARTICLE_POOL_H
+
+#include "Particle.h"
+#include "GrowableArray.h"
+
+class JobSystem;
+
+// Growable particle storage, one partition per job system thread
+//
+//     Each partition is a reserved virtual range placed on the NUMA node of
+//     its thread. The base capacity is committed up front and first touched
+//     by the owner thread (runOnEachThread), so a pinned thread that only
+//     moves its own partition stays in local memory and the first frames
+//     never fault. Past the base, pages are committed as slots are first
+//     used, up to the reserve, and trim() decommits them again after a burst.
+//
+//     Large pages (tryLargePages, if the OS lets us) cut TLB misses but are
+//     fixed - the pool can't grow past the base then.
+//
+//     alloc() deals slots round robin over the partitions and hands out the
+//     lowest free slot of a partition, so the live slots stay packed at the
+//     bottom and the top can be trimmed. Live flags let forEachLive() walk
+//     one partition without the particle list.
+class ParticlePool
+{
+public:
+	// pJobs: nullptr for a single partition
+	ParticlePool(int reserve, int base, JobSystem *pJobs, bool tryLargePages);
+	ParticlePool() = delete;
+	ParticlePool(const ParticlePool &) = delete;
+	ParticlePool &operator = (const ParticlePool &) = delete;
+	~ParticlePool();
+
+	// constructed particle, nullptr when full
+	Particle *alloc();
+	void release(Particle *p);
+
+	// lowers the high water marks and decommits the spare pages
+	void trim();
+
+	int getMaxCapacity() const;		// largest pool it can grow to
+	int getLiveCount() const;
+	int getNumPartitions() const;
+	size_t getCommittedBytes() const;
+
+	// f(Particle *) on every live particle of the partition, in slot order
+	template <typename F>
+	void forEachLive(int partition, F &f) const
+	{
+		const Partition &part = this->poPartitions[partition];
+		Particle *pSlots = part.slots.data();
+		const unsigned char *pAlive = part.alive.data();
+
+		for( int i = 0; i < part.highWater; i++ )
+		{
+			if( pAlive[i] )
+			{
+				f(pSlots + i);
+			}
+		}
+	}
+
+	// partition -> node, pages, committed bytes and live count
+	void report() const;
+
+private:
+	struct Partition
+	{
+		GrowableArray<Particle>			slots;
+		GrowableArray<unsigned char>	alive;
+		GrowableArray<int>				freeSlots;		// min heap
+		int				numFree;
+		int				highWater;		// slots [0, highWater) handed out at least once
+		int				live;
+		int				node;			// dense topology index, -1: any
+	};
+
+	bool privGrow(Partition &part, int count);
+	static void privTouch(void *pContext, int begin, int end, int slice);
+
+	Partition	*poPartitions;
+	int			numPartitions;
+	int			live;
+	int			nextPartition;		// round robin
+	JobSystem	*pJobs;
+	float		prefaultMs;			// construction time spent faulting pages in
+};
+
+#endif
+
+// --- End of File ---
@@ -0,0 +1,78 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <thread>
+#include "PinBenchmark.h"
+#include "Settings.h"
+#include "ParticleEmitter.h"
+#include "JobSystem.h"
+#include "FrameGraph.h"
+
+// no more than this many warm up frames, the pool may never fill on a slow box
+static const int MAX_WARM_UP_FRAMES = 100000;
+
+double PinBenchmark::privTimeUpdate(int numThreads, PinMode mode, int frames)
+{
+	JobSystem jobs(numThreads - 1, WORKER_SPIN_BUDGET, mode);
+
+	ParticleEmitter emitter;
+	emitter.setJobSystem(&jobs);
+
+	// the draw graph is never run, it only has to exist for registerStages()
+	FrameGraph updateGraph("bench update");
+	FrameGraph drawGraph("bench draw");
+	emitter.registerStages(updateGraph, drawGraph);
+	updateGraph.compile();
+
+	// steady state - every slot taken
+	for( int i = 0; i < MAX_WARM_UP_FRAMES && emitter.getParticleCount() < NUM_PARTICLES; i++ )
+	{
+		updateGraph.execute(&jobs);
+	}
+
+	PerformanceTimer timer;
+	timer.Tic();
+	for( int i = 0; i < frames; i++ )
+	{
+		updateGraph.execute(&jobs);
+	}
+	timer.Toc();
+
+	return timer.TimeInSeconds() * 1000.0 / (double)frames;
+}
+
+void PinBenchmark::Run(int frames, PinMode pinned)
+{
+	assert(frames > 0);
+
+	if( pinned == PinMode::None )
+	{
+		pinned = PinMode::Compact;
+	}
+
+	int hw = (int)std::thread::hardware_concurrency();
+	hw = (hw > 0) ? hw : 1;
+
+	Trace::out("--- PinBenchmark: %d particles, %d frames, update ms/frame ---\n", NUM_PARTICLES, frames);
+	Trace::out("  threads   unpinned     pinned    speedup\n");
+
+	// powers of two, then every hardware thread
+	int threads = 1;
+	while( true )
+	{
+		const double unpinnedMs = PinBenchmark::privTimeUpdate(threads, PinMode::None, frames);
+		const double pinnedMs = PinBenchmark::privTimeUpdate(threads, pinned, frames);
+
+		Trace::out("  %7d  %9.4f  %9.4f  %8.2fx\n", threads, unpinnedMs, pinnedMs,
+			(pinnedMs > 0.0) ? unpinnedMs / pinnedMs : 0.0);
+
+		if( threads == hw )
+		{
+			break;
+		}
+		threads = (threads * 2 < hw) ? threads * 2 : hw;
+	}
+}
+
+// --- End of File ---
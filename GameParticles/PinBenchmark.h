@@ -0,0 +1,29 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef PIN_BENCHMARK_H
+#define PIN_BENCHMARK_H
+
+#include "Enum.h"
+
+// Update scaling, unpinned vs pinned
+//
+//     For 1, 2, 4 ... threads up to the hardware count, a fresh job system
+//     and emitter run the update graph until the pool is full, then time
+//     the next frames. The same runs are done unpinned and pinned, so the
+//     table shows what pinning plus owned partitions buy on this machine.
+//
+//     Uses rand() - run it before seeding the real emitter.
+class PinBenchmark
+{
+public:
+	static void Run(int frames, PinMode pinned);
+
+private:
+	static double privTimeUpdate(int numThreads, PinMode mode, int frames);
+};
+
+#endif
+
+// --- End of File ---
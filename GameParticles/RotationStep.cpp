@@ -0,0 +1,56 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <Math.h>
+#include "RotationStep.h"
+
+// past this the polynomials lose digits - at 0.25 the next terms are below 1e-9
+static const float SMALL_STEP = 0.25f;
+
+RotationStep::RotationStep()
+	: delta(0.0f),
+	cosDelta(1.0f),
+	sinDelta(0.0f)
+{
+}
+
+void RotationStep::Apply(const float d, float &c, float &s)
+{
+	float cd;
+	float sd;
+
+	if( d == this->delta )
+	{
+		cd = this->cosDelta;
+		sd = this->sinDelta;
+	}
+	else if( fabsf(d) < SMALL_STEP )
+	{
+		// Taylor to d^6 / d^7
+		const float d2 = d * d;
+		cd = 1.0f - d2 * (1.0f / 2.0f) * (1.0f - d2 * (1.0f / 12.0f) * (1.0f - d2 * (1.0f / 30.0f)));
+		sd = d * (1.0f - d2 * (1.0f / 6.0f) * (1.0f - d2 * (1.0f / 20.0f) * (1.0f - d2 * (1.0f / 42.0f))));
+
+		this->delta = d;
+		this->cosDelta = cd;
+		this->sinDelta = sd;
+	}
+	else
+	{
+		// the kick - rare, keep the shared step cached
+		cd = cosf(d);
+		sd = sinf(d);
+	}
+
+	const float c1 = c * cd - s * sd;
+	const float s1 = s * cd + c * sd;
+
+	// 1 / sqrt(len2) ~ (3 - len2) / 2 next to 1
+	const float k = 1.5f - 0.5f * (c1 * c1 + s1 * s1);
+
+	c = c1 * k;
+	s = s1 * k;
+}
+
+// --- End of File ---
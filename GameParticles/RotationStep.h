@@ -0,0 +1,46 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef ROTATION_STEP_H
+#define ROTATION_STEP_H
+
+// (cos d, sin d) of a rotation step - PARTICLE_INCREMENTAL_ROTATION
+//
+//     The particle keeps its angle as a unit (cos, sin) pair and turns it by
+//     angle addition, so neither Spin() nor the build calls sin / cos:
+//
+//         c' = c cos d - s sin d
+//         s' = s cos d + c sin d
+//
+//     Every particle turns by the same d = rotation velocity * dt * 2 but for
+//     its one time kick (see Particle.h), so a batch of updates keeps one
+//     RotationStep and the pair for d is worked out once - a short
+//     polynomial, the step is well under a radian. The kick can be any size,
+//     it goes to sinf / cosf and leaves the shared step alone.
+//
+//     Rounding walks |(c, s)| away from 1. Apply() pulls it back each time
+//     with one Newton step of 1 / sqrt, a few multiplies - cheaper than
+//     counting frames for a periodic fix, and the length never drifts past
+//     the float epsilon.
+class RotationStep
+{
+public:
+	RotationStep();
+	RotationStep(const RotationStep &) = default;
+	RotationStep &operator = (const RotationStep &) = default;
+	~RotationStep() = default;
+
+	// turn (c, s) by d
+	void Apply(const float d, float &c, float &s);
+
+private:
+	// cached (cos d, sin d) of the shared step
+	float	delta;
+	float	cosDelta;
+	float	sinDelta;
+};
+
+#endif
+
+// --- End of File ---
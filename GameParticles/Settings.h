@@ -25,6 +25,96 @@
     #define PRINT_COUNT     5
 #endif
 
+// Chunked bounds and culling
+//    particles are grouped in fixed size chunks (power of two) each frame,
+//    every chunk keeps a box that draw() tests before touching its particles
+
+#define PARTICLE_CHUNK_SIZE     256
+#define PARTICLE_CULLING        1         // 0: draw everything (no frustum tests)
+
+// View volume used for culling - the projection the OpenGL wrapper sets up,
+// glFrustum(-1, 1, -1, 1, 1, 10000), seen from the origin of the world matrices
+#define VIEW_TAN_HALF_FOV_Y     (1.0f)    // 90 deg vertical
+#define VIEW_ASPECT             (1.0f)
+#define VIEW_NEAR               (1.0f)
+#define VIEW_FAR                (10000.0f)
+#define VIEW_PARTICLE_RADIUS    (2.0f)    // triangle extent before scaling
+
+// Screen size culling - particles whose projected triangle is smaller
+// than VIEW_MIN_PIXELS are skipped (0.0f: off, every particle GL would draw is drawn)
+//    pixels are measured against the window's viewport height
+#define VIEW_MIN_PIXELS         (0.0f)
+
+// Worker threads besides the main thread (-1: one less than the hardware threads)
+#define NUM_WORKER_THREADS      (-1)
+
+// Pauses an idle worker spins before sleeping in the kernel (0: sleep at once)
+//    higher: faster per frame wake up, more CPU burnt between frames
+#define WORKER_SPIN_BUDGET      (4000)
+
+// Worker placement - 0: unpinned, 1: compact, 2: scatter over NUMA nodes (see PinMode)
+//    pinned: every thread moves the particles of its own first touched partition
+#define WORKER_PIN_MODE         0
+
+// Particle storage on large pages when the account may lock pages in memory
+//    (0: normal pages) - either way the whole pool is pre-faulted at startup
+//    opt-in: it enables SeLockMemoryPrivilege on the process token, and a
+//    large page pool is committed whole, so it can't grow or trim
+#define PARTICLE_LARGE_PAGES    0
+
+// Page faults of the first frames, printed at exit (0: off)
+#define PAGE_FAULT_FRAMES       (10)
+
+// Address space reserved per particle stream, in particles - pages are only
+//    committed as the live count grows (x86: keep it near 1M, x64: millions)
+#define PARTICLE_RESERVE        (1024 * 1024)
+
+// Address space of each thread's scratch arena, in bytes (see FrameMemory)
+#define FRAME_ARENA_THREAD_RESERVE  (1024 * 1024)
+
+// Pinned vs unpinned update scaling, printed at startup (0: off)
+#define RUN_PIN_BENCHMARK       0
+#define PIN_BENCHMARK_FRAMES    (200)
+
+// Particle velocity, scale and rotation velocity as IEEE halves (0: floats)
+//    sizeof(Particle) 32 bytes smaller - HalfFloat::Report() prints the error at startup
+#define PARTICLE_HALF_ATTRIBUTES  0
+
+// Heap allocations per frame and per stage, Debug builds only (0: off)
+//    past the warm-up a frame that allocates prints its call sites
+//    ALLOC_ASSERT_ZERO 1 also asserts on it - CRT and framework allocations included
+#define ALLOC_PROFILE           1
+#define ALLOC_WARM_UP_FRAMES    (1)
+#define ALLOC_ASSERT_ZERO       0
+
+// Particle rotation as a (cos, sin) pair turned by angle addition (0: angle, sin / cos per draw)
+//    no transcendentals per particle, the angle drifts from the 0 run by rounding (see RotationStep)
+#define PARTICLE_INCREMENTAL_ROTATION  0
+
+// New particles copied out of a table of start states drawn at setup (0: rand() per spawn)
+//    emitters of an EmitterSystem share one, the table vs rand() distributions are printed at the end (see TableSpawn)
+#define PARTICLE_SPAWN_TABLE        0
+#define PARTICLE_SPAWN_TABLE_SIZE   (64 * 1024)
+
+// Emitters in the scene, laid out on a grid SCENE_SPACING apart (1: the single original emitter)
+//    they split NUM_PARTICLES, share one pool and run as one frame graph (see EmitterSystem)
+//    an emitter under EMITTER_SLICE_MIN particles runs each stage as one job
+#define SCENE_EMITTERS          1
+#define SCENE_SPACING           (4.0f)
+#define EMITTER_SLICE_MIN       (16 * 1024)
+
+// Widest Simd<T, N> backend compiled in - 4: SSE4.1, 8: AVX2 + FMA, 16: AVX-512F
+//    the widest one the CPU has is picked at run time (see Simd.h)
+#define SIMD_MAX_WIDTH          16
+
+// AoS <-> SoA transpose timings per path, printed at startup (0: off, see SoATranspose)
+#define RUN_TRANSPOSE_BENCHMARK     0
+#define TRANSPOSE_BENCHMARK_COUNT   (64 * 1024)
+#define TRANSPOSE_BENCHMARK_REPS    (20)
+
+// Draw order - 0: list order, 1: back to front, 2: front to back (see SortOrder)
+#define PARTICLE_SORT_ORDER     0
+
 #endif 
 
 // --- End of File ---
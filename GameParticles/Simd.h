@@ -0,0 +1,1032 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+#include <type_traits>
+#include "CpuFeatures.h"
+#include "Settings.h"
+
+// N lanes in one register - kernels are written once, for any N
+//
+//     Simd<float, 4>   Simd<int32_t, 4>    SSE4.1, always there (baseline)
+//     Simd<float, 8>   Simd<int32_t, 8>    AVX2 + FMA, CpuFeatures::hasAVX2()
+//     Simd<float, 16>  Simd<int32_t, 16>   AVX-512F, CpuFeatures::hasAVX512()
+//
+//     LoadN / storeN touch only the first n lanes - the tail of an array
+//     (masked on AVX2 / AVX-512, through a stack copy on SSE4.1).
+//
+//     The backend is picked at compile time by N. A kernel is a template on
+//     the width - usually a generic lambda handed to SimdDispatch(), which
+//     instantiates it for each width up to SIMD_MAX_WIDTH and runs the
+//     widest one the CPU has. The compiler emits VEX / EVEX code for the
+//     wide instantiations (MSVC does without /arch), nothing runs them on a
+//     CPU that lacks them.
+//
+//     FMAdd is fused on the wide backends but a multiply and an add on
+//     SSE4.1, and reduceAdd sums in a different order per width. Kernels
+//     that must give the same bits at every width stick to exact operations:
+//     min / max, compares, selects, integer math.
+//
+//     Simd, Mask and Int go in by const reference, kernels included
+//     (const auto &v) - Win32 can't pass an aligned struct by value (C2719).
+template <typename T, int N>
+struct Simd;
+
+// set bits of a lane mask - no POPCNT below SSE4.2
+inline int SimdCountBits(unsigned int bits)
+{
+	int n = 0;
+	while( bits != 0 )
+	{
+		bits &= bits - 1;
+		n++;
+	}
+	return n;
+}
+
+// lanes of v under the set bits, packed to the front of p - the number written
+template <typename Int>
+inline int SimdCompressBits(int32_t *p, const Int &v, unsigned int bits)
+{
+	alignas(64) int32_t tmp[Int::WIDTH];
+	v.store(tmp);
+
+	int n = 0;
+	for( int lane = 0; bits != 0; lane++, bits >>= 1 )
+	{
+		if( bits & 1u )
+		{
+			p[n++] = tmp[lane];
+		}
+	}
+	return n;
+}
+
+// ---------------------------------------------------------------------------
+// SSE4.1
+// ---------------------------------------------------------------------------
+
+template <>
+struct Simd<int32_t, 4>
+{
+	static const int WIDTH = 4;
+
+	__m128i	v;
+
+	static Simd Load(const int32_t *p)		// aligned to the register
+	{
+		return Simd{ _mm_load_si128(reinterpret_cast<const __m128i *>(p)) };
+	}
+
+	static Simd LoadU(const int32_t *p)
+	{
+		return Simd{ _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)) };
+	}
+
+	static Simd Set1(const int32_t i)
+	{
+		return Simd{ _mm_set1_epi32(i) };
+	}
+
+	// 0 1 2 3
+	static Simd Ramp()
+	{
+		return Simd{ _mm_setr_epi32(0, 1, 2, 3) };
+	}
+
+	void store(int32_t *p) const
+	{
+		_mm_store_si128(reinterpret_cast<__m128i *>(p), this->v);
+	}
+
+	void storeU(int32_t *p) const
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(p), this->v);
+	}
+
+	friend Simd operator + (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_add_epi32(a.v, b.v) };
+	}
+
+	friend Simd operator - (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_sub_epi32(a.v, b.v) };
+	}
+
+	friend Simd operator * (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_mullo_epi32(a.v, b.v) };
+	}
+
+	static Simd Min(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_min_epi32(a.v, b.v) };
+	}
+
+	static Simd Max(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_max_epi32(a.v, b.v) };
+	}
+};
+
+template <>
+struct Simd<float, 4>
+{
+	static const int WIDTH = 4;
+
+	typedef Simd<int32_t, 4> Int;
+
+	// all ones / all zeros per lane
+	struct Mask
+	{
+		__m128	m;
+
+		int bits() const
+		{
+			return _mm_movemask_ps(this->m);
+		}
+
+		bool any() const
+		{
+			return this->bits() != 0;
+		}
+
+		int count() const
+		{
+			return SimdCountBits((unsigned int)this->bits());
+		}
+
+		friend Mask operator & (const Mask &a, const Mask &b)
+		{
+			return Mask{ _mm_and_ps(a.m, b.m) };
+		}
+
+		friend Mask operator | (const Mask &a, const Mask &b)
+		{
+			return Mask{ _mm_or_ps(a.m, b.m) };
+		}
+
+		friend Mask operator ~ (const Mask &m)
+		{
+			return Mask{ _mm_xor_ps(m.m, _mm_castsi128_ps(_mm_set1_epi32(-1))) };
+		}
+	};
+
+	__m128	v;
+
+	static Simd Load(const float *p)		// aligned to the register
+	{
+		return Simd{ _mm_load_ps(p) };
+	}
+
+	static Simd LoadU(const float *p)
+	{
+		return Simd{ _mm_loadu_ps(p) };
+	}
+
+	static Simd Set1(const float f)
+	{
+		return Simd{ _mm_set1_ps(f) };
+	}
+
+	static Simd Zero()
+	{
+		return Simd{ _mm_setzero_ps() };
+	}
+
+	// first n lanes (0 < n < WIDTH), the rest 0 - no masked loads before AVX, go through the stack
+	static Simd LoadN(const float *p, const int n)
+	{
+		alignas(16) float tmp[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for( int i = 0; i < n; i++ )
+		{
+			tmp[i] = p[i];
+		}
+		return Simd{ _mm_load_ps(tmp) };
+	}
+
+	// base[idx] per lane
+	static Simd Gather(const float *base, const Int &idx)
+	{
+		return Simd{ _mm_setr_ps(base[_mm_extract_epi32(idx.v, 0)], base[_mm_extract_epi32(idx.v, 1)],
+			base[_mm_extract_epi32(idx.v, 2)], base[_mm_extract_epi32(idx.v, 3)]) };
+	}
+
+	static Simd FromInt(const Int &i)
+	{
+		return Simd{ _mm_cvtepi32_ps(i.v) };
+	}
+
+	void store(float *p) const
+	{
+		_mm_store_ps(p, this->v);
+	}
+
+	void storeU(float *p) const
+	{
+		_mm_storeu_ps(p, this->v);
+	}
+
+	// first n lanes only
+	void storeN(float *p, const int n) const
+	{
+		alignas(16) float tmp[4];
+		_mm_store_ps(tmp, this->v);
+		for( int i = 0; i < n; i++ )
+		{
+			p[i] = tmp[i];
+		}
+	}
+
+	// truncates toward zero
+	Int toInt() const
+	{
+		return Int{ _mm_cvttps_epi32(this->v) };
+	}
+
+	friend Simd operator + (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_add_ps(a.v, b.v) };
+	}
+
+	friend Simd operator - (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_sub_ps(a.v, b.v) };
+	}
+
+	friend Simd operator * (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_mul_ps(a.v, b.v) };
+	}
+
+	friend Simd operator / (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_div_ps(a.v, b.v) };
+	}
+
+	// a * b + c - not fused on this backend
+	static Simd FMAdd(const Simd &a, const Simd &b, const Simd &c)
+	{
+		return Simd{ _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v) };
+	}
+
+	static Simd Min(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_min_ps(a.v, b.v) };
+	}
+
+	static Simd Max(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_max_ps(a.v, b.v) };
+	}
+
+	static Simd Sqrt(const Simd &a)
+	{
+		return Simd{ _mm_sqrt_ps(a.v) };
+	}
+
+	static Mask CmpLT(const Simd &a, const Simd &b)
+	{
+		return Mask{ _mm_cmplt_ps(a.v, b.v) };
+	}
+
+	static Mask CmpLE(const Simd &a, const Simd &b)
+	{
+		return Mask{ _mm_cmple_ps(a.v, b.v) };
+	}
+
+	static Mask CmpEQ(const Simd &a, const Simd &b)
+	{
+		return Mask{ _mm_cmpeq_ps(a.v, b.v) };
+	}
+
+	// lanes below n
+	static Mask Active(const int n)
+	{
+		return Mask{ _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(n), _mm_setr_epi32(0, 1, 2, 3))) };
+	}
+
+	static Simd Abs(const Simd &a)
+	{
+		return Simd{ _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) };
+	}
+
+	// lanes of v where m is set, packed to the front of p - returns how many
+	static int CompressStore(int32_t *p, const Int &v, const Mask &m)
+	{
+		return SimdCompressBits(p, v, (unsigned int)m.bits());
+	}
+
+	// m ? a : b
+	static Simd Select(const Mask &m, const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm_blendv_ps(b.v, a.v, m.m) };
+	}
+
+	// lane I in every lane
+	template <int I>
+	Simd broadcast() const
+	{
+		return Simd{ _mm_shuffle_ps(this->v, this->v, _MM_SHUFFLE(I, I, I, I)) };
+	}
+
+	Simd reverse() const
+	{
+		return Simd{ _mm_shuffle_ps(this->v, this->v, _MM_SHUFFLE(0, 1, 2, 3)) };
+	}
+
+	float reduceMin() const
+	{
+		__m128 m = _mm_min_ps(this->v, _mm_shuffle_ps(this->v, this->v, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(m);
+	}
+
+	float reduceMax() const
+	{
+		__m128 m = _mm_max_ps(this->v, _mm_shuffle_ps(this->v, this->v, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(m);
+	}
+
+	float reduceAdd() const
+	{
+		__m128 m = _mm_add_ps(this->v, _mm_shuffle_ps(this->v, this->v, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(m);
+	}
+};
+
+// ---------------------------------------------------------------------------
+// AVX2 + FMA
+// ---------------------------------------------------------------------------
+
+#if SIMD_MAX_WIDTH >= 8
+
+template <>
+struct Simd<int32_t, 8>
+{
+	static const int WIDTH = 8;
+
+	__m256i	v;
+
+	static Simd Load(const int32_t *p)
+	{
+		return Simd{ _mm256_load_si256(reinterpret_cast<const __m256i *>(p)) };
+	}
+
+	static Simd LoadU(const int32_t *p)
+	{
+		return Simd{ _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)) };
+	}
+
+	static Simd Set1(const int32_t i)
+	{
+		return Simd{ _mm256_set1_epi32(i) };
+	}
+
+	static Simd Ramp()
+	{
+		return Simd{ _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7) };
+	}
+
+	void store(int32_t *p) const
+	{
+		_mm256_store_si256(reinterpret_cast<__m256i *>(p), this->v);
+	}
+
+	void storeU(int32_t *p) const
+	{
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(p), this->v);
+	}
+
+	friend Simd operator + (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_add_epi32(a.v, b.v) };
+	}
+
+	friend Simd operator - (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_sub_epi32(a.v, b.v) };
+	}
+
+	friend Simd operator * (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_mullo_epi32(a.v, b.v) };
+	}
+
+	static Simd Min(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_min_epi32(a.v, b.v) };
+	}
+
+	static Simd Max(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_max_epi32(a.v, b.v) };
+	}
+};
+
+template <>
+struct Simd<float, 8>
+{
+	static const int WIDTH = 8;
+
+	typedef Simd<int32_t, 8> Int;
+
+	struct Mask
+	{
+		__m256	m;
+
+		int bits() const
+		{
+			return _mm256_movemask_ps(this->m);
+		}
+
+		bool any() const
+		{
+			return this->bits() != 0;
+		}
+
+		int count() const
+		{
+			return SimdCountBits((unsigned int)this->bits());
+		}
+
+		friend Mask operator & (const Mask &a, const Mask &b)
+		{
+			return Mask{ _mm256_and_ps(a.m, b.m) };
+		}
+
+		friend Mask operator | (const Mask &a, const Mask &b)
+		{
+			return Mask{ _mm256_or_ps(a.m, b.m) };
+		}
+
+		friend Mask operator ~ (const Mask &m)
+		{
+			return Mask{ _mm256_xor_ps(m.m, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) };
+		}
+	};
+
+	__m256	v;
+
+	static Simd Load(const float *p)
+	{
+		return Simd{ _mm256_load_ps(p) };
+	}
+
+	static Simd LoadU(const float *p)
+	{
+		return Simd{ _mm256_loadu_ps(p) };
+	}
+
+	static Simd Set1(const float f)
+	{
+		return Simd{ _mm256_set1_ps(f) };
+	}
+
+	static Simd Zero()
+	{
+		return Simd{ _mm256_setzero_ps() };
+	}
+
+	// lanes below n
+	static __m256i FirstN(const int n)
+	{
+		return _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	}
+
+	static Simd LoadN(const float *p, const int n)
+	{
+		return Simd{ _mm256_maskload_ps(p, Simd::FirstN(n)) };
+	}
+
+	static Simd Gather(const float *base, const Int &idx)
+	{
+		return Simd{ _mm256_i32gather_ps(base, idx.v, 4) };
+	}
+
+	static Simd FromInt(const Int &i)
+	{
+		return Simd{ _mm256_cvtepi32_ps(i.v) };
+	}
+
+	void store(float *p) const
+	{
+		_mm256_store_ps(p, this->v);
+	}
+
+	void storeU(float *p) const
+	{
+		_mm256_storeu_ps(p, this->v);
+	}
+
+	void storeN(float *p, const int n) const
+	{
+		_mm256_maskstore_ps(p, Simd::FirstN(n), this->v);
+	}
+
+	Int toInt() const
+	{
+		return Int{ _mm256_cvttps_epi32(this->v) };
+	}
+
+	friend Simd operator + (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_add_ps(a.v, b.v) };
+	}
+
+	friend Simd operator - (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_sub_ps(a.v, b.v) };
+	}
+
+	friend Simd operator * (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_mul_ps(a.v, b.v) };
+	}
+
+	friend Simd operator / (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_div_ps(a.v, b.v) };
+	}
+
+	static Simd FMAdd(const Simd &a, const Simd &b, const Simd &c)
+	{
+		return Simd{ _mm256_fmadd_ps(a.v, b.v, c.v) };
+	}
+
+	static Simd Min(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_min_ps(a.v, b.v) };
+	}
+
+	static Simd Max(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_max_ps(a.v, b.v) };
+	}
+
+	static Simd Sqrt(const Simd &a)
+	{
+		return Simd{ _mm256_sqrt_ps(a.v) };
+	}
+
+	static Mask CmpLT(const Simd &a, const Simd &b)
+	{
+		return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) };
+	}
+
+	static Mask CmpLE(const Simd &a, const Simd &b)
+	{
+		return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) };
+	}
+
+	static Mask CmpEQ(const Simd &a, const Simd &b)
+	{
+		return Mask{ _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) };
+	}
+
+	static Mask Active(const int n)
+	{
+		return Mask{ _mm256_castsi256_ps(Simd::FirstN(n)) };
+	}
+
+	static Simd Abs(const Simd &a)
+	{
+		return Simd{ _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) };
+	}
+
+	// no compress before AVX-512, one lane at a time
+	static int CompressStore(int32_t *p, const Int &v, const Mask &m)
+	{
+		return SimdCompressBits(p, v, (unsigned int)m.bits());
+	}
+
+	static Simd Select(const Mask &m, const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm256_blendv_ps(b.v, a.v, m.m) };
+	}
+
+	template <int I>
+	Simd broadcast() const
+	{
+		return Simd{ _mm256_permutevar8x32_ps(this->v, _mm256_set1_epi32(I)) };
+	}
+
+	Simd reverse() const
+	{
+		return Simd{ _mm256_permutevar8x32_ps(this->v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0)) };
+	}
+
+	// halves, folded down to the SSE4.1 reductions
+	Simd<float, 4> low() const
+	{
+		return Simd<float, 4>{ _mm256_castps256_ps128(this->v) };
+	}
+
+	Simd<float, 4> high() const
+	{
+		return Simd<float, 4>{ _mm256_extractf128_ps(this->v, 1) };
+	}
+
+	float reduceMin() const
+	{
+		return Simd<float, 4>::Min(this->low(), this->high()).reduceMin();
+	}
+
+	float reduceMax() const
+	{
+		return Simd<float, 4>::Max(this->low(), this->high()).reduceMax();
+	}
+
+	float reduceAdd() const
+	{
+		return (this->low() + this->high()).reduceAdd();
+	}
+};
+
+#endif
+
+// ---------------------------------------------------------------------------
+// AVX-512F
+// ---------------------------------------------------------------------------
+
+#if SIMD_MAX_WIDTH >= 16
+
+template <>
+struct Simd<int32_t, 16>
+{
+	static const int WIDTH = 16;
+
+	__m512i	v;
+
+	static Simd Load(const int32_t *p)
+	{
+		return Simd{ _mm512_load_si512(p) };
+	}
+
+	static Simd LoadU(const int32_t *p)
+	{
+		return Simd{ _mm512_loadu_si512(p) };
+	}
+
+	static Simd Set1(const int32_t i)
+	{
+		return Simd{ _mm512_set1_epi32(i) };
+	}
+
+	static Simd Ramp()
+	{
+		return Simd{ _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15) };
+	}
+
+	void store(int32_t *p) const
+	{
+		_mm512_store_si512(p, this->v);
+	}
+
+	void storeU(int32_t *p) const
+	{
+		_mm512_storeu_si512(p, this->v);
+	}
+
+	friend Simd operator + (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_add_epi32(a.v, b.v) };
+	}
+
+	friend Simd operator - (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_sub_epi32(a.v, b.v) };
+	}
+
+	friend Simd operator * (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_mullo_epi32(a.v, b.v) };
+	}
+
+	static Simd Min(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_min_epi32(a.v, b.v) };
+	}
+
+	static Simd Max(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_max_epi32(a.v, b.v) };
+	}
+};
+
+template <>
+struct Simd<float, 16>
+{
+	static const int WIDTH = 16;
+
+	typedef Simd<int32_t, 16> Int;
+
+	// one bit per lane, in a k register
+	struct Mask
+	{
+		__mmask16	m;
+
+		int bits() const
+		{
+			return (int)this->m;
+		}
+
+		bool any() const
+		{
+			return this->m != 0;
+		}
+
+		int count() const
+		{
+			return SimdCountBits((unsigned int)this->m);
+		}
+
+		friend Mask operator & (const Mask &a, const Mask &b)
+		{
+			return Mask{ (__mmask16)(a.m & b.m) };
+		}
+
+		friend Mask operator | (const Mask &a, const Mask &b)
+		{
+			return Mask{ (__mmask16)(a.m | b.m) };
+		}
+
+		friend Mask operator ~ (const Mask &m)
+		{
+			return Mask{ (__mmask16)~m.m };
+		}
+	};
+
+	__m512	v;
+
+	static Simd Load(const float *p)
+	{
+		return Simd{ _mm512_load_ps(p) };
+	}
+
+	static Simd LoadU(const float *p)
+	{
+		return Simd{ _mm512_loadu_ps(p) };
+	}
+
+	static Simd Set1(const float f)
+	{
+		return Simd{ _mm512_set1_ps(f) };
+	}
+
+	static Simd Zero()
+	{
+		return Simd{ _mm512_setzero_ps() };
+	}
+
+	static Simd LoadN(const float *p, const int n)
+	{
+		return Simd{ _mm512_maskz_loadu_ps((__mmask16)((1u << n) - 1u), p) };
+	}
+
+	static Simd Gather(const float *base, const Int &idx)
+	{
+		return Simd{ _mm512_i32gather_ps(idx.v, base, 4) };
+	}
+
+	static Simd FromInt(const Int &i)
+	{
+		return Simd{ _mm512_cvtepi32_ps(i.v) };
+	}
+
+	void store(float *p) const
+	{
+		_mm512_store_ps(p, this->v);
+	}
+
+	void storeU(float *p) const
+	{
+		_mm512_storeu_ps(p, this->v);
+	}
+
+	void storeN(float *p, const int n) const
+	{
+		_mm512_mask_storeu_ps(p, (__mmask16)((1u << n) - 1u), this->v);
+	}
+
+	Int toInt() const
+	{
+		return Int{ _mm512_cvttps_epi32(this->v) };
+	}
+
+	friend Simd operator + (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_add_ps(a.v, b.v) };
+	}
+
+	friend Simd operator - (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_sub_ps(a.v, b.v) };
+	}
+
+	friend Simd operator * (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_mul_ps(a.v, b.v) };
+	}
+
+	friend Simd operator / (const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_div_ps(a.v, b.v) };
+	}
+
+	static Simd FMAdd(const Simd &a, const Simd &b, const Simd &c)
+	{
+		return Simd{ _mm512_fmadd_ps(a.v, b.v, c.v) };
+	}
+
+	static Simd Min(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_min_ps(a.v, b.v) };
+	}
+
+	static Simd Max(const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_max_ps(a.v, b.v) };
+	}
+
+	static Simd Sqrt(const Simd &a)
+	{
+		return Simd{ _mm512_sqrt_ps(a.v) };
+	}
+
+	static Mask CmpLT(const Simd &a, const Simd &b)
+	{
+		return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) };
+	}
+
+	static Mask CmpLE(const Simd &a, const Simd &b)
+	{
+		return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) };
+	}
+
+	static Mask CmpEQ(const Simd &a, const Simd &b)
+	{
+		return Mask{ _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ) };
+	}
+
+	static Mask Active(const int n)
+	{
+		return Mask{ (__mmask16)((1u << n) - 1u) };
+	}
+
+	static Simd Abs(const Simd &a)
+	{
+		return Simd{ _mm512_abs_ps(a.v) };
+	}
+
+	// vpcompressd - no scalar loop
+	static int CompressStore(int32_t *p, const Int &v, const Mask &m)
+	{
+		_mm512_mask_compressstoreu_epi32(p, m.m, v.v);
+		return m.count();
+	}
+
+	static Simd Select(const Mask &m, const Simd &a, const Simd &b)
+	{
+		return Simd{ _mm512_mask_blend_ps(m.m, b.v, a.v) };
+	}
+
+	template <int I>
+	Simd broadcast() const
+	{
+		return Simd{ _mm512_permutexvar_ps(_mm512_set1_epi32(I), this->v) };
+	}
+
+	Simd reverse() const
+	{
+		return Simd{ _mm512_permutexvar_ps(_mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0), this->v) };
+	}
+
+	// AVX-512F only - no extractf32x8 (that is DQ), go through the double view
+	Simd<float, 8> low() const
+	{
+		return Simd<float, 8>{ _mm512_castps512_ps256(this->v) };
+	}
+
+	Simd<float, 8> high() const
+	{
+		return Simd<float, 8>{ _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(this->v), 1)) };
+	}
+
+	float reduceMin() const
+	{
+		return Simd<float, 8>::Min(this->low(), this->high()).reduceMin();
+	}
+
+	float reduceMax() const
+	{
+		return Simd<float, 8>::Max(this->low(), this->high()).reduceMax();
+	}
+
+	float reduceAdd() const
+	{
+		return (this->low() + this->high()).reduceAdd();
+	}
+};
+
+#endif
+
+// ---------------------------------------------------------------------------
+// dispatch
+// ---------------------------------------------------------------------------
+
+// widest width the CPU runs, capped by SIMD_MAX_WIDTH
+inline int SimdWidth()
+{
+#if SIMD_MAX_WIDTH >= 16
+	if( CpuFeatures::Get().hasAVX512() )
+	{
+		return 16;
+	}
+#endif
+#if SIMD_MAX_WIDTH >= 8
+	if( CpuFeatures::Get().hasAVX2() )
+	{
+		return 8;
+	}
+#endif
+	return 4;
+}
+
+// kernel(std::integral_constant<int, N>) at SimdWidth()
+//
+//     e.g.  SimdDispatch([&](auto width)
+//           {
+//               typedef Simd<float, decltype(width)::value> V;
+//               ...
+//           });
+template <typename Kernel>
+inline void SimdDispatch(const Kernel &kernel)
+{
+	switch( SimdWidth() )
+	{
+#if SIMD_MAX_WIDTH >= 16
+	case 16:
+		kernel(std::integral_constant<int, 16>());
+		_mm256_zeroupper();
+		break;
+#endif
+#if SIMD_MAX_WIDTH >= 8
+	case 8:
+		kernel(std::integral_constant<int, 8>());
+		_mm256_zeroupper();
+		break;
+#endif
+	default:
+		kernel(std::integral_constant<int, 4>());
+		break;
+	}
+}
+
+// n lanes from p - a full register, or the tail of an array
+template <typename V>
+inline V SimdIn(const float *p, const int n)
+{
+	return (n == V::WIDTH) ? V::LoadU(p) : V::LoadN(p, n);
+}
+
+template <typename V>
+inline void SimdOut(const V &v, float *p, const int n)
+{
+	if( n == V::WIDTH )
+	{
+		v.storeU(p);
+	}
+	else
+	{
+		v.storeN(p, n);
+	}
+}
+
+// step(V(), i, n) over [0, count) at SimdWidth() - n < WIDTH only on the last step
+//     step takes (const auto &v, ...), its V is std::decay_t<decltype(v)>
+template <typename Step>
+inline void SimdForEach(const int count, const Step &step)
+{
+	SimdDispatch([count, &step](auto width)
+	{
+		typedef Simd<float, decltype(width)::value> V;
+
+		for( int i = 0; i < count; i += V::WIDTH )
+		{
+			const int n = (count - i < V::WIDTH) ? count - i : V::WIDTH;
+			step(V(), i, n);
+		}
+	});
+}
+
+#endif
+
+// --- End of File ---
@@ -0,0 +1,388 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <new>
+#include <string.h>
+#include "SoATranspose.h"
+#include "CpuFeatures.h"
+#include "Settings.h"
+
+// matrices per pass over the four rows - a multiple of 8, so only the last block has a tail
+static const int MATRIX_BLOCK = 64;
+
+// rows are count __m128 stride bytes apart: a Vect4D array, or one row of a Matrix array
+static __m128 LoadRow(const char *pRows, const size_t stride, const int k)
+{
+	return _mm_loadu_ps(reinterpret_cast<const float *>(pRows + stride * (size_t)k));
+}
+
+static void StoreRow(char *pRows, const size_t stride, const int k, const __m128 r)
+{
+	_mm_storeu_ps(reinterpret_cast<float *>(pRows + stride * (size_t)k), r);
+}
+
+// vectors [i, count) one at a time
+static void RowsToStreamsScalar(const char *pRows, const size_t stride, float *const pS[4], int i, const int count)
+{
+	for( ; i < count; i++ )
+	{
+		const float *r = reinterpret_cast<const float *>(pRows + stride * (size_t)i);
+		pS[0][i] = r[0];
+		pS[1][i] = r[1];
+		pS[2][i] = r[2];
+		pS[3][i] = r[3];
+	}
+}
+
+static void StreamsToRowsScalar(const float *const pS[4], char *pRows, const size_t stride, int i, const int count)
+{
+	for( ; i < count; i++ )
+	{
+		float *r = reinterpret_cast<float *>(pRows + stride * (size_t)i);
+		r[0] = pS[0][i];
+		r[1] = pS[1][i];
+		r[2] = pS[2][i];
+		r[3] = pS[3][i];
+	}
+}
+
+// the vectors the SSE path did, the caller finishes the rest
+static int RowsToStreamsSSE(const char *pRows, const size_t stride, float *const pS[4], int i, const int count)
+{
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 r0 = LoadRow(pRows, stride, i + 0);
+		__m128 r1 = LoadRow(pRows, stride, i + 1);
+		__m128 r2 = LoadRow(pRows, stride, i + 2);
+		__m128 r3 = LoadRow(pRows, stride, i + 3);
+		SoATranspose::Transpose4(r0, r1, r2, r3);
+
+		_mm_storeu_ps(pS[0] + i, r0);
+		_mm_storeu_ps(pS[1] + i, r1);
+		_mm_storeu_ps(pS[2] + i, r2);
+		_mm_storeu_ps(pS[3] + i, r3);
+	}
+	return i;
+}
+
+static int StreamsToRowsSSE(const float *const pS[4], char *pRows, const size_t stride, int i, const int count)
+{
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 r0 = _mm_loadu_ps(pS[0] + i);
+		__m128 r1 = _mm_loadu_ps(pS[1] + i);
+		__m128 r2 = _mm_loadu_ps(pS[2] + i);
+		__m128 r3 = _mm_loadu_ps(pS[3] + i);
+		SoATranspose::Transpose4(r0, r1, r2, r3);
+
+		StoreRow(pRows, stride, i + 0, r0);
+		StoreRow(pRows, stride, i + 1, r1);
+		StoreRow(pRows, stride, i + 2, r2);
+		StoreRow(pRows, stride, i + 3, r3);
+	}
+	return i;
+}
+
+#if SIMD_MAX_WIDTH >= 8
+
+// 4x4 transpose in each 128 bit half - the AVX2 shuffles don't cross halves
+static void Transpose4x2(__m256 &r0, __m256 &r1, __m256 &r2, __m256 &r3)
+{
+	const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+	const __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+	const __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+	const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+
+	r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+	r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+	r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// rows k and k + 4 side by side
+static __m256 LoadRowPair(const char *pRows, const size_t stride, const int k)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(LoadRow(pRows, stride, k)), LoadRow(pRows, stride, k + 4), 1);
+}
+
+static void StoreRowPair(char *pRows, const size_t stride, const int k, const __m256 r)
+{
+	StoreRow(pRows, stride, k, _mm256_castps256_ps128(r));
+	StoreRow(pRows, stride, k + 4, _mm256_extractf128_ps(r, 1));
+}
+
+static int RowsToStreamsAVX2(const char *pRows, const size_t stride, float *const pS[4], int i, const int count)
+{
+	for( ; i + 8 <= count; i += 8 )
+	{
+		__m256 r0 = LoadRowPair(pRows, stride, i + 0);
+		__m256 r1 = LoadRowPair(pRows, stride, i + 1);
+		__m256 r2 = LoadRowPair(pRows, stride, i + 2);
+		__m256 r3 = LoadRowPair(pRows, stride, i + 3);
+		Transpose4x2(r0, r1, r2, r3);
+
+		_mm256_storeu_ps(pS[0] + i, r0);
+		_mm256_storeu_ps(pS[1] + i, r1);
+		_mm256_storeu_ps(pS[2] + i, r2);
+		_mm256_storeu_ps(pS[3] + i, r3);
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+static int StreamsToRowsAVX2(const float *const pS[4], char *pRows, const size_t stride, int i, const int count)
+{
+	for( ; i + 8 <= count; i += 8 )
+	{
+		__m256 r0 = _mm256_loadu_ps(pS[0] + i);
+		__m256 r1 = _mm256_loadu_ps(pS[1] + i);
+		__m256 r2 = _mm256_loadu_ps(pS[2] + i);
+		__m256 r3 = _mm256_loadu_ps(pS[3] + i);
+		Transpose4x2(r0, r1, r2, r3);
+
+		StoreRowPair(pRows, stride, i + 0, r0);
+		StoreRowPair(pRows, stride, i + 1, r1);
+		StoreRowPair(pRows, stride, i + 2, r2);
+		StoreRowPair(pRows, stride, i + 3, r3);
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+#endif
+
+// [begin, end) - begin is where the wide steps start, the rest of the range goes scalar
+static void RowsToStreams(const char *pRows, const size_t stride, float *const pS[4], const int begin, const int count, const TransposePath path)
+{
+	int i = begin;
+#if SIMD_MAX_WIDTH >= 8
+	if( path == TransposePath::AVX2 )
+	{
+		i = RowsToStreamsAVX2(pRows, stride, pS, i, count);
+	}
+#endif
+	if( path != TransposePath::Scalar )
+	{
+		i = RowsToStreamsSSE(pRows, stride, pS, i, count);
+	}
+	RowsToStreamsScalar(pRows, stride, pS, i, count);
+}
+
+static void StreamsToRows(const float *const pS[4], char *pRows, const size_t stride, const int begin, const int count, const TransposePath path)
+{
+	int i = begin;
+#if SIMD_MAX_WIDTH >= 8
+	if( path == TransposePath::AVX2 )
+	{
+		i = StreamsToRowsAVX2(pS, pRows, stride, i, count);
+	}
+#endif
+	if( path != TransposePath::Scalar )
+	{
+		i = StreamsToRowsSSE(pS, pRows, stride, i, count);
+	}
+	StreamsToRowsScalar(pS, pRows, stride, i, count);
+}
+
+TransposePath SoATranspose::privResolve(const TransposePath path)
+{
+	const bool avx2 = (SIMD_MAX_WIDTH >= 8) && CpuFeatures::Get().hasAVX2();
+
+	if( path == TransposePath::Best || path == TransposePath::AVX2 )
+	{
+		return avx2 ? TransposePath::AVX2 : TransposePath::SSE;
+	}
+	return path;
+}
+
+void SoATranspose::ToStreams(const Vect4D *pSrc, const Vect4DStreams &dst, const int count, const TransposePath path)
+{
+	float *const pS[4] = { dst.px, dst.py, dst.pz, dst.pw };
+	RowsToStreams(reinterpret_cast<const char *>(pSrc), sizeof(Vect4D), pS, 0, count, SoATranspose::privResolve(path));
+}
+
+void SoATranspose::FromStreams(const Vect4DStreams &src, Vect4D *pDst, const int count, const TransposePath path)
+{
+	const float *const pS[4] = { src.px, src.py, src.pz, src.pw };
+	StreamsToRows(pS, reinterpret_cast<char *>(pDst), sizeof(Vect4D), 0, count, SoATranspose::privResolve(path));
+}
+
+void SoATranspose::ToStreams(const Matrix *pSrc, const MatrixStreams &dst, const int count, const TransposePath path)
+{
+	const TransposePath resolved = SoATranspose::privResolve(path);
+	if( count <= 0 )
+	{
+		return;
+	}
+
+	// row r of every matrix -> elements 4r .. 4r + 3, a block at a time so
+	// the four row passes hit the cache
+	const Vect4D *pRows[4] = { &pSrc->v0, &pSrc->v1, &pSrc->v2, &pSrc->v3 };
+	for( int begin = 0; begin < count; begin += MATRIX_BLOCK )
+	{
+		const int end = (count - begin < MATRIX_BLOCK) ? count : begin + MATRIX_BLOCK;
+		for( int r = 0; r < 4; r++ )
+		{
+			float *const pS[4] = { dst.pm[4 * r + 0], dst.pm[4 * r + 1], dst.pm[4 * r + 2], dst.pm[4 * r + 3] };
+			RowsToStreams(reinterpret_cast<const char *>(pRows[r]), sizeof(Matrix), pS, begin, end, resolved);
+		}
+	}
+}
+
+void SoATranspose::FromStreams(const MatrixStreams &src, Matrix *pDst, const int count, const TransposePath path)
+{
+	const TransposePath resolved = SoATranspose::privResolve(path);
+	if( count <= 0 )
+	{
+		return;
+	}
+
+	Vect4D *pRows[4] = { &pDst->v0, &pDst->v1, &pDst->v2, &pDst->v3 };
+	for( int begin = 0; begin < count; begin += MATRIX_BLOCK )
+	{
+		const int end = (count - begin < MATRIX_BLOCK) ? count : begin + MATRIX_BLOCK;
+		for( int r = 0; r < 4; r++ )
+		{
+			const float *const pS[4] = { src.pm[4 * r + 0], src.pm[4 * r + 1], src.pm[4 * r + 2], src.pm[4 * r + 3] };
+			StreamsToRows(pS, reinterpret_cast<char *>(pRows[r]), sizeof(Matrix), begin, end, resolved);
+		}
+
+		// the rows came in behind the setters' back
+		for( int k = begin; k < end; k++ )
+		{
+			pDst[k].structure = pDst[k].privClassifyW();
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark
+// ---------------------------------------------------------------------------
+
+// fixed seed - must not touch rand(), spawning depends on its sequence
+static float RandomFloat(unsigned int &state)
+{
+	state = state * 1664525u + 1013904223u;
+	return (float)(state >> 8) * (1.0f / 16777216.0f) - 0.5f;
+}
+
+// rows and structure - not the padding behind them
+static bool SameMatrices(const Matrix *pA, const Matrix *pB, const int count)
+{
+	const Matrix::MatrixRow rows[4] = { Matrix::MatrixRow::MATRIX_ROW_0, Matrix::MatrixRow::MATRIX_ROW_1,
+		Matrix::MatrixRow::MATRIX_ROW_2, Matrix::MatrixRow::MATRIX_ROW_3 };
+
+	for( int k = 0; k < count; k++ )
+	{
+		for( int r = 0; r < 4; r++ )
+		{
+			Vect4D a;
+			Vect4D b;
+			pA[k].get(rows[r], a);
+			pB[k].get(rows[r], b);
+			if( memcmp(&a, &b, sizeof(Vect4D)) != 0 )
+			{
+				return false;
+			}
+		}
+		if( pA[k].getStructure() != pB[k].getStructure() )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// ns per element, best of reps
+template <typename Work>
+static double TimeNs(const int count, const int reps, const Work &work)
+{
+	double best = 0.0;
+	for( int rep = 0; rep < reps; rep++ )
+	{
+		PerformanceTimer timer;
+		timer.Tic();
+		work();
+		timer.Toc();
+
+		const double ns = timer.TimeInSeconds() * 1.0e9 / (double)count;
+		best = (rep == 0 || ns < best) ? ns : best;
+	}
+	return best;
+}
+
+void SoATranspose::Benchmark(const int count, const int reps)
+{
+	assert(count > 0);
+	assert(reps > 0);
+
+	unsigned int state = 3u;
+
+	Vect4D *pVects = static_cast<Vect4D *>(_mm_malloc(sizeof(Vect4D) * (size_t)count, 16));
+	Vect4D *pVectsBack = static_cast<Vect4D *>(_mm_malloc(sizeof(Vect4D) * (size_t)count, 16));
+	Matrix *pMats = static_cast<Matrix *>(_mm_malloc(sizeof(Matrix) * (size_t)count, 16));
+	Matrix *pMatsBack = static_cast<Matrix *>(_mm_malloc(sizeof(Matrix) * (size_t)count, 16));
+	float *pFloats = static_cast<float *>(_mm_malloc(sizeof(float) * 16 * (size_t)count, 16));
+
+	Vect4DStreams vs = { pFloats, pFloats + count, pFloats + 2 * count, pFloats + 3 * count };
+	MatrixStreams ms;
+	for( int e = 0; e < 16; e++ )
+	{
+		ms.pm[e] = pFloats + e * count;
+	}
+
+	#undef new
+	for( int k = 0; k < count; k++ )
+	{
+		::new(pVects + k) Vect4D(RandomFloat(state), RandomFloat(state), RandomFloat(state), RandomFloat(state));
+		::new(pVectsBack + k) Vect4D();
+		::new(pMats + k) Matrix(Vect4D(RandomFloat(state), RandomFloat(state), RandomFloat(state), 0.0f),
+			Vect4D(RandomFloat(state), RandomFloat(state), RandomFloat(state), 0.0f),
+			Vect4D(RandomFloat(state), RandomFloat(state), RandomFloat(state), 0.0f),
+			Vect4D(RandomFloat(state), RandomFloat(state), RandomFloat(state), 1.0f));
+		::new(pMatsBack + k) Matrix();
+	}
+
+	Trace::out("--- SoATranspose: %d elements, best of %d, ns per element ---\n", count, reps);
+	Trace::out("  path      Vect4D->SoA  SoA->Vect4D  Matrix->SoA  SoA->Matrix  round trip\n");
+
+	const TransposePath paths[3] = { TransposePath::Scalar, TransposePath::SSE, TransposePath::AVX2 };
+	const char *names[3] = { "scalar", "SSE 4x4", "AVX2 8x4" };
+
+	for( int p = 0; p < 3; p++ )
+	{
+		const TransposePath path = paths[p];
+		if( path == TransposePath::AVX2 && SoATranspose::privResolve(path) != path )
+		{
+			Trace::out("  %-8s  (not on this CPU / SIMD_MAX_WIDTH)\n", names[p]);
+			continue;
+		}
+
+		const double toV = TimeNs(count, reps, [&]() { SoATranspose::ToStreams(pVects, vs, count, path); });
+		const double fromV = TimeNs(count, reps, [&]() { SoATranspose::FromStreams(vs, pVectsBack, count, path); });
+		const double toM = TimeNs(count, reps, [&]() { SoATranspose::ToStreams(pMats, ms, count, path); });
+		const double fromM = TimeNs(count, reps, [&]() { SoATranspose::FromStreams(ms, pMatsBack, count, path); });
+
+		// both directions have to give back the bits that went in
+		const bool same = (memcmp(pVects, pVectsBack, sizeof(Vect4D) * (size_t)count) == 0)
+			&& SameMatrices(pMats, pMatsBack, count);
+
+		Trace::out("  %-8s  %11.3f  %11.3f  %11.3f  %11.3f  %s\n", names[p], toV, fromV, toM, fromM, same ? "exact" : "MISMATCH");
+		assert(same);
+
+		for( int k = 0; k < count; k++ )
+		{
+			pVectsBack[k].set(0.0f, 0.0f, 0.0f, 0.0f);
+			pMatsBack[k].setDefault();
+		}
+	}
+
+	_mm_free(pFloats);
+	_mm_free(pMatsBack);
+	_mm_free(pMats);
+	_mm_free(pVectsBack);
+	_mm_free(pVects);
+}
+
+// --- End of File ---
@@ -0,0 +1,56 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef SOA_TRANSPOSE_H
+#define SOA_TRANSPOSE_H
+
+#include "Enum.h"
+#include "Vect4D.h"
+#include "Matrix.h"
+#include "Vect4DArray.h"
+#include "MatrixArray.h"
+
+// Vect4D / Matrix arrays <-> the float streams of Vect4DArray / MatrixArray
+//
+//     AoS code keeps its Vect4D and Matrix at the edges, the hot loops run
+//     on streams. The conversion is a transpose in registers:
+//
+//         SSE    4 Vect4D -> 4 x __m128, one _MM_TRANSPOSE4_PS
+//         AVX2   8 Vect4D -> 4 x __m256, the two 4x4 halves side by side
+//
+//     A matrix is four rows, so count matrices are four row arrays with a
+//     stride of sizeof(Matrix) - the same transposes, four times over.
+//     The last count % 4 (or % 8) vectors go one at a time.
+//
+//     Best picks AVX2 when CpuFeatures has it, SSE otherwise - no 16 wide
+//     path, the 512 bit transpose needs cross lane permutes that cost more
+//     than the second 256 bit store. Matrices coming back are classified
+//     like the row constructor does (last column only).
+//
+//     RUN_TRANSPOSE_BENCHMARK times every path against the scalar one.
+class SoATranspose
+{
+public:
+	// four xyzw rows <-> x y z w columns, in place
+	static void Transpose4(__m128 &r0, __m128 &r1, __m128 &r2, __m128 &r3)
+	{
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	}
+
+	static void ToStreams(const Vect4D *pSrc, const Vect4DStreams &dst, const int count, const TransposePath path = TransposePath::Best);
+	static void FromStreams(const Vect4DStreams &src, Vect4D *pDst, const int count, const TransposePath path = TransposePath::Best);
+
+	static void ToStreams(const Matrix *pSrc, const MatrixStreams &dst, const int count, const TransposePath path = TransposePath::Best);
+	static void FromStreams(const MatrixStreams &src, Matrix *pDst, const int count, const TransposePath path = TransposePath::Best);
+
+	// ns per vector / matrix of every path, both directions
+	static void Benchmark(const int count, const int reps);
+
+private:
+	static TransposePath privResolve(const TransposePath path);
+};
+
+#endif
+
+// --- End of File ---
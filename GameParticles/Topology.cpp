@@ -0,0 +1,255 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <thread>
+#include "Topology.h"
+
+static int LowestBit(KAFFINITY mask)
+{
+	int bit = 0;
+	while( mask != 0 && (mask & 1) == 0 )
+	{
+		mask >>= 1;
+		bit++;
+	}
+	return bit;
+}
+
+static int CountBits(KAFFINITY mask)
+{
+	int bits = 0;
+	for( ; mask != 0; mask &= mask - 1 )
+	{
+		bits++;
+	}
+	return bits;
+}
+
+Topology::Topology()
+	: numCores(0),
+	numNodes(0),
+	known(false)
+{
+	this->known = this->privQuery();
+	if( !this->known )
+	{
+		this->privFallback();
+	}
+}
+
+Topology::~Topology()
+{
+	// nothing to delete
+}
+
+bool Topology::privQuery()
+{
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+	if( GetLastError() != ERROR_INSUFFICIENT_BUFFER || length == 0 )
+	{
+		return false;
+	}
+
+	char *poBuffer = new char[length];
+	if( !GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)poBuffer, &length) )
+	{
+		delete[] poBuffer;
+		return false;
+	}
+
+	// nodes first, every core is looked up in them
+	GROUP_AFFINITY nodeMasks[MAX_NODES];
+	for( DWORD offset = 0; offset < length; )
+	{
+		const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *pInfo = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(poBuffer + offset);
+		if( pInfo->Relationship == RelationNumaNode && this->numNodes < MAX_NODES )
+		{
+			nodeMasks[this->numNodes] = pInfo->NumaNode.GroupMask;
+			this->nodeNumbers[this->numNodes] = pInfo->NumaNode.NodeNumber;
+			this->nodeCores[this->numNodes] = 0;
+			this->numNodes++;
+		}
+		offset += pInfo->Size;
+	}
+
+	for( DWORD offset = 0; offset < length; )
+	{
+		const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *pInfo = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(poBuffer + offset);
+		if( pInfo->Relationship == RelationProcessorCore && this->numCores < MAX_CORES )
+		{
+			CpuCore &core = this->cores[this->numCores++];
+			core.mask = pInfo->Processor.GroupMask[0].Mask;
+			core.group = pInfo->Processor.GroupMask[0].Group;
+			core.first = LowestBit(core.mask);
+			core.node = 0;
+
+			for( int n = 0; n < this->numNodes; n++ )
+			{
+				if( nodeMasks[n].Group == core.group && (nodeMasks[n].Mask & core.mask) != 0 )
+				{
+					core.node = n;
+					break;
+				}
+			}
+		}
+		offset += pInfo->Size;
+	}
+
+	delete[] poBuffer;
+
+	if( this->numCores == 0 )
+	{
+		this->numNodes = 0;
+		return false;
+	}
+
+	if( this->numNodes == 0 )
+	{
+		this->nodeNumbers[0] = 0;
+		this->nodeCores[0] = 0;
+		this->numNodes = 1;
+	}
+
+	// stable insertion sort by node - OS order within a node
+	for( int i = 1; i < this->numCores; i++ )
+	{
+		const CpuCore core = this->cores[i];
+		int j = i;
+		while( j > 0 && this->cores[j - 1].node > core.node )
+		{
+			this->cores[j] = this->cores[j - 1];
+			j--;
+		}
+		this->cores[j] = core;
+	}
+
+	for( int i = 0; i < this->numCores; i++ )
+	{
+		this->nodeCores[this->cores[i].node]++;
+	}
+
+	return true;
+}
+
+void Topology::privFallback()
+{
+	int hw = (int)std::thread::hardware_concurrency();
+	hw = (hw > 0) ? hw : 1;
+	hw = (hw < MAX_CORES) ? hw : MAX_CORES;
+
+	for( int i = 0; i < hw; i++ )
+	{
+		CpuCore &core = this->cores[i];
+		core.mask = 0;
+		core.group = 0;
+		core.first = i;
+		core.node = 0;
+	}
+
+	this->numCores = hw;
+	this->numNodes = 1;
+	this->nodeNumbers[0] = 0;
+	this->nodeCores[0] = hw;
+}
+
+int Topology::getNumCores() const
+{
+	return this->numCores;
+}
+
+int Topology::getNumNodes() const
+{
+	return this->numNodes;
+}
+
+bool Topology::isKnown() const
+{
+	return this->known;
+}
+
+const CpuCore &Topology::getCore(int index) const
+{
+	assert(index >= 0 && index < this->numCores);
+	return this->cores[index];
+}
+
+DWORD Topology::getNodeNumber(int node) const
+{
+	assert(node >= 0 && node < this->numNodes);
+	return this->nodeNumbers[node];
+}
+
+int Topology::pickCore(int threadIndex, PinMode mode) const
+{
+	if( mode == PinMode::None || !this->known )
+	{
+		return -1;
+	}
+
+	const int slot = threadIndex % this->numCores;
+
+	if( mode == PinMode::Compact || this->numNodes == 1 )
+	{
+		return slot;
+	}
+
+	// Scatter: node slot % nodes, the next free core of it - cores are in node order
+	int node = slot % this->numNodes;
+	int rank = slot / this->numNodes;
+
+	// small nodes run out first, carry on with the next one
+	for( int tries = 0; tries < this->numNodes; tries++ )
+	{
+		if( rank < this->nodeCores[node] )
+		{
+			int first = 0;
+			for( int n = 0; n < node; n++ )
+			{
+				first += this->nodeCores[n];
+			}
+			return first + rank;
+		}
+		rank -= this->nodeCores[node];
+		node = (node + 1) % this->numNodes;
+	}
+
+	return slot;
+}
+
+bool Topology::Pin(HANDLE hThread, const CpuCore &core, GROUP_AFFINITY *pOld)
+{
+	GROUP_AFFINITY affinity = {};
+	affinity.Mask = core.mask;
+	affinity.Group = core.group;
+
+	return SetThreadGroupAffinity(hThread, &affinity, pOld) != 0;
+}
+
+bool Topology::Unpin(HANDLE hThread, const GROUP_AFFINITY &old)
+{
+	return SetThreadGroupAffinity(hThread, &old, nullptr) != 0;
+}
+
+void Topology::report() const
+{
+	Trace::out("--- Topology: %d cores, %d NUMA nodes%s ---\n",
+		this->numCores, this->numNodes, this->known ? "" : " (unknown, not pinning)");
+
+	for( int n = 0; n < this->numNodes; n++ )
+	{
+		int smt = 0;
+		for( int i = 0; i < this->numCores; i++ )
+		{
+			if( this->cores[i].node == n )
+			{
+				smt = (this->cores[i].mask != 0) ? CountBits(this->cores[i].mask) : 1;
+				break;
+			}
+		}
+		Trace::out("  node %lu: %d cores x %d threads\n", (unsigned long)this->nodeNumbers[n], this->nodeCores[n], smt);
+	}
+}
+
+// --- End of File ---
@@ -0,0 +1,70 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include "Enum.h"
+
+// one physical core - a thread pinned to it may use any of its SMT siblings
+struct CpuCore
+{
+	KAFFINITY	mask;		// logical processors of the core
+	WORD		group;		// processor group
+	int			first;		// lowest logical processor in the group
+	int			node;		// dense NUMA node index
+};
+
+// Cores and NUMA nodes of the machine
+//
+//     Read once with GetLogicalProcessorInformationEx, cores kept in node
+//     order. pickCore() maps a thread index (0 = main) to a core: Compact
+//     fills node 0 before node 1, Scatter deals the threads round robin
+//     over the nodes. More threads than cores wrap around.
+//
+//     If the query fails it falls back to a single node with one core
+//     per hardware thread and pinning is skipped.
+class Topology
+{
+public:
+	static const int MAX_CORES = 256;
+	static const int MAX_NODES = 64;
+
+	Topology();
+	Topology(const Topology &) = delete;
+	Topology &operator = (const Topology &) = delete;
+	~Topology();
+
+	int getNumCores() const;
+	int getNumNodes() const;
+	bool isKnown() const;
+	const CpuCore &getCore(int index) const;
+
+	// NUMA node number as the OS names it (VirtualAllocExNuma)
+	DWORD getNodeNumber(int node) const;
+
+	// -1 for PinMode::None or an unknown topology
+	int pickCore(int threadIndex, PinMode mode) const;
+
+	// previous affinity goes to pOld, for Unpin()
+	static bool Pin(HANDLE hThread, const CpuCore &core, GROUP_AFFINITY *pOld);
+	static bool Unpin(HANDLE hThread, const GROUP_AFFINITY &old);
+
+	void report() const;
+
+private:
+	bool privQuery();
+	void privFallback();
+
+	CpuCore		cores[MAX_CORES];
+	DWORD		nodeNumbers[MAX_NODES];
+	int			nodeCores[MAX_NODES];	// cores per node
+	int			numCores;
+	int			numNodes;
+	bool		known;
+};
+
+#endif
+
+// --- End of File ---
@@ -34,24 +34,12 @@ Vect4D::~Vect4D()
 
 void Vect4D::norm(Vect4D &v)	
 {
-	float mag = sqrt(this->x * this->x + this->y * this->y + this->z * this->z);
+	// dp sums (x*x + y*y) + z*z, then one divide - the bits of the scalar version, no branch
+	const __m128 mag = _mm_sqrt_ps(_mm_dp_ps(this->_m, this->_m, 0x7F));
+	const __m128 unit = _mm_blend_ps(_mm_mul_ps(this->_m, _mm_div_ps(_mm_set1_ps(1.0f), mag)), _mm_set1_ps(1.0f), 0x8);
 
-
-	if(0.0f < mag)
-	{
-		mag = 1 / mag;
-
-		v.x = this->x * mag;
-		v.y = this->y * mag;
-		v.z = this->z * mag;
-		v.w = 1.0;
-
-	}
-}
-
-Vect4D Vect4D:: operator + (const Vect4D &t) const
-{
-	return Vect4D(_mm_add_ps(this->_m, t._m));
+	// zero length leaves v alone
+	v._m = _mm_blendv_ps(v._m, unit, _mm_cmplt_ps(_mm_setzero_ps(), mag));
 }
 
 float &Vect4D::operator[](Vect e)
@@ -78,21 +66,17 @@ float &Vect4D::operator[](Vect e)
 
 
 
-Vect4D Vect4D::operator - (const Vect4D &t) const
-{
-	return Vect4D(_mm_sub_ps(this->_m, t._m));
-}
-
 
 // Called once
 void Vect4D::Cross(Vect4D &vin, Vect4D &vout) const
 {
-	//vout._m = _mm_set_ps((y * vin.z - z * vin.y), (z * vin.x - x * vin.z), (x * vin.y - y * vin.x), 1.0f);
+	// (yzx * vin.zxy) - (zxy * vin.yzx), w = 1
+	const __m128 aYZX = _mm_shuffle_ps(this->_m, this->_m, _MM_SHUFFLE(3, 0, 2, 1));
+	const __m128 aZXY = _mm_shuffle_ps(this->_m, this->_m, _MM_SHUFFLE(3, 1, 0, 2));
+	const __m128 bZXY = _mm_shuffle_ps(vin._m, vin._m, _MM_SHUFFLE(3, 1, 0, 2));
+	const __m128 bYZX = _mm_shuffle_ps(vin._m, vin._m, _MM_SHUFFLE(3, 0, 2, 1));
 
-	vout.x = (y * vin.z - z * vin.y);
-	vout.y = (z * vin.x - x * vin.z);
-	vout.z = (x * vin.y - y * vin.x);
-	vout.w = 1.0f;
+	vout._m = _mm_blend_ps(_mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX)), _mm_set1_ps(1.0f), 0x8);
 }
 
 void Vect4D::set(float tx, float ty, float tz, float tw)
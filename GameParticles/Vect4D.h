@@ -6,6 +6,7 @@
 #define Vect4D_H
 
 // includes
+#include <type_traits>
 #include "Enum.h"
 
 // Foward Declarations
@@ -31,8 +32,7 @@ public:
 	void set(float tx, float ty, float tz, float tw = 1.0f);
 
 
-	Vect4D operator + (const Vect4D& t) const;
-	Vect4D operator - (const Vect4D& t) const;
+	// + - and * by a float are lazy, see VecNode below
 	//Vect4D operator * (const float scale) const;
 	
 
@@ -54,56 +54,157 @@ public:
 			float w;
 		};
 	};
-	
-	friend struct VxF;
-	friend struct VxFxF;
 };
 
 
 
-struct VxF
+// Lazy vector arithmetic
+//
+//     a + b, a - b, v * s ... don't compute anything, they build a tree of
+//     nodes holding their operands. Converting the tree to a Vect4D
+//     evaluates it in one pass, the intermediate values stay in registers.
+//     A run of scalars folds into one: v * s * t multiplies v once, by
+//     (s * t) - the way the old VxFxF proxy did.
+//
+//     Leaves hold references - evaluate in the same statement, don't keep
+//     a tree in an auto variable.
+struct VecNode
+{
+};
+
+// a Vect4D as a leaf
+struct VecRef : public VecNode
+{
+	const Vect4D &v;
+
+	explicit VecRef(const Vect4D &t)
+		: v(t)
+	{
+	}
+
+	__m128 eval() const
+	{
+		return v._m;
+	}
+};
+
+// what an operand becomes in a tree: nodes stay, Vect4D is wrapped, anything else isn't a vector
+template <typename T, bool = std::is_base_of<VecNode, T>::value>
+struct VecArg
+{
+};
+
+template <typename T>
+struct VecArg<T, true>
+{
+	typedef T type;
+
+	static const T &Wrap(const T &t)
+	{
+		return t;
+	}
+};
+
+template <>
+struct VecArg<Vect4D, false>
+{
+	typedef VecRef type;
+
+	static VecRef Wrap(const Vect4D &t)
+	{
+		return VecRef(t);
+	}
+};
+
+template <typename E>
+struct VecScale : public VecNode
+{
+	E		e;
+	float	s;
+
+	VecScale(const E &t, const float ts)
+		: e(t), s(ts)
+	{
+	}
+
+	__m128 eval() const
+	{
+		return _mm_mul_ps(e.eval(), _mm_set1_ps(s));
+	}
+
+	operator Vect4D() const
+	{
+		return Vect4D(this->eval());
+	}
+};
+
+template <typename L, typename R>
+struct VecAdd : public VecNode
 {
-	const Vect4D& v1;
-	const float f1;
+	L	l;
+	R	r;
+
+	VecAdd(const L &tl, const R &tr)
+		: l(tl), r(tr)
+	{
+	}
 
-	VxF(const Vect4D& t1, const float tf1)
-		:v1(t1), f1(tf1)
+	__m128 eval() const
 	{
+		return _mm_add_ps(l.eval(), r.eval());
 	}
 
-	operator Vect4D()
+	operator Vect4D() const
 	{
-		__m128 tmp = _mm_set1_ps(f1);
-		return Vect4D(_mm_mul_ps(v1._m, tmp));
+		return Vect4D(this->eval());
 	}
 };
 
-struct  VxFxF
+template <typename L, typename R>
+struct VecSub : public VecNode
 {
-	const Vect4D& v1;
-	const float f1;
-	const float f2;
+	L	l;
+	R	r;
+
+	VecSub(const L &tl, const R &tr)
+		: l(tl), r(tr)
+	{
+	}
 
-	VxFxF(const VxF& t1, const float tf1)
-		:v1(t1.v1), f1(t1.f1), f2(tf1)
+	__m128 eval() const
 	{
+		return _mm_sub_ps(l.eval(), r.eval());
 	}
 
-	operator Vect4D()
+	operator Vect4D() const
 	{
-		__m128 tmp = _mm_set1_ps(f2 * f1);
-		return Vect4D(_mm_mul_ps(v1._m, tmp));
+		return Vect4D(this->eval());
 	}
 };
 
-inline VxF operator * (const Vect4D& a1, const float& af1)
+template <typename L>
+inline VecScale<typename VecArg<L>::type> operator * (const L &a1, const float af1)
+{
+	return VecScale<typename VecArg<L>::type>(VecArg<L>::Wrap(a1), af1);
+}
+
+// more specialized than the one above - folds the scalars
+template <typename E>
+inline VecScale<E> operator * (const VecScale<E> &a1, const float af1)
+{
+	return VecScale<E>(a1.e, af1 * a1.s);
+}
+
+template <typename L, typename R>
+inline VecAdd<typename VecArg<L>::type, typename VecArg<R>::type> operator + (const L &a1, const R &a2)
 {
-	return VxF(a1, af1);
+	return VecAdd<typename VecArg<L>::type, typename VecArg<R>::type>(VecArg<L>::Wrap(a1), VecArg<R>::Wrap(a2));
 }
 
-inline VxFxF operator * (const VxF& a1, const float& af1)
+template <typename L, typename R>
+inline VecSub<typename VecArg<L>::type, typename VecArg<R>::type> operator - (const L &a1, const R &a2)
 {
-	return VxFxF(a1, af1);
+	return VecSub<typename VecArg<L>::type, typename VecArg<R>::type>(VecArg<L>::Wrap(a1), VecArg<R>::Wrap(a2));
 }
 
 
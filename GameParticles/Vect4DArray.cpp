@@ -0,0 +1,218 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include "Vect4DArray.h"
+#include "Simd.h"
+
+static const float *Floats(const Vect4D *p)
+{
+	return reinterpret_cast<const float *>(p);
+}
+
+static float *Floats(Vect4D *p)
+{
+	return reinterpret_cast<float *>(p);
+}
+
+// same products and order as Vect4D::Cross
+template <typename V>
+static void Cross(const V &ax, const V &ay, const V &az, const Vect4D &k, V &x, V &y, V &z)
+{
+	x = ay * V::Set1(k.z) - az * V::Set1(k.y);
+	y = az * V::Set1(k.x) - ax * V::Set1(k.z);
+	z = ax * V::Set1(k.y) - ay * V::Set1(k.x);
+}
+
+// ---------------------------------------------------------------------------
+// AoS
+// ---------------------------------------------------------------------------
+
+void Vect4DArray::Add(const Vect4D *pA, const Vect4D *pB, Vect4D *pOut, const int count)
+{
+	const float *a = Floats(pA);
+	const float *b = Floats(pB);
+	float *out = Floats(pOut);
+
+	SimdForEach(count * 4, [a, b, out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		SimdOut(SimdIn<V>(a + i, n) + SimdIn<V>(b + i, n), out + i, n);
+	});
+}
+
+void Vect4DArray::Scale(const Vect4D *pA, const float s, Vect4D *pOut, const int count)
+{
+	const float *a = Floats(pA);
+	float *out = Floats(pOut);
+
+	SimdForEach(count * 4, [a, s, out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		SimdOut(SimdIn<V>(a + i, n) * V::Set1(s), out + i, n);
+	});
+}
+
+void Vect4DArray::Scale(const Vect4D *pA, const float *pS, Vect4D *pOut, const int count)
+{
+	for( int i = 0; i < count; i++ )
+	{
+		pOut[i]._m = _mm_mul_ps(pA[i]._m, _mm_set1_ps(pS[i]));
+	}
+}
+
+void Vect4DArray::FMAdd(const Vect4D *pA, const float s, const Vect4D *pB, Vect4D *pOut, const int count)
+{
+	const float *a = Floats(pA);
+	const float *b = Floats(pB);
+	float *out = Floats(pOut);
+
+	SimdForEach(count * 4, [a, s, b, out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		SimdOut(V::FMAdd(SimdIn<V>(a + i, n), V::Set1(s), SimdIn<V>(b + i, n)), out + i, n);
+	});
+}
+
+void Vect4DArray::CrossConst(const Vect4D *pA, const Vect4D &k, Vect4D *pOut, const int count)
+{
+	// (a.yzx * k.zxy) - (a.zxy * k.yzx)
+	const __m128 kZXY = _mm_shuffle_ps(k._m, k._m, _MM_SHUFFLE(3, 1, 0, 2));
+	const __m128 kYZX = _mm_shuffle_ps(k._m, k._m, _MM_SHUFFLE(3, 0, 2, 1));
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	for( int i = 0; i < count; i++ )
+	{
+		const __m128 a = pA[i]._m;
+		const __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		const __m128 aZXY = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+		const __m128 c = _mm_sub_ps(_mm_mul_ps(aYZX, kZXY), _mm_mul_ps(aZXY, kYZX));
+
+		pOut[i]._m = _mm_blend_ps(c, one, 0x8);
+	}
+}
+
+void Vect4DArray::Dot3(const Vect4D *pA, const Vect4D *pB, float *pOut, const int count)
+{
+	for( int i = 0; i < count; i++ )
+	{
+		pOut[i] = _mm_cvtss_f32(_mm_dp_ps(pA[i]._m, pB[i]._m, 0x71));
+	}
+}
+
+void Vect4DArray::Normalize(const Vect4D *pA, Vect4D *pOut, const int count)
+{
+	for( int i = 0; i < count; i++ )
+	{
+		Vect4D a = pA[i];
+		Vect4D n = a;
+		a.norm(n);
+		pOut[i] = n;
+	}
+}
+
+// ---------------------------------------------------------------------------
+// SoA
+// ---------------------------------------------------------------------------
+
+void Vect4DArray::Add(const Vect4DStreams &a, const Vect4DStreams &b, const Vect4DStreams &out, const int count)
+{
+	SimdForEach(count, [&a, &b, &out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		SimdOut(SimdIn<V>(a.px + i, n) + SimdIn<V>(b.px + i, n), out.px + i, n);
+		SimdOut(SimdIn<V>(a.py + i, n) + SimdIn<V>(b.py + i, n), out.py + i, n);
+		SimdOut(SimdIn<V>(a.pz + i, n) + SimdIn<V>(b.pz + i, n), out.pz + i, n);
+		SimdOut(SimdIn<V>(a.pw + i, n) + SimdIn<V>(b.pw + i, n), out.pw + i, n);
+	});
+}
+
+void Vect4DArray::Scale(const Vect4DStreams &a, const float s, const Vect4DStreams &out, const int count)
+{
+	SimdForEach(count, [&a, s, &out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		const V vs = V::Set1(s);
+		SimdOut(SimdIn<V>(a.px + i, n) * vs, out.px + i, n);
+		SimdOut(SimdIn<V>(a.py + i, n) * vs, out.py + i, n);
+		SimdOut(SimdIn<V>(a.pz + i, n) * vs, out.pz + i, n);
+		SimdOut(SimdIn<V>(a.pw + i, n) * vs, out.pw + i, n);
+	});
+}
+
+void Vect4DArray::Scale(const Vect4DStreams &a, const float *pS, const Vect4DStreams &out, const int count)
+{
+	SimdForEach(count, [&a, pS, &out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		const V vs = SimdIn<V>(pS + i, n);
+		SimdOut(SimdIn<V>(a.px + i, n) * vs, out.px + i, n);
+		SimdOut(SimdIn<V>(a.py + i, n) * vs, out.py + i, n);
+		SimdOut(SimdIn<V>(a.pz + i, n) * vs, out.pz + i, n);
+		SimdOut(SimdIn<V>(a.pw + i, n) * vs, out.pw + i, n);
+	});
+}
+
+void Vect4DArray::FMAdd(const Vect4DStreams &a, const float s, const Vect4DStreams &b, const Vect4DStreams &out, const int count)
+{
+	SimdForEach(count, [&a, s, &b, &out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		const V vs = V::Set1(s);
+		SimdOut(V::FMAdd(SimdIn<V>(a.px + i, n), vs, SimdIn<V>(b.px + i, n)), out.px + i, n);
+		SimdOut(V::FMAdd(SimdIn<V>(a.py + i, n), vs, SimdIn<V>(b.py + i, n)), out.py + i, n);
+		SimdOut(V::FMAdd(SimdIn<V>(a.pz + i, n), vs, SimdIn<V>(b.pz + i, n)), out.pz + i, n);
+		SimdOut(V::FMAdd(SimdIn<V>(a.pw + i, n), vs, SimdIn<V>(b.pw + i, n)), out.pw + i, n);
+	});
+}
+
+void Vect4DArray::CrossConst(const Vect4DStreams &a, const Vect4D &k, const Vect4DStreams &out, const int count)
+{
+	SimdForEach(count, [&a, &k, &out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		V x;
+		V y;
+		V z;
+		Cross(SimdIn<V>(a.px + i, n), SimdIn<V>(a.py + i, n), SimdIn<V>(a.pz + i, n), k, x, y, z);
+
+		SimdOut(x, out.px + i, n);
+		SimdOut(y, out.py + i, n);
+		SimdOut(z, out.pz + i, n);
+		SimdOut(V::Set1(1.0f), out.pw + i, n);
+	});
+}
+
+void Vect4DArray::Dot3(const Vect4DStreams &a, const Vect4DStreams &b, float *pOut, const int count)
+{
+	SimdForEach(count, [&a, &b, pOut](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		const V xy = SimdIn<V>(a.px + i, n) * SimdIn<V>(b.px + i, n) + SimdIn<V>(a.py + i, n) * SimdIn<V>(b.py + i, n);
+		SimdOut(xy + SimdIn<V>(a.pz + i, n) * SimdIn<V>(b.pz + i, n), pOut + i, n);
+	});
+}
+
+void Vect4DArray::Normalize(const Vect4DStreams &a, const Vect4DStreams &out, const int count)
+{
+	SimdForEach(count, [&a, &out](const auto &v, const int i, const int n)
+	{
+		typedef std::decay_t<decltype(v)> V;
+		const V x = SimdIn<V>(a.px + i, n);
+		const V y = SimdIn<V>(a.py + i, n);
+		const V z = SimdIn<V>(a.pz + i, n);
+		const V w = SimdIn<V>(a.pw + i, n);
+
+		// same steps as Vect4D::norm: sqrt((x*x + y*y) + z*z), one divide, three multiplies
+		const V mag = V::Sqrt((x * x + y * y) + z * z);
+		const V inv = V::Set1(1.0f) / mag;
+		const typename V::Mask live = V::CmpLT(V::Zero(), mag);
+
+		SimdOut(V::Select(live, x * inv, x), out.px + i, n);
+		SimdOut(V::Select(live, y * inv, y), out.py + i, n);
+		SimdOut(V::Select(live, z * inv, z), out.pz + i, n);
+		SimdOut(V::Select(live, V::Set1(1.0f), w), out.pw + i, n);
+	});
+}
+
+// --- End of File ---
@@ -0,0 +1,68 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef VECT4D_ARRAY_H
+#define VECT4D_ARRAY_H
+
+#include "Vect4D.h"
+
+// one vector array as four float streams, x[i] y[i] z[i] w[i] is vector i
+struct Vect4DStreams
+{
+	float	*px;
+	float	*py;
+	float	*pz;
+	float	*pw;
+};
+
+// Vect4D math over count vectors at once
+//
+//     AoS - plain Vect4D arrays. Add / Scale / FMAdd don't care which lane
+//     is which and run over the floats at SimdWidth(). Cross, Dot3 and
+//     Normalize need the components apart, one Vect4D per step.
+//
+//     SoA - Vect4DStreams. Everything runs SimdWidth() vectors per step:
+//     4 on SSE4.1, 8 on AVX2, 16 on AVX-512.
+//
+//     The tail that doesn't fill a register goes through LoadN / storeN,
+//     no scalar loop. Output may be one of the inputs.
+//
+//     Cross, Dot3 and Normalize give the bits of Vect4D::Cross / norm at
+//     every width. FMAdd is fused on AVX2 / AVX-512 - use Scale then Add
+//     when the result has to match the SSE4.1 run.
+class Vect4DArray
+{
+public:
+	// out = a + b
+	static void Add(const Vect4D *pA, const Vect4D *pB, Vect4D *pOut, const int count);
+	static void Add(const Vect4DStreams &a, const Vect4DStreams &b, const Vect4DStreams &out, const int count);
+
+	// out = a * s
+	static void Scale(const Vect4D *pA, const float s, Vect4D *pOut, const int count);
+	static void Scale(const Vect4DStreams &a, const float s, const Vect4DStreams &out, const int count);
+
+	// out = a * s[i], a scale per vector
+	static void Scale(const Vect4D *pA, const float *pS, Vect4D *pOut, const int count);
+	static void Scale(const Vect4DStreams &a, const float *pS, const Vect4DStreams &out, const int count);
+
+	// out = a * s + b
+	static void FMAdd(const Vect4D *pA, const float s, const Vect4D *pB, Vect4D *pOut, const int count);
+	static void FMAdd(const Vect4DStreams &a, const float s, const Vect4DStreams &b, const Vect4DStreams &out, const int count);
+
+	// out = a x k, w = 1
+	static void CrossConst(const Vect4D *pA, const Vect4D &k, Vect4D *pOut, const int count);
+	static void CrossConst(const Vect4DStreams &a, const Vect4D &k, const Vect4DStreams &out, const int count);
+
+	// out = a.xyz . b.xyz
+	static void Dot3(const Vect4D *pA, const Vect4D *pB, float *pOut, const int count);
+	static void Dot3(const Vect4DStreams &a, const Vect4DStreams &b, float *pOut, const int count);
+
+	// out = a / |a|, w = 1 - zero length vectors are copied as they are
+	static void Normalize(const Vect4D *pA, Vect4D *pOut, const int count);
+	static void Normalize(const Vect4DStreams &a, const Vect4DStreams &out, const int count);
+};
+
+#endif
+
+// --- End of File ---
@@ -0,0 +1,198 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include <math.h>
+#include "ViewFrustum.h"
+
+static inline float absMax(const float a, const float b)
+{
+	const float fa = fabsf(a);
+	const float fb = fabsf(b);
+	return (fa > fb) ? fa : fb;
+}
+
+// smallest |x| for x in [a,b]
+static inline float absMin(const float a, const float b)
+{
+	if( (a <= 0.0f) && (b >= 0.0f) )
+	{
+		return 0.0f;
+	}
+	const float fa = fabsf(a);
+	const float fb = fabsf(b);
+	return (fa < fb) ? fa : fb;
+}
+
+ViewFrustum::ViewFrustum()
+	: eye(0.0f, 0.0f, 0.0f),
+	tanX(1.0f),
+	tanY(1.0f),
+	tanR(sqrtf(2.0f)),
+	eyeXY(0.0f),
+	zNear(1.0f),
+	zFar(10000.0f),
+	radius(1.0f),
+	pixelScale(0.0f),
+	minPixels(0.0f)
+{
+}
+
+ViewFrustum::ViewFrustum(const Vect4D& _eye, float tanHalfFovY, float aspect, float _zNear, float _zFar, float _radius)
+	: eye(_eye),
+	tanX(tanHalfFovY * aspect),
+	tanY(tanHalfFovY),
+	tanR(sqrtf(tanX * tanX + tanY * tanY)),
+	eyeXY(sqrtf(_eye.x * _eye.x + _eye.y * _eye.y)),
+	zNear(_zNear),
+	zFar(_zFar),
+	radius(_radius),
+	pixelScale(0.0f),
+	minPixels(0.0f)
+{
+}
+
+ViewFrustum::~ViewFrustum()
+{
+	// nothing to delete
+}
+
+void ViewFrustum::setScreenSizeCulling(float screenHeight, float _minPixels)
+{
+	// half the screen covers tanY at depth 1
+	this->pixelScale = (0.5f * screenHeight) / this->tanY;
+	this->minPixels = _minPixels;
+}
+
+CullResult ViewFrustum::classify(const BoundingBox& posBounds, const BoundingBox& scaleBounds, const Vect4D& offset) const
+{
+	const Vect4D qMin = posBounds.vMin + offset;
+	const Vect4D qMax = posBounds.vMax + offset;
+	const Vect4D& sMin = scaleBounds.vMin;
+	const Vect4D& sMax = scaleBounds.vMax;
+
+	// z' = qz * sz over both intervals - scale can flip sign
+	const float p0 = qMin.z * sMin.z;
+	const float p1 = qMin.z * sMax.z;
+	const float p2 = qMax.z * sMin.z;
+	const float p3 = qMax.z * sMax.z;
+	const float zLo = fminf(fminf(p0, p1), fminf(p2, p3));
+	const float zHi = fmaxf(fmaxf(p0, p1), fmaxf(p2, p3));
+
+	// depth in front of the camera
+	const float dLo = this->eye.z - zHi;
+	const float dHi = this->eye.z - zLo;
+
+	const float sxy = fmaxf(absMax(sMin.x, sMax.x), absMax(sMin.y, sMax.y));
+	const float sAll = fmaxf(sxy, absMax(sMin.z, sMax.z));
+	const float r = this->radius * sAll * sAll;
+
+	if ((dHi + r < this->zNear) || (dLo - r > this->zFar))
+	{
+		return CullResult::Outside;
+	}
+
+	// radius of the (x,y) disc the rotation can sweep
+	const float qx = absMax(qMin.x, qMax.x);
+	const float qy = absMax(qMin.y, qMax.y);
+	const float rho = sqrtf(qx * qx + qy * qy) * sxy;
+
+	const float ex = fabsf(this->eye.x);
+	const float ey = fabsf(this->eye.y);
+
+	if ((ex - rho > this->tanX * (dHi + r) + r) || (ey - rho > this->tanY * (dHi + r) + r))
+	{
+		return CullResult::Outside;
+	}
+
+	// inner radius of the ring - past the frustum's corners at every angle
+	const float qxIn = absMin(qMin.x, qMax.x);
+	const float qyIn = absMin(qMin.y, qMax.y);
+	const float sxyMin = fminf(absMin(sMin.x, sMax.x), absMin(sMin.y, sMax.y));
+	const float rhoIn = sqrtf(qxIn * qxIn + qyIn * qyIn) * sxyMin;
+
+	if (rhoIn > this->eyeXY + this->tanR * (dHi + r) + r)
+	{
+		return CullResult::Outside;
+	}
+
+	bool bigEnough = true;
+	if( this->minPixels > 0.0f )
+	{
+		// biggest triangle at the closest depth still under the threshold
+		if( (dLo > this->zNear) && (2.0f * r * this->pixelScale < this->minPixels * dLo) )
+		{
+			return CullResult::SubPixel;
+		}
+
+		// smallest triangle at the farthest depth already over it
+		const float sMinAbs = fminf(fminf(absMin(sMin.x, sMax.x), absMin(sMin.y, sMax.y)), absMin(sMin.z, sMax.z));
+		const float rMin = this->radius * sMinAbs * sMinAbs;
+		bigEnough = (2.0f * rMin * this->pixelScale >= this->minPixels * dHi);
+	}
+
+	// fully inside when the nearest slice of the frustum already holds everything
+	const float dNear = dLo - r;
+	if ((dNear >= this->zNear) && (dHi + r <= this->zFar)
+		&& (ex + rho + r <= this->tanX * dNear)
+		&& (ey + rho + r <= this->tanY * dNear)
+		&& bigEnough)
+	{
+		return CullResult::Inside;
+	}
+
+	return CullResult::Intersect;
+}
+
+CullResult ViewFrustum::classifyParticle(const Vect4D& pos, const Vect4D& scale, const Vect4D& offset) const
+{
+	const float qx = pos.x + offset.x;
+	const float qy = pos.y + offset.y;
+	const float qz = pos.z + offset.z;
+
+	const float sxy = absMax(scale.x, scale.y);
+	const float sxyMin = fminf(fabsf(scale.x), fabsf(scale.y));
+	const float sAll = fmaxf(sxy, fabsf(scale.z));
+	const float r = this->radius * sAll * sAll;
+
+	// depth in front of the camera
+	const float d = this->eye.z - qz * scale.z;
+	if ((d + r < this->zNear) || (d - r > this->zFar))
+	{
+		return CullResult::Outside;
+	}
+
+	// squared radius of the (x,y) disc - no sqrt needed
+	const float q2 = qx * qx + qy * qy;
+	const float rho2 = q2 * sxy * sxy;
+	const float depth = d + r;
+
+	// inner radius of the ring past the frustum's corners
+	const float reach = this->eyeXY + this->tanR * depth + r;
+	if (reach * reach < q2 * sxyMin * sxyMin)
+	{
+		return CullResult::Outside;
+	}
+
+	const float gapX = fabsf(this->eye.x) - (this->tanX * depth + r);
+	if ((gapX > 0.0f) && (gapX * gapX > rho2))
+	{
+		return CullResult::Outside;
+	}
+
+	const float gapY = fabsf(this->eye.y) - (this->tanY * depth + r);
+	if ((gapY > 0.0f) && (gapY * gapY > rho2))
+	{
+		return CullResult::Outside;
+	}
+
+	// projected size from the center depth
+	if( (this->minPixels > 0.0f) && (d > this->zNear) && (2.0f * r * this->pixelScale < this->minPixels * d) )
+	{
+		return CullResult::SubPixel;
+	}
+
+	return CullResult::Inside;
+}
+
+// --- End of File ---
@@ -0,0 +1,112 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef VIEW_FRUSTUM_H
+#define VIEW_FRUSTUM_H
+
+// includes
+#include <math.h>
+#include "Enum.h"
+#include "Vect4D.h"
+#include "BoundingBox.h"
+#include "Simd.h"
+
+// Conservative view volume for the particle transform
+//
+//     draw() places each particle at   ((pos + offset) * RotZ) * Scale
+//     RotZ never changes z or the length of (x,y), so without any sin/cos:
+//          z'      = (pos.z + offset.z) * scale.z
+//          |xy'|  <= |pos.xy + offset.xy| * max(|scale.x|, |scale.y|)
+//     and the triangle around it is at most radius * maxScale^2 wide.
+//     The rotation can put (x,y) anywhere on that ring, so the side planes
+//     are tested against the ring: its nearest point per axis, and its
+//     inner radius |pos.xy + offset.xy| * min(|scale.x|, |scale.y|) against
+//     the circle around the frustum's cross section.
+//
+//     The camera looks down -Z from eye. draw() loads each world matrix as
+//     the whole GL modelview with the camera already in offset, so the eye
+//     is the origin of that space (see main) and the volume is the wrapper's
+//     glFrustum.
+//
+//     Screen size culling: a particle whose projected triangle is smaller
+//     than minPixels (2 * extent / depth * pixelScale) is reported as SubPixel
+class ViewFrustum
+{
+public:
+	ViewFrustum();
+	ViewFrustum(const Vect4D& eye, float tanHalfFovY, float aspect, float zNear, float zFar, float radius);
+	ViewFrustum(const ViewFrustum& r) = default;
+	ViewFrustum& operator = (const ViewFrustum& r) = default;
+	~ViewFrustum();
+
+	// minPixels <= 0 turns the screen size test off
+	void setScreenSizeCulling(float screenHeight, float minPixels);
+
+	// whole chunk test: position and scale boxes of every particle in the chunk
+	//     Inside only when every particle is in view and big enough
+	CullResult classify(const BoundingBox& posBounds, const BoundingBox& scaleBounds, const Vect4D& offset) const;
+
+	// single particle test, only needed when the chunk is Intersect
+	//     returns Outside, SubPixel or Inside
+	CullResult classifyParticle(const Vect4D& pos, const Vect4D& scale, const Vect4D& offset) const;
+
+	// classifyParticle on V::WIDTH particles at once, q = pos + offset
+	//     same operations in the same order, so every lane agrees with it;
+	//     lanes in neither mask are Inside
+	template <typename V>
+	void classifyLanes(const V& qx, const V& qy, const V& qz, const V& sx, const V& sy, const V& sz,
+		typename V::Mask& outside, typename V::Mask& subPixel) const
+	{
+		const V sxy = V::Max(V::Abs(sx), V::Abs(sy));
+		const V sxyMin = V::Min(V::Abs(sx), V::Abs(sy));
+		const V sAll = V::Max(sxy, V::Abs(sz));
+		const V r = V::Set1(this->radius) * sAll * sAll;
+
+		const V d = V::Set1(this->eye.z) - qz * sz;
+		outside = V::CmpLT(d + r, V::Set1(this->zNear)) | V::CmpLT(V::Set1(this->zFar), d - r);
+
+		const V q2 = qx * qx + qy * qy;
+		const V rho2 = q2 * sxy * sxy;
+		const V depth = d + r;
+
+		const V reach = V::Set1(this->eyeXY) + V::Set1(this->tanR) * depth + r;
+		outside = outside | V::CmpLT(reach * reach, q2 * sxyMin * sxyMin);
+
+		const V gapX = V::Set1(fabsf(this->eye.x)) - (V::Set1(this->tanX) * depth + r);
+		outside = outside | (V::CmpLT(V::Zero(), gapX) & V::CmpLT(rho2, gapX * gapX));
+
+		const V gapY = V::Set1(fabsf(this->eye.y)) - (V::Set1(this->tanY) * depth + r);
+		outside = outside | (V::CmpLT(V::Zero(), gapY) & V::CmpLT(rho2, gapY * gapY));
+
+		// no lanes when screen size culling is off
+		subPixel = V::CmpLT(V::Zero(), V::Zero());
+		if( this->minPixels > 0.0f )
+		{
+			subPixel = V::CmpLT(V::Set1(this->zNear), d) & V::CmpLT(V::Set1(2.0f) * r * V::Set1(this->pixelScale), V::Set1(this->minPixels) * d);
+			subPixel = subPixel & ~outside;
+		}
+	}
+
+	// distance in front of the camera of the particle center
+	inline float depth(const Vect4D& pos, const Vect4D& scale, const Vect4D& offset) const
+	{
+		return this->eye.z - (pos.z + offset.z) * scale.z;
+	}
+
+private:
+	Vect4D	eye;
+	float	tanX;
+	float	tanY;
+	float	tanR;			// corner of the cross section at depth 1
+	float	eyeXY;			// eye distance from the z axis
+	float	zNear;
+	float	zFar;
+	float	radius;
+	float	pixelScale;		// pixels per unit at depth 1
+	float	minPixels;
+};
+
+#endif
+
+// --- End of File ---
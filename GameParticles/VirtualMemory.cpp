@@ -0,0 +1,138 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#include "VirtualMemory.h"
+
+size_t VirtualMemory::PageSize()
+{
+	static size_t pageSize = 0;
+	if( pageSize == 0 )
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		pageSize = (size_t)info.dwPageSize;
+	}
+	return pageSize;
+}
+
+bool VirtualMemory::privEnableLargePages()
+{
+	HANDLE hToken = nullptr;
+	if( !OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken) )
+	{
+		return false;
+	}
+
+	TOKEN_PRIVILEGES privileges = {};
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+	bool enabled = false;
+	if( LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) )
+	{
+		// succeeds even when the account doesn't hold the right - check the error
+		AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, nullptr, nullptr);
+		enabled = (GetLastError() == ERROR_SUCCESS);
+	}
+
+	CloseHandle(hToken);
+	return enabled;
+}
+
+size_t VirtualMemory::LargePageSize()
+{
+	// asked once, the privilege doesn't come and go
+	static int state = -1;
+	if( state < 0 )
+	{
+		state = (GetLargePageMinimum() != 0 && VirtualMemory::privEnableLargePages()) ? 1 : 0;
+	}
+	return (state == 1) ? GetLargePageMinimum() : 0;
+}
+
+size_t VirtualMemory::RoundUp(size_t bytes, size_t granularity)
+{
+	return ((bytes + granularity - 1) / granularity) * granularity;
+}
+
+void *VirtualMemory::Reserve(size_t bytes)
+{
+	return VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool VirtualMemory::Commit(void *p, size_t bytes, int nodeNumber)
+{
+	if( bytes == 0 )
+	{
+		return true;
+	}
+
+	void *pCommitted = nullptr;
+	if( nodeNumber >= 0 )
+	{
+		pCommitted = VirtualAllocExNuma(GetCurrentProcess(), p, bytes, MEM_COMMIT, PAGE_READWRITE, (DWORD)nodeNumber);
+	}
+	if( pCommitted == nullptr )
+	{
+		pCommitted = VirtualAlloc(p, bytes, MEM_COMMIT, PAGE_READWRITE);
+	}
+	return pCommitted != nullptr;
+}
+
+void VirtualMemory::Decommit(void *p, size_t bytes)
+{
+	if( bytes != 0 )
+	{
+		VirtualFree(p, bytes, MEM_DECOMMIT);
+	}
+}
+
+void *VirtualMemory::AllocLarge(size_t &bytes, int nodeNumber)
+{
+	const size_t largePage = VirtualMemory::LargePageSize();
+	if( largePage == 0 )
+	{
+		return nullptr;
+	}
+
+	const size_t size = VirtualMemory::RoundUp(bytes, largePage);
+	const DWORD type = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+
+	// fails on fragmented physical memory - not enough contiguous large pages
+	void *p = (nodeNumber >= 0)
+		? VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, type, PAGE_READWRITE, (DWORD)nodeNumber)
+		: VirtualAlloc(nullptr, size, type, PAGE_READWRITE);
+
+	if( p != nullptr )
+	{
+		bytes = size;
+	}
+	return p;
+}
+
+void VirtualMemory::Release(void *p)
+{
+	if( p != nullptr )
+	{
+		VirtualFree(p, 0, MEM_RELEASE);
+	}
+}
+
+void VirtualMemory::Touch(void *p, size_t bytes)
+{
+	const size_t page = VirtualMemory::PageSize();
+	volatile char *pBytes = static_cast<volatile char *>(p);
+
+	for( size_t offset = 0; offset < bytes; offset += page )
+	{
+		pBytes[offset] = pBytes[offset];
+	}
+	if( bytes > 0 )
+	{
+		// the last page when p isn't page aligned
+		pBytes[bytes - 1] = pBytes[bytes - 1];
+	}
+}
+
+// --- End of File ---
@@ -0,0 +1,45 @@
+//---------------------------------------------------------------
+// Copyright 2024, Ed Keenan, all rights reserved.
+//---------------------------------------------------------------
+
+#ifndef VIRTUAL_MEMORY_H
+#define VIRTUAL_MEMORY_H
+
+// Page level memory (VirtualAlloc) for the big particle arrays
+//
+//     Reserve() takes address space only, Commit() / Decommit() move the
+//     committed part in COMMIT_GRANULE steps - the range never moves, so
+//     pointers into it stay valid while it grows.
+//
+//     AllocLarge() needs the "Lock pages in memory" right
+//     (SeLockMemoryPrivilege), enabled on first use. Large pages come
+//     committed and locked, they can't grow or shrink.
+class VirtualMemory
+{
+public:
+	static const size_t COMMIT_GRANULE = 64 * 1024;
+
+	static size_t PageSize();
+	static size_t LargePageSize();		// 0 when large pages can't be used
+	static size_t RoundUp(size_t bytes, size_t granularity);
+
+	// nodeNumber -1: any node
+	static void *Reserve(size_t bytes);
+	static bool Commit(void *p, size_t bytes, int nodeNumber);
+	static void Decommit(void *p, size_t bytes);
+
+	// committed large pages, bytes rounded up - nullptr when not available
+	static void *AllocLarge(size_t &bytes, int nodeNumber);
+
+	static void Release(void *p);
+
+	// one write per page, so the faults happen here and not in a frame
+	static void Touch(void *p, size_t bytes);
+
+private:
+	static bool privEnableLargePages();
+};
+
+#endif
+
+// --- End of File ---
@@ -8,22 +8,102 @@
 // -----------------------------------------------------------
 #include "OpenGLDevice.h"
 #include "Settings.h"
-#include "ParticleEmitter.h"
+#include "EmitterSystem.h"
+#include "JobSystem.h"
+#include "PinBenchmark.h"
+#include "SoATranspose.h"
+#include "PageFaultMonitor.h"
+#include "AllocProfiler.h"
+#include "HalfFloat.h"
+#include "CpuFeatures.h"
+
+static int WorkerCount()
+{
+	if( NUM_WORKER_THREADS >= 0 )
+	{
+		return NUM_WORKER_THREADS;
+	}
+
+	// leave the main thread its own core
+	const int hw = (int)std::thread::hardware_concurrency();
+	return (hw > 1) ? hw - 1 : 0;
+}
+
+static EmitterParams SceneParams(int e)
+{
+	EmitterParams params;
+
+#if SCENE_EMITTERS > 1
+	// a square grid centered on the original emitter, NUM_PARTICLES split evenly
+	int side = 1;
+	while( side * side < SCENE_EMITTERS )
+	{
+		side++;
+	}
+
+	const float half = 0.5f * (float)(side - 1);
+	const float x = ((float)(e % side) - half) * SCENE_SPACING;
+	const float z = ((float)(e / side) - half) * SCENE_SPACING;
+	params.startPosition = Vect4D(x, 2.0f, 2.0f + z);
+
+	params.maxParticles = NUM_PARTICLES / SCENE_EMITTERS;
+	params.reserveParticles = params.maxParticles;
+#else
+	AZUL_UNUSED_VAR(e);
+#endif
+
+	return params;
+}
 
 int main()
 {
 	Trace::out("Num Particle: %.1e time:%.1f\n",(float)NUM_PARTICLES,MAX_LIFE);
 
+	Debug::Create();
+	Debug::SetCurrentName("--- Main ---");
+
+#if RUN_PIN_BENCHMARK
+	// burns rand() - before the seed
+	PinBenchmark::Run(PIN_BENCHMARK_FRAMES, (PinMode)WORKER_PIN_MODE);
+#endif
+
+	CpuFeatures::Get().report();
+
+#if RUN_TRANSPOSE_BENCHMARK
+	SoATranspose::Benchmark(TRANSPOSE_BENCHMARK_COUNT, TRANSPOSE_BENCHMARK_REPS);
+#endif
+
+#if PARTICLE_HALF_ATTRIBUTES
+	HalfFloat::Report();
+#endif
+
 	srand(1);
 
+	{	// workers and emitters must be gone before Debug::Destroy()
+
 	// initialize timers:------------------------------
 
 		// Create a timer objects
 		PerformanceTimer updateTimer;
 		PerformanceTimer drawTimer;
 
-	// create an emitter:-------------------------------
-		ParticleEmitter emitter;
+		// faults from here on - setup, then the first frames
+		PageFaultMonitor faults(PAGE_FAULT_FRAMES);
+
+		// heap use of the loop, per frame and per stage
+		AllocProfiler allocs(ALLOC_WARM_UP_FRAMES);
+
+	// create the job system:--------------------------
+		JobSystem jobs(WorkerCount(), WORKER_SPIN_BUDGET, (PinMode)WORKER_PIN_MODE);
+		jobs.report();
+
+	// create the emitters:-----------------------------
+		EmitterSystem emitters(&jobs, SCENE_EMITTERS);
+		ParticleEmitter &firstEmitter = emitters.add(nullptr, SceneParams(0));
+		for( int e = 1; e < SCENE_EMITTERS; e++ )
+		{
+			emitters.add(nullptr, SceneParams(e));
+		}
 
 	// Get the inverse Camera Matrix:-------------------
 
@@ -55,6 +135,24 @@ int main()
 		//       there is a float version (hint)
 		// ------------------------------------------------
 		OpenGLDevice::SetCameraMatrixDouble((const double *)&inverseCameraMatrix);
+
+		// culling volume - the particles' world matrices replace this camera
+		// (the emitter folds its own camera into them), so the eye is their origin
+		const Vect4D eye(0.0f, 0.0f, 0.0f);
+		ViewFrustum frustum(eye, VIEW_TAN_HALF_FOV_Y, VIEW_ASPECT, VIEW_NEAR, VIEW_FAR, VIEW_PARTICLE_RADIUS);
+
+		// the window exists now - its viewport is what the pixels are counted in
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		frustum.setScreenSizeCulling((float)viewport[3], VIEW_MIN_PIXELS);
+		emitters.setViewFrustum(frustum);
+
+	// build the frame graphs:--------------------------
+		emitters.build();
+		emitters.getPool().report();
+		emitters.dumpSchedule();
+		faults.startup();
+		allocs.startup();
 	
 	// main update loop... do this forever or until some breaks 
 	while(OpenGLDevice::IsRunning())
@@ -62,8 +160,8 @@ int main()
 		// start update timer ---------------------------------------
 		updateTimer.Tic();
 
-			// update the emitter
-			emitter.update();
+			// update the emitters
+			emitters.update();
 
 		// stop update timer: -----------------------------------------
 		updateTimer.Toc();
@@ -72,11 +170,14 @@ int main()
 		drawTimer.Tic();
 
 			// draw particles
-			emitter.draw();
+			emitters.draw();
 		
 		// stop draw timer: -----------------------------------------
 		drawTimer.Toc();
 
+		faults.frame();
+		allocs.frame();
+
 		// LEAVE the loop below alone
 		if( i++ > PRINT_COUNT ) 
 		{
@@ -86,6 +187,23 @@ int main()
 			printf("LoopTime: update:%f ms  draw:%f ms  tot:%f\n",updateTime * 1000.0f, drawTime * 1000.0f, (updateTime + drawTime) *1000.0f);
 		}
 	}
+
+		emitters.dumpTimings();
+		jobs.getWakeBarrier().report("workers");
+		faults.report();
+		allocs.report();
+		emitters.report();
+		emitters.reportMemory();
+
+#if PARTICLE_SPAWN_TABLE
+		// the table is picked by the first spawn
+		firstEmitter.getSpawn().report();
+#else
+		AZUL_UNUSED_VAR(firstEmitter);
+#endif
+
+	}	// workers join here
+	Debug::Destroy();
 	
     return 0;
 }